@@ -15,6 +15,16 @@ const std::vector<uint8_t>& Assembler::getOpcodes() {
 	return m_opcodes;
 }
 
+const std::vector<Symbol>& Assembler::getSymbols() {
+	std::scoped_lock lock(m_mtx);
+	return m_symbols;
+}
+
+const std::vector<SourceLine>& Assembler::getLines() {
+	std::scoped_lock lock(m_mtx);
+	return m_lines;
+}
+
 Assembler::Assembler(const std::vector<std::shared_ptr<Instruction>>& instructions) {
 	std::vector<uint8_t> opcodes;
 	std::unordered_map<size_t, size_t> instr_map;
@@ -39,6 +49,11 @@ Assembler::Assembler(const std::vector<std::shared_ptr<Instruction>>& instructio
 				il_operands.push_back(IL_CreateOperandRegister(id, size));
 				break;
 			}
+			case OperandKind::Vector: {
+				const std::shared_ptr<VectorOperand>& vec = std::static_pointer_cast<VectorOperand>(operand);
+				il_operands.push_back(IL_CreateOperandVector(vec->getId(), vec->isWide(), vec->getLane()));
+				break;
+			}
 			case OperandKind::Location: {
 				// Find the instruction with that location
 				const std::shared_ptr<LocationOperand>& loc = std::static_pointer_cast<LocationOperand>(operand);
@@ -107,8 +122,23 @@ Assembler::Assembler(const std::vector<std::shared_ptr<Instruction>>& instructio
 		}
 
 		assert(corrected);
+		(void)corrected;
+	}
+
+	// Labels become symbols, line numbered locations are not worth a name
+	std::vector<Symbol> symbols;
+	std::vector<SourceLine> lines;
+	for (size_t insn_idx = 0; insn_idx < instructions.size(); ++insn_idx) {
+		const std::shared_ptr<Instruction>& instruction = instructions[insn_idx];
+		if (instruction->isLabeled()) {
+			symbols.push_back({ instruction->getLocation(), instr_map[insn_idx] });
+		}
+
+		lines.push_back({ instr_map[insn_idx], instruction->getLine() + 1 });
 	}
 
 	std::scoped_lock lock(m_mtx);
 	m_opcodes.insert(m_opcodes.end(), opcodes.begin(), opcodes.end());
+	m_symbols.insert(m_symbols.end(), symbols.begin(), symbols.end());
+	m_lines.insert(m_lines.end(), lines.begin(), lines.end());
 }
@@ -2,16 +2,31 @@
 
 #include <vector>
 #include <mutex>
+#include <string>
 
 #include "parser.hpp"
 
+struct Symbol {
+	std::string name;
+	size_t offset; // In the code section
+};
+
+struct SourceLine {
+	size_t offset; // In the code section
+	size_t line; // 1-based
+};
+
 class Assembler {
 private:
 	std::mutex m_mtx;
 	std::vector<uint8_t> m_opcodes;
+	std::vector<Symbol> m_symbols;
+	std::vector<SourceLine> m_lines;
 
 public:
 	const std::vector<uint8_t>& getOpcodes();
+	const std::vector<Symbol>& getSymbols();
+	const std::vector<SourceLine>& getLines();
 
 	Assembler(const std::vector<std::shared_ptr<Instruction>>& instructions);
 };
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include "image.hpp"
+#include "image.h"
+
+template <typename T>
+static void AppendBytes(std::vector<uint8_t>& data, const T& value) {
+	size_t old = data.size();
+	data.resize(old + sizeof(value));
+	memcpy(data.data() + old, &value, sizeof(value));
+}
+
+void ImageWriter::addSection(IL_SectionType type, const std::vector<uint8_t>& data) {
+	m_sections.emplace_back(type, data);
+}
+
+void ImageWriter::addSymbols(const std::vector<Symbol>& symbols) {
+	std::vector<uint8_t> data;
+
+	IL_ImageSymbols header = {};
+	header.count = static_cast<uint32_t>(symbols.size());
+	AppendBytes(data, header);
+
+	std::vector<uint8_t> names;
+	for (const Symbol& symbol : symbols) {
+		IL_ImageSymbol entry = {};
+		entry.offset = symbol.offset;
+		entry.name = static_cast<uint32_t>(names.size());
+		AppendBytes(data, entry);
+
+		names.insert(names.end(), symbol.name.begin(), symbol.name.end());
+		names.push_back('\0');
+	}
+
+	data.insert(data.end(), names.begin(), names.end());
+	addSection(IL_SECTION_SYMBOLS, data);
+}
+
+static void AppendVarint(std::vector<uint8_t>& data, uint64_t value) {
+	while (value >= 0x80) {
+		data.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+
+	data.push_back(static_cast<uint8_t>(value));
+}
+
+void ImageWriter::addLines(const std::vector<SourceLine>& lines) {
+	std::vector<uint8_t> data;
+
+	IL_ImageLines header = {};
+	header.count = static_cast<uint32_t>(lines.size());
+	AppendBytes(data, header);
+
+	// Mostly one byte each, instructions are short and on consecutive lines
+	size_t offset = 0;
+	int64_t line = 0;
+	for (const SourceLine& entry : lines) {
+		int64_t delta = static_cast<int64_t>(entry.line) - line;
+		AppendVarint(data, entry.offset - offset);
+		AppendVarint(data, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+
+		offset = entry.offset;
+		line = static_cast<int64_t>(entry.line);
+	}
+
+	addSection(IL_SECTION_LINES, data);
+}
+
+void ImageWriter::addMetadata(const std::string& key, const std::string& value) {
+	std::string line = key + "=" + value + "\n";
+	for (auto& [type, data] : m_sections) {
+		if (type == IL_SECTION_METADATA) {
+			data.insert(data.end(), line.begin(), line.end());
+			return;
+		}
+	}
+
+	addSection(IL_SECTION_METADATA, std::vector<uint8_t>(line.begin(), line.end()));
+}
+
+std::vector<uint8_t> ImageWriter::build() const {
+	size_t header_size = sizeof(IL_ImageHeader) + m_sections.size() * sizeof(IL_ImageSection);
+
+	std::vector<uint8_t> image;
+	IL_ImageHeader header = {};
+	header.magic = IL_IMAGE_MAGIC;
+	header.version = IL_IMAGE_VERSION;
+	header.section_count = static_cast<uint16_t>(m_sections.size());
+	header.header_size = static_cast<uint32_t>(header_size);
+	AppendBytes(image, header);
+
+	// Section data follows the table, each aligned
+	size_t offset = header_size;
+	for (const auto& [type, data] : m_sections) {
+		offset = (offset + IL_IMAGE_ALIGNMENT - 1) & ~static_cast<size_t>(IL_IMAGE_ALIGNMENT - 1);
+
+		IL_ImageSection section = {};
+		section.type = type;
+		section.offset = offset;
+		section.size = data.size();
+		AppendBytes(image, section);
+
+		offset += data.size();
+	}
+
+	for (const auto& [type, data] : m_sections) {
+		image.resize((image.size() + IL_IMAGE_ALIGNMENT - 1) & ~static_cast<size_t>(IL_IMAGE_ALIGNMENT - 1));
+		image.insert(image.end(), data.begin(), data.end());
+	}
+
+	return image;
+}
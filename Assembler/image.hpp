@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <utility>
+
+#include "assembler.hpp"
+#include "image.h"
+
+// Lays out sections behind an IL_ImageHeader, see Shared/image.h
+class ImageWriter {
+private:
+	std::vector<std::pair<IL_SectionType, std::vector<uint8_t>>> m_sections;
+
+public:
+	void addSection(IL_SectionType type, const std::vector<uint8_t>& data);
+	void addSymbols(const std::vector<Symbol>& symbols);
+	void addLines(const std::vector<SourceLine>& lines);
+	void addMetadata(const std::string& key, const std::string& value);
+
+	std::vector<uint8_t> build() const;
+};
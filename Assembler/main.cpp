@@ -7,6 +7,7 @@
 #include "tokenizer.hpp"
 #include "parser.hpp"
 #include "assembler.hpp"
+#include "image.hpp"
 
 void SaveFile(const std::string& filename, const std::vector<uint8_t>& data) {
     std::ofstream file(filename, std::ios::binary);
@@ -55,13 +56,15 @@ std::vector<std::string> ReadSource(const std::string& filename) {
 }
 
 int main(int argc, char* argv[]) {
-	if (argc != 3) {
-		std::cerr << "Usage: " << argv[0] << " <input file> <output file>" << std::endl;
+	// -g adds the line table, the code is the same either way
+	bool lines = argc == 4 && std::string(argv[1]) == "-g";
+	if (argc != 3 && !lines) {
+		std::cerr << "Usage: " << argv[0] << " [-g] <input file> <output file>" << std::endl;
 		return EXIT_FAILURE;
 	}
 
-	std::string input_file = argv[1];
-	std::string output_file = argv[2];
+	std::string input_file = argv[argc - 2];
+	std::string output_file = argv[argc - 1];
 
 	std::cout << "Reading source file: " << input_file << std::endl;
 	std::vector<std::string> source = ReadSource(input_file);
@@ -75,8 +78,17 @@ int main(int argc, char* argv[]) {
 	std::cout << "Generating opcodes..." << std::endl;
     Assembler assembler(parser.getInstructions());
 
-	std::cout << "Saving opcodes to file: " << output_file << std::endl;
-	SaveFile(output_file, assembler.getOpcodes());
+	ImageWriter image;
+	image.addSection(IL_SECTION_CODE, assembler.getOpcodes());
+	image.addSymbols(assembler.getSymbols());
+	if (lines) {
+		image.addLines(assembler.getLines());
+	}
+
+	image.addMetadata("source", input_file);
+
+	std::cout << "Saving image to file: " << output_file << std::endl;
+	SaveFile(output_file, image.build());
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
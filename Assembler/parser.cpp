@@ -4,6 +4,7 @@
 #include <unordered_map>
 #include <cassert>
 #include <algorithm>
+#include <cctype>
 
 #include "tokenizer.hpp"
 #include "il.h"
@@ -29,7 +30,24 @@ const std::unordered_map<std::string, IL_Mnemonic> MNEMONICS_MAP = {
 	{ "POP", IL_MNEMONIC_POP },
 	{ "CALL", IL_MNEMONIC_CALL },
 	{ "RETURN", IL_MNEMONIC_RETURN },
-	{ "HALT", IL_MNEMONIC_HALT }
+	{ "HALT", IL_MNEMONIC_HALT },
+	{ "HOSTCALL", IL_MNEMONIC_HOSTCALL },
+	{ "MEMCPY", IL_MNEMONIC_MEMCPY },
+	{ "MEMSET", IL_MNEMONIC_MEMSET },
+	{ "MEMCMP", IL_MNEMONIC_MEMCMP },
+	{ "VLOAD", IL_MNEMONIC_VLOAD },
+	{ "VSTORE", IL_MNEMONIC_VSTORE },
+	{ "VSPLAT", IL_MNEMONIC_VSPLAT },
+	{ "VMASK", IL_MNEMONIC_VMASK },
+	{ "VADD", IL_MNEMONIC_VADD },
+	{ "VSUB", IL_MNEMONIC_VSUB },
+	{ "VMUL", IL_MNEMONIC_VMUL },
+	{ "VAND", IL_MNEMONIC_VAND },
+	{ "VOR", IL_MNEMONIC_VOR },
+	{ "VXOR", IL_MNEMONIC_VXOR },
+	{ "VCMPEQ", IL_MNEMONIC_VCMPEQ },
+	{ "VCMPGT", IL_MNEMONIC_VCMPGT },
+	{ "VSHUF", IL_MNEMONIC_VSHUF }
 };
 
 const std::unordered_map<std::string, IL_Conditions> CONDITIONS_MAP = {
@@ -46,6 +64,45 @@ const std::vector<std::string> REGISTERS_MAP = {
 	"R8", "R9", "R10", "R11", "R12", "SP", "IP", "CD",
 };
 
+// The whole name has to match, R1 is a prefix of R10 to R12
+static bool IsRegisterName(const std::string& upper_token, const std::string& reg) {
+	return upper_token.starts_with(reg) && (upper_token.size() == reg.size() || upper_token[reg.size()] == '.');
+}
+
+// X0 to X15 and Y0 to Y15, optionally followed by the lane size like registers are by theirs
+static bool ParseVectorName(const std::string& upper_token, uint8_t& id, bool& wide, uint8_t& lane) {
+	if (upper_token.size() < 2 || (upper_token[0] != 'X' && upper_token[0] != 'Y')) {
+		return false;
+	}
+
+	size_t end = 1;
+	unsigned value = 0;
+	while (end < upper_token.size() && isdigit((unsigned char)upper_token[end]) && end < 3) {
+		value = value * 10 + (upper_token[end] - '0');
+		++end;
+	}
+
+	if (end == 1 || value >= IL_VECTOR_REGISTERS_COUNT) {
+		return false;
+	}
+
+	lane = 8;
+	if (end < upper_token.size()) {
+		if (upper_token[end] != '.' || upper_token.size() != end + 2) {
+			return false;
+		}
+
+		lane = upper_token[end + 1] - '0';
+		if (lane != 1 && lane != 2 && lane != 4 && lane != 8) {
+			return false;
+		}
+	}
+
+	id = (uint8_t)value;
+	wide = upper_token[0] == 'Y';
+	return true;
+}
+
 // add opereator |= for IL_Conditions
 IL_Conditions operator|=(IL_Conditions& lhs, IL_Conditions rhs) {
 	return lhs = static_cast<IL_Conditions>(static_cast<int>(lhs) | static_cast<int>(rhs));
@@ -66,6 +123,25 @@ uint8_t RegisterOperand::getSize() const {
 	return m_size;
 }
 
+VectorOperand::VectorOperand(uint8_t id, bool wide, uint8_t lane)
+	: m_id(id), m_wide(wide), m_lane(lane) {}
+
+OperandKind VectorOperand::getKind() {
+	return OperandKind::Vector;
+}
+
+uint8_t VectorOperand::getId() const {
+	return m_id;
+}
+
+bool VectorOperand::isWide() const {
+	return m_wide;
+}
+
+uint8_t VectorOperand::getLane() const {
+	return m_lane;
+}
+
 LocationOperand::LocationOperand(const std::string& location)
 	: m_location(location) {}
 
@@ -92,13 +168,21 @@ size_t ImmediateOperand::getSize() const {
 	return m_size;
 }
 
-Instruction::Instruction(const std::string& location, IL_Mnemonic mnemonic, IL_Conditions conditions, const std::vector<std::shared_ptr<Operand>>& operands)
-	: m_location(location), m_mnemonic(mnemonic), m_conditions(conditions), m_operands(operands) {}
+Instruction::Instruction(const std::string& location, bool labeled, size_t line, IL_Mnemonic mnemonic, IL_Conditions conditions, const std::vector<std::shared_ptr<Operand>>& operands)
+	: m_location(location), m_labeled(labeled), m_line(line), m_operands(operands), m_mnemonic(mnemonic), m_conditions(conditions) {}
 
 const std::string& Instruction::getLocation() const {
 	return m_location;
 }
 
+bool Instruction::isLabeled() const {
+	return m_labeled;
+}
+
+size_t Instruction::getLine() const {
+	return m_line;
+}
+
 IL_Mnemonic Instruction::getMnemonic() const {
 	return m_mnemonic;
 }
@@ -135,7 +219,7 @@ bool Parser::isRegister(const std::shared_ptr<Token>& token) {
 	std::transform(upper_token.begin(), upper_token.end(), upper_token.begin(), toupper);
 
 	for (const std::string& reg : REGISTERS_MAP) {
-		if (upper_token.starts_with(reg)) {
+		if (IsRegisterName(upper_token, reg)) {
 			return true;
 		}
 	}
@@ -143,6 +227,16 @@ bool Parser::isRegister(const std::shared_ptr<Token>& token) {
 	return false;
 }
 
+bool Parser::isVector(const std::shared_ptr<Token>& token) {
+	std::string upper_token = token->getValue();
+	std::transform(upper_token.begin(), upper_token.end(), upper_token.begin(), toupper);
+
+	uint8_t id = 0;
+	bool wide = false;
+	uint8_t lane = 0;
+	return ParseVectorName(upper_token, id, wide, lane);
+}
+
 bool Parser::isLocation(const std::shared_ptr<Token>& token) {
 	return token->getValue().starts_with("@");
 }
@@ -190,7 +284,7 @@ std::shared_ptr<Operand> Parser::parseOperand(const std::shared_ptr<Token>& toke
 
 		uint8_t id = 0;
 		for (const std::string& reg : REGISTERS_MAP) {
-			if (upper_token.starts_with(reg)) {
+			if (IsRegisterName(upper_token, reg)) {
 				// if after the register name there's ".", then get the size otherwise the size is 8 by default
 				uint8_t size = 8;
 				if (upper_token.size() > reg.size() && upper_token[reg.size()] == '.') {
@@ -204,6 +298,16 @@ std::shared_ptr<Operand> Parser::parseOperand(const std::shared_ptr<Token>& toke
 			++id;
 		}
 	}
+	else if (isVector(token)) {
+		std::string upper_token = token->getValue();
+		std::transform(upper_token.begin(), upper_token.end(), upper_token.begin(), toupper);
+
+		uint8_t id = 0;
+		bool wide = false;
+		uint8_t lane = 0;
+		ParseVectorName(upper_token, id, wide, lane);
+		return std::make_shared<VectorOperand>(id, wide, lane);
+	}
 	else if (isLocation(token)) {
 		std::string location = token->getValue().substr(1);
 		return std::make_shared<LocationOperand>(location);
@@ -215,6 +319,8 @@ std::shared_ptr<Operand> Parser::parseOperand(const std::shared_ptr<Token>& toke
 
 		return std::make_shared<ImmediateOperand>(num, size);
 	}
+
+	return nullptr;
 }
 
 const std::vector<std::shared_ptr<Instruction>>& Parser::getInstructions() {
@@ -260,7 +366,8 @@ Parser::Parser(const std::vector<std::shared_ptr<Token>>& tokens) {
 			}
 
 			std::string location;
-			if (!next_location.empty()) {
+			bool labeled = !next_location.empty();
+			if (labeled) {
 				location = next_location;
 				next_location.clear();
 			}
@@ -268,7 +375,7 @@ Parser::Parser(const std::vector<std::shared_ptr<Token>>& tokens) {
 				location = std::to_string(line);
 			}
 
-			instructions.push_back(std::make_unique<Instruction>(location, mnemonic, conditions, operands));
+			instructions.push_back(std::make_unique<Instruction>(location, labeled, line, mnemonic, conditions, operands));
 			break;
 		}
 		default: {
@@ -9,6 +9,7 @@
 
 enum class OperandKind {
 	Register,
+	Vector,
 	Location,
 	Immediate
 };
@@ -32,6 +33,22 @@ public:
 	uint8_t getSize() const;
 };
 
+class VectorOperand : public Operand {
+private:
+	uint8_t m_id;
+	bool m_wide;
+	uint8_t m_lane;
+
+public:
+	VectorOperand(uint8_t id, bool wide, uint8_t lane);
+
+	OperandKind getKind() override;
+
+	uint8_t getId() const;
+	bool isWide() const;
+	uint8_t getLane() const;
+};
+
 class LocationOperand : public Operand {
 private:
 	std::string m_location;
@@ -61,14 +78,18 @@ public:
 class Instruction {
 private:
 	std::string m_location;
+	bool m_labeled; // Location comes from a label, not the line number
+	size_t m_line; // 0-based source line
 	std::vector<std::shared_ptr<Operand>> m_operands;
 	IL_Mnemonic m_mnemonic;
 	IL_Conditions m_conditions;
 
 public:
-	Instruction(const std::string& location, IL_Mnemonic mnemonic, IL_Conditions conditions, const std::vector<std::shared_ptr<Operand>>& operands);
+	Instruction(const std::string& location, bool labeled, size_t line, IL_Mnemonic mnemonic, IL_Conditions conditions, const std::vector<std::shared_ptr<Operand>>& operands);
 
 	const std::string& getLocation() const;
+	bool isLabeled() const;
+	size_t getLine() const;
 	IL_Mnemonic getMnemonic() const;
 	IL_Conditions getConditions() const;
 	const std::vector<std::shared_ptr<Operand>>& getOperands() const;
@@ -82,6 +103,7 @@ private:
 	std::vector<std::shared_ptr<Instruction>> m_instructions;
 
 	static bool isRegister(const std::shared_ptr<Token>& token);
+	static bool isVector(const std::shared_ptr<Token>& token);
 	static bool isLocation(const std::shared_ptr<Token>& token);
 
 	static IL_Mnemonic parseMnemonic(const std::shared_ptr<Token>& token);
@@ -0,0 +1,393 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "vm.h"
+#include "decoder.h"
+#include "verifier.h"
+#include "loader.h"
+#include "memory.h"
+#include "bench.h"
+#include "fusion.h"
+#include "jit.h"
+#include "host.h"
+#include "platform.h"
+
+// Runs every image in each mode for about the same time and reports throughput and peak memory.
+// The iteration count is calibrated on the table engine, every mode then runs the same count.
+
+#define SUITE_MODE_COUNT 5
+
+// Percent a mode may get slower per instruction than in the baseline before it's reported
+#define SUITE_DEFAULT_TOLERANCE 10.0
+
+enum SuiteRunner {
+	SUITE_RUN_ENGINE, // One VM after the other
+	SUITE_RUN_POOL, // Batches of VMs on the worker pool
+	SUITE_RUN_LOCKSTEP, // Groups of VMs on SIMD lanes, on the unfused program like the CLI does
+};
+
+struct SuiteMode {
+	const char* name;
+	enum SuiteRunner runner;
+	enum VM_Engine engine;
+	struct VM_BenchResult result;
+	size_t peak_memory;
+};
+
+struct SuiteEntry {
+	const char* path;
+	const char* name; // File name without directories and extension
+	char buffer[64];
+	bool loaded;
+	struct SuiteMode modes[SUITE_MODE_COUNT];
+};
+
+// One mode of one image in an earlier --json file
+struct SuiteBaseline {
+	char name[64];
+	char mode[16];
+	double ns_per_insn;
+};
+
+static void PrintUsage(const char* program) {
+	printf("Usage: %s [--time <seconds>] [--json <file>] [--baseline <file>] <image>...\n", program);
+	printf("  --time <seconds>     Time spent on each engine per image, 0.5 by default\n");
+	printf("  --json <file>        Write the results as JSON\n");
+	printf("  --baseline <file>    Compare with the JSON of an earlier run, fails if a mode got slower\n");
+	printf("  --tolerance <pct>    Slowdown per instruction allowed against the baseline, %.0f by default\n", SUITE_DEFAULT_TOLERANCE);
+}
+
+static const char* GetEntryName(struct SuiteEntry* entry) {
+	const char* name = entry->path;
+	for (const char* c = entry->path; *c != '\0'; ++c) {
+		if (*c == '/' || *c == '\\') {
+			name = c + 1;
+		}
+	}
+
+	size_t length = strlen(name);
+	const char* dot = strrchr(name, '.');
+	if (dot != NULL && dot != name) {
+		length = (size_t)(dot - name);
+	}
+
+	length = VM_MIN(length, sizeof(entry->buffer) - 1);
+	memcpy(entry->buffer, name, length);
+	entry->buffer[length] = '\0';
+	return entry->buffer;
+}
+
+static void RunMode(const struct VM_Program* program, const struct VM_Program* plain, struct SuiteMode* mode, uint64_t iterations) {
+	const struct VM_HostTable* host = &VM_BUILTIN_HOST_TABLE;
+
+	VM_ResetPeakMemory();
+	switch (mode->runner) {
+	case SUITE_RUN_ENGINE:
+		VM_Benchmark(program, mode->engine, host, iterations, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &mode->result);
+		break;
+	case SUITE_RUN_POOL:
+		VM_BenchmarkPool(program, mode->engine, host, iterations, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &mode->result);
+		break;
+	case SUITE_RUN_LOCKSTEP:
+		VM_BenchmarkLockstep(plain, host, iterations, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &mode->result);
+		break;
+	}
+
+	mode->peak_memory = VM_GetPeakMemory();
+}
+
+static bool RunEntry(struct SuiteEntry* entry, double target) {
+	const char* error = NULL;
+	struct VM_MappedImage mapped;
+	if (!VM_MapImage(entry->path, &mapped, &error)) {
+		printf("Failed to load %s: %s\n", entry->path, error);
+		return false;
+	}
+
+	struct VM_Program program;
+	struct VM_VerifyError verify;
+	if (!VM_DecodeProgram(&program, (uint8_t*)mapped.image.code, mapped.image.code_size, &verify)) {
+		printf("Invalid image %s at code offset 0x%zx: %s\n", entry->path, verify.offset, verify.reason);
+		VM_UnmapImage(&mapped);
+		return false;
+	}
+
+	struct VM_Program plain;
+	if (!VM_DecodeProgram(&plain, (uint8_t*)mapped.image.code, mapped.image.code_size, &verify)) {
+		VM_FreeProgram(&program);
+		VM_UnmapImage(&mapped);
+		return false;
+	}
+
+	VM_FuseProgram(&program, NULL);
+	if (!VM_CreateJit(&program, VM_JIT_DEFAULT_THRESHOLD)) {
+		printf("Failed to create the jit for %s\n", entry->path);
+		VM_FreeProgram(&plain);
+		VM_FreeProgram(&program);
+		VM_UnmapImage(&mapped);
+		return false;
+	}
+
+	// Doubled until a run is long enough to time, the first ones also warm the jit and the caches
+	struct VM_BenchResult calibration;
+	uint64_t iterations = 1;
+	for (;;) {
+		VM_Benchmark(&program, VM_ENGINE_TABLE, &VM_BUILTIN_HOST_TABLE, iterations, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &calibration);
+		if (calibration.seconds * 8 >= target || calibration.iterations == 0) {
+			break;
+		}
+
+		iterations *= 2;
+	}
+
+	if (calibration.seconds > 0 && target > calibration.seconds) {
+		iterations = VM_MAX(1, (uint64_t)((double)iterations * target / calibration.seconds));
+	}
+
+	bool same = true;
+	for (size_t i = 0; i < SUITE_MODE_COUNT; ++i) {
+		RunMode(&program, &plain, &entry->modes[i], iterations);
+		same = same && entry->modes[i].result.result == entry->modes[0].result.result;
+	}
+
+	VM_FreeJit(&program);
+	VM_FreeProgram(&plain);
+	VM_FreeProgram(&program);
+	VM_UnmapImage(&mapped);
+
+	entry->loaded = true;
+	if (!same) {
+		printf("%s: engines disagree on R0\n", entry->name);
+	}
+
+	return same;
+}
+
+static void PrintEntry(const struct SuiteEntry* entry) {
+	const struct SuiteMode* baseline = &entry->modes[0];
+	printf("%s: %llu iterations, R0 = 0x%llx\n", entry->name,
+		(unsigned long long)baseline->result.iterations, (unsigned long long)baseline->result.result);
+
+	for (size_t i = 0; i < SUITE_MODE_COUNT; ++i) {
+		const struct SuiteMode* mode = &entry->modes[i];
+		VM_PrintBenchmark(mode->name, &mode->result, i > 0 ? &baseline->result : NULL);
+		printf("%-10s %12.1f MiB peak\n", "", (double)mode->peak_memory / (1024.0 * 1024.0));
+	}
+}
+
+static void WriteJson(const struct SuiteEntry* entries, size_t count, FILE* out) {
+	fprintf(out, "{\n  \"benchmarks\": [");
+	bool first = true;
+	for (size_t i = 0; i < count; ++i) {
+		const struct SuiteEntry* entry = &entries[i];
+		if (!entry->loaded) {
+			continue;
+		}
+
+		const struct VM_BenchResult* baseline = &entry->modes[0].result;
+		fprintf(out, "%s\n    {\n", first ? "" : ",");
+		fprintf(out, "      \"name\": \"%s\",\n", entry->name);
+		fprintf(out, "      \"iterations\": %llu,\n", (unsigned long long)baseline->iterations);
+		fprintf(out, "      \"instructions\": %llu,\n", (unsigned long long)baseline->steps);
+		fprintf(out, "      \"result\": %llu,\n", (unsigned long long)baseline->result);
+		fprintf(out, "      \"modes\": {");
+
+		for (size_t j = 0; j < SUITE_MODE_COUNT; ++j) {
+			const struct SuiteMode* mode = &entry->modes[j];
+			double seconds = mode->result.seconds;
+			double steps = (double)mode->result.steps;
+
+			fprintf(out, "%s\n        \"%s\": {", j == 0 ? "" : ",", mode->name);
+			fprintf(out, " \"seconds\": %.6f,", seconds);
+			fprintf(out, " \"insns_per_second\": %.0f,", seconds > 0 ? steps / seconds : 0);
+			fprintf(out, " \"ns_per_insn\": %.3f,", steps > 0 ? seconds * 1e9 / steps : 0);
+			fprintf(out, " \"peak_memory\": %zu }", mode->peak_memory);
+		}
+
+		fprintf(out, "\n      }\n    }");
+		first = false;
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+}
+
+// Reads back what WriteJson wrote, one mode per line
+static struct SuiteBaseline* LoadBaseline(const char* path, size_t* count) {
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		return NULL;
+	}
+
+	struct SuiteBaseline* baselines = NULL;
+	size_t capacity = 0;
+	*count = 0;
+
+	char name[64] = "";
+	char line[512];
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char mode[16];
+		double seconds = 0;
+		double ips = 0;
+		double ns = 0;
+
+		if (sscanf(line, " \"name\": \"%63[^\"]\"", name) == 1) {
+			continue;
+		}
+
+		if (sscanf(line, " \"%15[^\"]\": { \"seconds\": %lf, \"insns_per_second\": %lf, \"ns_per_insn\": %lf", mode, &seconds, &ips, &ns) != 4) {
+			continue;
+		}
+
+		if (*count == capacity) {
+			capacity = capacity != 0 ? capacity * 2 : 32;
+			struct SuiteBaseline* grown = realloc(baselines, capacity * sizeof(struct SuiteBaseline));
+			if (grown == NULL) {
+				break;
+			}
+
+			baselines = grown;
+		}
+
+		struct SuiteBaseline* baseline = &baselines[(*count)++];
+		strcpy(baseline->name, name);
+		strcpy(baseline->mode, mode);
+		baseline->ns_per_insn = ns;
+	}
+
+	fclose(in);
+	return baselines;
+}
+
+static const struct SuiteBaseline* FindBaseline(const struct SuiteBaseline* baselines, size_t count, const char* name, const char* mode) {
+	for (size_t i = 0; i < count; ++i) {
+		if (strcmp(baselines[i].name, name) == 0 && strcmp(baselines[i].mode, mode) == 0) {
+			return &baselines[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Time per instruction is compared since iteration counts are calibrated again on every run
+static size_t CompareBaseline(const struct SuiteEntry* entries, size_t count, const struct SuiteBaseline* baselines, size_t baseline_count, double tolerance) {
+	printf("============== BASELINE ==============\n");
+
+	size_t regressions = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const struct SuiteEntry* entry = &entries[i];
+		if (!entry->loaded) {
+			continue;
+		}
+
+		for (size_t j = 0; j < SUITE_MODE_COUNT; ++j) {
+			const struct SuiteMode* mode = &entry->modes[j];
+			const struct SuiteBaseline* baseline = FindBaseline(baselines, baseline_count, entry->name, mode->name);
+			if (baseline == NULL || baseline->ns_per_insn <= 0 || mode->result.steps == 0) {
+				continue;
+			}
+
+			double ns = mode->result.seconds * 1e9 / (double)mode->result.steps;
+			double change = (ns / baseline->ns_per_insn - 1.0) * 100.0;
+			bool regressed = change > tolerance;
+			regressions += regressed;
+
+			printf("%-12s %-10s %8.2f -> %8.2f ns/insn %+7.1f%%%s\n", entry->name, mode->name,
+				baseline->ns_per_insn, ns, change, regressed ? "  REGRESSION" : "");
+		}
+	}
+
+	printf("%zu regressions over %.0f%%\n", regressions, tolerance);
+	printf("=======================================\n");
+	return regressions;
+}
+
+int main(int argc, char** argv) {
+	double target = 0.5;
+	const char* json = NULL;
+	const char* baseline = NULL;
+	double tolerance = SUITE_DEFAULT_TOLERANCE;
+
+	struct SuiteEntry* entries = calloc((size_t)argc, sizeof(struct SuiteEntry));
+	if (entries == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	size_t count = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+			target = strtod(argv[++i], NULL);
+		}
+		else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+			json = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+			baseline = argv[++i];
+		}
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+			tolerance = strtod(argv[++i], NULL);
+		}
+		else if (argv[i][0] == '-') {
+			PrintUsage(argv[0]);
+			free(entries);
+			return EXIT_FAILURE;
+		}
+		else {
+			entries[count++].path = argv[i];
+		}
+	}
+
+	if (count == 0) {
+		PrintUsage(argv[0]);
+		free(entries);
+		return EXIT_FAILURE;
+	}
+
+	bool passed = true;
+	for (size_t i = 0; i < count; ++i) {
+		struct SuiteEntry* entry = &entries[i];
+		entry->name = GetEntryName(entry);
+		entry->modes[0] = (struct SuiteMode){ .name = "table", .runner = SUITE_RUN_ENGINE, .engine = VM_ENGINE_TABLE };
+		entry->modes[1] = (struct SuiteMode){ .name = "threaded", .runner = SUITE_RUN_ENGINE, .engine = VM_ENGINE_THREADED };
+		entry->modes[2] = (struct SuiteMode){ .name = "jit", .runner = SUITE_RUN_ENGINE, .engine = VM_ENGINE_JIT };
+		entry->modes[3] = (struct SuiteMode){ .name = "pool", .runner = SUITE_RUN_POOL, .engine = VM_ENGINE_THREADED };
+		entry->modes[4] = (struct SuiteMode){ .name = "lockstep", .runner = SUITE_RUN_LOCKSTEP };
+
+		if (!RunEntry(entry, target)) {
+			passed = false;
+			continue;
+		}
+
+		PrintEntry(entry);
+	}
+
+	if (json != NULL) {
+		FILE* out = fopen(json, "w");
+		if (out == NULL) {
+			printf("Failed to open %s\n", json);
+			passed = false;
+		}
+		else {
+			WriteJson(entries, count, out);
+			fclose(out);
+		}
+	}
+
+	if (baseline != NULL) {
+		size_t baseline_count = 0;
+		struct SuiteBaseline* baselines = LoadBaseline(baseline, &baseline_count);
+		if (baselines == NULL) {
+			printf("Failed to read the baseline %s\n", baseline);
+			passed = false;
+		}
+		else {
+			passed = CompareBaseline(entries, count, baselines, baseline_count, tolerance) == 0 && passed;
+			free(baselines);
+		}
+	}
+
+	free(entries);
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,179 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "decoder.h"
+#include "bench.h"
+#include "memory.h"
+#include "host.h"
+#include "pool.h"
+#include "lockstep.h"
+
+static double VM_GetTime(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+void VM_Benchmark(const struct VM_Program* program, enum VM_Engine engine, const struct VM_HostTable* host, uint64_t iterations, size_t memory_size, size_t stack_size, struct VM_BenchResult* result) {
+	memset(result, 0, sizeof(*result));
+
+	// Shared by the iterations, like the stack was
+	struct VM_Memory memory;
+	if (!VM_CreateMemory(&memory, memory_size, stack_size)) {
+		return;
+	}
+
+	struct IL_VirtualMachine vm;
+
+	double start = VM_GetTime();
+	for (uint64_t i = 0; i < iterations; ++i) {
+		VM_Init(&vm);
+		VM_RegisterHostTable(&vm, host);
+		vm.memory = &memory;
+		vm.ip = (uint64_t)program->base;
+		vm.sp = memory.stack_top;
+
+		result->suspends += VM_ExecuteWaiting(&vm, program, engine);
+		result->steps += vm.steps;
+		result->result = vm.regs[0];
+	}
+
+	result->seconds = VM_GetTime() - start;
+	result->iterations = iterations;
+
+	VM_FreeMemory(&memory);
+}
+
+static void VM_FreeBenchTasks(struct VM_Task* tasks, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		VM_FreeTask(&tasks[i]);
+	}
+
+	free(tasks);
+}
+
+// Tasks of a batch are reused by the next one, so only a batch worth of guest memory is reserved
+static size_t VM_CreateBenchTasks(struct VM_Task** tasks, const struct VM_Program* program, uint64_t iterations, size_t batch, size_t memory_size, size_t stack_size) {
+	size_t count = (size_t)VM_MIN(iterations, (uint64_t)batch);
+	*tasks = calloc(count, sizeof(struct VM_Task));
+	if (*tasks == NULL) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		if (!VM_InitTask(&(*tasks)[i], program, memory_size, stack_size)) {
+			VM_FreeBenchTasks(*tasks, i);
+			*tasks = NULL;
+			return 0;
+		}
+	}
+
+	return count;
+}
+
+void VM_BenchmarkPool(const struct VM_Program* program, enum VM_Engine engine, const struct VM_HostTable* host, uint64_t iterations, size_t memory_size, size_t stack_size, struct VM_BenchResult* result) {
+	memset(result, 0, sizeof(*result));
+
+	struct VM_Task* tasks = NULL;
+	size_t batch = VM_CreateBenchTasks(&tasks, program, iterations, VM_BENCH_POOL_BATCH, memory_size, stack_size);
+	if (batch == 0) {
+		return;
+	}
+
+	struct VM_PoolConfig config = { 0 };
+	config.engine = engine;
+
+	struct VM_Pool* pool = VM_CreatePool(program, &config);
+	if (pool == NULL) {
+		VM_FreeBenchTasks(tasks, batch);
+		return;
+	}
+
+	double start = VM_GetTime();
+	for (uint64_t done = 0; done < iterations;) {
+		size_t count = (size_t)VM_MIN(iterations - done, (uint64_t)batch);
+		for (size_t i = 0; i < count; ++i) {
+			VM_ResetTask(&tasks[i], program);
+			VM_RegisterHostTable(&tasks[i].vm, host);
+			VM_SubmitTask(pool, &tasks[i]);
+		}
+
+		VM_WaitPool(pool);
+
+		for (size_t i = 0; i < count; ++i) {
+			result->steps += tasks[i].vm.steps;
+			result->result = tasks[i].vm.regs[0];
+		}
+
+		done += count;
+	}
+
+	result->seconds = VM_GetTime() - start;
+	result->iterations = iterations;
+
+	VM_FreePool(pool);
+	VM_FreeBenchTasks(tasks, batch);
+}
+
+void VM_BenchmarkLockstep(const struct VM_Program* program, const struct VM_HostTable* host, uint64_t iterations, size_t memory_size, size_t stack_size, struct VM_BenchResult* result) {
+	memset(result, 0, sizeof(*result));
+
+	struct VM_Task* tasks = NULL;
+	size_t lanes = VM_CreateBenchTasks(&tasks, program, iterations, VM_LOCKSTEP_MAX_LANES, memory_size, stack_size);
+	if (lanes == 0) {
+		return;
+	}
+
+	struct VM_LockstepStats stats = { 0 };
+	struct IL_VirtualMachine* vms[VM_LOCKSTEP_MAX_LANES];
+
+	double start = VM_GetTime();
+	for (uint64_t done = 0; done < iterations;) {
+		uint32_t count = (uint32_t)VM_MIN(iterations - done, (uint64_t)lanes);
+		for (uint32_t i = 0; i < count; ++i) {
+			VM_ResetTask(&tasks[i], program);
+			VM_RegisterHostTable(&tasks[i].vm, host);
+
+			// Lanes aren't metered, nor is the engine finishing a diverged group
+			VM_SetFuel(&tasks[i].vm, VM_FUEL_UNLIMITED);
+			vms[i] = &tasks[i].vm;
+		}
+
+		VM_RunLockstep(vms, count, program, &stats);
+
+		for (uint32_t i = 0; i < count; ++i) {
+			// Lanes stopped on a pending host call finish on their own
+			if (vms[i]->suspend == VM_SUSPEND_HOST_CALL) {
+				result->suspends += VM_ExecuteWaiting(vms[i], program, VM_ENGINE_THREADED);
+			}
+
+			result->steps += vms[i]->steps;
+			result->result = vms[i]->regs[0];
+		}
+
+		done += count;
+	}
+
+	result->seconds = VM_GetTime() - start;
+	result->iterations = iterations;
+
+	VM_FreeBenchTasks(tasks, lanes);
+}
+
+void VM_PrintBenchmark(const char* name, const struct VM_BenchResult* result, const struct VM_BenchResult* baseline) {
+	double ips = result->seconds > 0 ? (double)result->steps / result->seconds : 0;
+	double ns = result->steps > 0 ? result->seconds * 1e9 / (double)result->steps : 0;
+
+	printf("%-10s %12llu insns %10.3f ms %14.0f insns/s %8.2f ns/insn",
+		name, (unsigned long long)result->steps, result->seconds * 1e3, ips, ns);
+
+	if (baseline != NULL && result->seconds > 0) {
+		printf(" %6.2fx", baseline->seconds / result->seconds);
+	}
+
+	printf("\n");
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "vm.h"
+#include "decoder.h"
+
+struct VM_BenchResult {
+	uint64_t iterations;
+	uint64_t steps;
+	uint64_t suspends; // Pending host calls waited for
+	uint64_t result; // R0 of the last iteration
+	double seconds;
+};
+
+struct VM_HostTable;
+
+void VM_Benchmark(const struct VM_Program* program, enum VM_Engine engine, const struct VM_HostTable* host, uint64_t iterations, size_t memory_size, size_t stack_size, struct VM_BenchResult* result);
+
+// Same iterations as VMs on a worker pool, VM_BENCH_POOL_BATCH at a time. Seconds are wall time, steps the sum of every VM.
+#define VM_BENCH_POOL_BATCH 64
+
+void VM_BenchmarkPool(const struct VM_Program* program, enum VM_Engine engine, const struct VM_HostTable* host, uint64_t iterations, size_t memory_size, size_t stack_size, struct VM_BenchResult* result);
+
+// Same iterations as groups of VM_LOCKSTEP_MAX_LANES VMs on the lockstep engine
+void VM_BenchmarkLockstep(const struct VM_Program* program, const struct VM_HostTable* host, uint64_t iterations, size_t memory_size, size_t stack_size, struct VM_BenchResult* result);
+void VM_PrintBenchmark(const char* name, const struct VM_BenchResult* result, const struct VM_BenchResult* baseline);
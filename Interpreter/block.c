@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "block.h"
+
+#if defined(VM_BLOCK_AVX2)
+#include <immintrin.h>
+#elif defined(VM_BLOCK_SSE2)
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// One step of the kernels, Equal returns a bit per byte that matches
+#if defined(VM_BLOCK_AVX2)
+
+typedef __m256i VM_Block_t;
+#define VM_BLOCK_SIZE 32
+#define VM_BLOCK_EQUAL_MASK UINT64_C(0xFFFFFFFF)
+
+static inline VM_Block_t VM_LoadBlock(const uint8_t* data) { return _mm256_loadu_si256((const __m256i*)data); }
+static inline void VM_StoreBlock(uint8_t* data, VM_Block_t value) { _mm256_storeu_si256((__m256i*)data, value); }
+static inline VM_Block_t VM_BroadcastBlock(uint8_t value) { return _mm256_set1_epi8((char)value); }
+static inline uint64_t VM_EqualBlock(VM_Block_t a, VM_Block_t b) { return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)); }
+
+#elif defined(VM_BLOCK_SSE2)
+
+typedef __m128i VM_Block_t;
+#define VM_BLOCK_SIZE 16
+#define VM_BLOCK_EQUAL_MASK UINT64_C(0xFFFF)
+
+static inline VM_Block_t VM_LoadBlock(const uint8_t* data) { return _mm_loadu_si128((const __m128i*)data); }
+static inline void VM_StoreBlock(uint8_t* data, VM_Block_t value) { _mm_storeu_si128((__m128i*)data, value); }
+static inline VM_Block_t VM_BroadcastBlock(uint8_t value) { return _mm_set1_epi8((char)value); }
+static inline uint64_t VM_EqualBlock(VM_Block_t a, VM_Block_t b) { return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)); }
+
+#else
+
+// Little endian words, the lowest differing byte is the first one
+typedef uint64_t VM_Block_t;
+#define VM_BLOCK_SIZE 8
+#define VM_BLOCK_EQUAL_MASK UINT8_MAX
+
+static inline VM_Block_t VM_LoadBlock(const uint8_t* data) { uint64_t value; memcpy(&value, data, sizeof(value)); return value; }
+static inline void VM_StoreBlock(uint8_t* data, VM_Block_t value) { memcpy(data, &value, sizeof(value)); }
+static inline VM_Block_t VM_BroadcastBlock(uint8_t value) { return value * UINT64_C(0x0101010101010101); }
+
+static inline uint64_t VM_EqualBlock(VM_Block_t a, VM_Block_t b) {
+	uint64_t diff = a ^ b;
+	uint64_t mask = 0;
+	for (int i = 0; i < 8; ++i) {
+		mask |= (uint64_t)(((diff >> (i * 8)) & 0xFF) == 0) << i;
+	}
+
+	return mask;
+}
+
+#endif
+
+static inline uint32_t VM_CountTrailingZeros(uint64_t value) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (uint32_t)index;
+#else
+	return (uint32_t)__builtin_ctzll(value);
+#endif
+}
+
+void VM_CopyBlock(uint8_t* dst, const uint8_t* src, size_t size) {
+	// Backwards when dst is inside the source, each step is loaded before the ones after it are stored
+	if (dst > src && dst < src + size) {
+		size_t i = size;
+		for (; i >= VM_BLOCK_SIZE; i -= VM_BLOCK_SIZE) {
+			VM_StoreBlock(dst + i - VM_BLOCK_SIZE, VM_LoadBlock(src + i - VM_BLOCK_SIZE));
+		}
+
+		while (i-- > 0) {
+			dst[i] = src[i];
+		}
+
+		return;
+	}
+
+	size_t i = 0;
+	for (; i + VM_BLOCK_SIZE <= size; i += VM_BLOCK_SIZE) {
+		VM_StoreBlock(dst + i, VM_LoadBlock(src + i));
+	}
+
+	for (; i < size; ++i) {
+		dst[i] = src[i];
+	}
+}
+
+void VM_FillBlock(uint8_t* dst, uint8_t value, size_t size) {
+	VM_Block_t fill = VM_BroadcastBlock(value);
+
+	size_t i = 0;
+	for (; i + VM_BLOCK_SIZE <= size; i += VM_BLOCK_SIZE) {
+		VM_StoreBlock(dst + i, fill);
+	}
+
+	for (; i < size; ++i) {
+		dst[i] = value;
+	}
+}
+
+size_t VM_FindMismatch(const uint8_t* a, const uint8_t* b, size_t size) {
+	size_t i = 0;
+	for (; i + VM_BLOCK_SIZE <= size; i += VM_BLOCK_SIZE) {
+		uint64_t differ = VM_EqualBlock(VM_LoadBlock(a + i), VM_LoadBlock(b + i)) ^ VM_BLOCK_EQUAL_MASK;
+		if (differ != 0) {
+			return i + VM_CountTrailingZeros(differ);
+		}
+	}
+
+	for (; i < size; ++i) {
+		if (a[i] != b[i]) {
+			return i;
+		}
+	}
+
+	return size;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Kernels behind MEMCPY, MEMSET and MEMCMP, the handlers check the guest ranges before calling them.
+// They step 32 bytes at a time with AVX2, 16 with SSE2 and 8 without either. Like the lockstep
+// kernels AVX2 is picked at compile time, build with -mavx2 or /arch:AVX2 to get it.
+#if defined(__AVX2__)
+#define VM_BLOCK_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#define VM_BLOCK_SSE2
+#endif
+
+// Ranges may overlap, like memmove
+void VM_CopyBlock(uint8_t* dst, const uint8_t* src, size_t size);
+void VM_FillBlock(uint8_t* dst, uint8_t value, size_t size);
+
+// Index of the first byte that differs, size if there's none
+size_t VM_FindMismatch(const uint8_t* a, const uint8_t* b, size_t size);
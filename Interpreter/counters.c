@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "il.h"
+#include "decoder.h"
+#include "counters.h"
+
+// Reads used to calibrate the overhead, the lowest one is kept
+#define VM_COUNTER_CALIBRATION 64
+
+static const char* VM_GetCounterName(size_t mnemonic) {
+	return mnemonic == VM_MNEMONIC_BAD ? "BAD" : IL_FormatMnemonic((enum IL_Mnemonic)mnemonic);
+}
+
+// Upper bound of the bucket the percentile falls in
+static uint64_t VM_GetCyclePercentile(const struct VM_OpcodeCounter* counter, uint64_t percent) {
+	uint64_t rank = (counter->executed * percent + 99) / 100;
+	uint64_t seen = 0;
+
+	for (uint32_t i = 0; i < VM_COUNTER_BUCKETS; ++i) {
+		seen += counter->histogram[i];
+		if (seen >= rank) {
+			return i == 0 ? 0 : 1ull << i;
+		}
+	}
+
+	return 1ull << (VM_COUNTER_BUCKETS - 1);
+}
+
+void VM_InitCounters(struct VM_Counters* counters) {
+	memset(counters, 0, sizeof(*counters));
+
+	uint64_t overhead = UINT64_MAX;
+	for (int i = 0; i < VM_COUNTER_CALIBRATION; ++i) {
+		uint64_t start = VM_ReadCycles();
+		uint64_t cycles = VM_ReadCycles() - start;
+		overhead = cycles < overhead ? cycles : overhead;
+	}
+
+	counters->overhead = overhead;
+}
+
+void VM_PrintCounters(const struct VM_Counters* counters) {
+	printf("============ OPCODE COUNTERS ===========\n");
+	printf("%-10s %12s %12s %7s %14s %8s %8s %8s\n", "Mnemonic", "Executed", "Skipped", "Skip%", "Cycles", "Avg", "P50<=", "P99<=");
+
+	uint64_t executed = 0;
+	uint64_t skipped = 0;
+	uint64_t cycles = 0;
+
+	for (size_t i = 0; i < VM_COUNTER_MNEMONICS; ++i) {
+		const struct VM_OpcodeCounter* counter = &counters->opcodes[i];
+		uint64_t total = counter->executed + counter->skipped;
+		if (total == 0) {
+			continue;
+		}
+
+		printf("%-10s %12llu %12llu %6.1f%% %14llu %8.1f %8llu %8llu\n", VM_GetCounterName(i),
+			(unsigned long long)counter->executed, (unsigned long long)counter->skipped, 100.0 * (double)counter->skipped / (double)total,
+			(unsigned long long)counter->cycles, counter->executed > 0 ? (double)counter->cycles / (double)counter->executed : 0.0,
+			(unsigned long long)VM_GetCyclePercentile(counter, 50), (unsigned long long)VM_GetCyclePercentile(counter, 99));
+
+		executed += counter->executed;
+		skipped += counter->skipped;
+		cycles += counter->cycles;
+	}
+
+	printf("%-10s %12llu %12llu %6.1f%% %14llu %8.1f\n", "Total", (unsigned long long)executed, (unsigned long long)skipped,
+		executed + skipped > 0 ? 100.0 * (double)skipped / (double)(executed + skipped) : 0.0,
+		(unsigned long long)cycles, executed > 0 ? (double)cycles / (double)executed : 0.0);
+	printf("Read overhead: %llu cycles, taken off each sample\n", (unsigned long long)counters->overhead);
+	printf("=======================================\n");
+}
+
+void VM_WriteCountersJson(const struct VM_Counters* counters, FILE* out) {
+	fprintf(out, "{\n  \"overhead\": %llu,\n  \"buckets\": %d,\n  \"opcodes\": [", (unsigned long long)counters->overhead, VM_COUNTER_BUCKETS);
+
+	bool first = true;
+	for (size_t i = 0; i < VM_COUNTER_MNEMONICS; ++i) {
+		const struct VM_OpcodeCounter* counter = &counters->opcodes[i];
+		if (counter->executed + counter->skipped == 0) {
+			continue;
+		}
+
+		fprintf(out, "%s\n    { \"mnemonic\": \"%s\", \"executed\": %llu, \"skipped\": %llu, \"cycles\": %llu, \"histogram\": [",
+			first ? "" : ",", VM_GetCounterName(i), (unsigned long long)counter->executed,
+			(unsigned long long)counter->skipped, (unsigned long long)counter->cycles);
+
+		for (uint32_t b = 0; b < VM_COUNTER_BUCKETS; ++b) {
+			fprintf(out, b == 0 ? "%llu" : ", %llu", (unsigned long long)counter->histogram[b]);
+		}
+
+		fprintf(out, "] }");
+		first = false;
+	}
+
+	fprintf(out, "\n  ]\n}\n");
+}
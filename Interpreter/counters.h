@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "il.h"
+#include "decoder.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Cycle histograms have a bucket per power of two, bucket i > 0 counts samples from 2^(i-1) to 2^i cycles,
+// bucket 0 those that took no more than the read overhead and the last one everything above
+#define VM_COUNTER_BUCKETS 24
+
+// Handlers and the BAD sentinel
+#define VM_COUNTER_MNEMONICS (VM_MNEMONIC_BAD + 1)
+
+struct VM_OpcodeCounter {
+	uint64_t executed;
+	uint64_t skipped; // Predicate didn't hold
+	uint64_t cycles; // Spent in the handler, executed codes only
+	uint64_t histogram[VM_COUNTER_BUCKETS];
+};
+
+// Filled by the counting loop of the table engine, which runs instead of the engine asked for while
+// vm->counters is set. Programs are counted unfused so each IL_Mnemonic gets its own row.
+struct VM_Counters {
+	struct VM_OpcodeCounter opcodes[VM_COUNTER_MNEMONICS];
+	uint64_t overhead; // Cycles of two back to back reads, taken off every sample
+};
+
+// Time stamp counter, a monotonic nanosecond clock where there is none
+static inline uint64_t VM_ReadCycles(void) {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static inline void VM_CountCode(struct VM_Counters* counters, const struct VM_DecodedCode* code, bool skipped, uint64_t cycles) {
+	struct VM_OpcodeCounter* counter = &counters->opcodes[code->mnemonic];
+	if (skipped) {
+		counter->skipped += 1;
+		return;
+	}
+
+	cycles = cycles > counters->overhead ? cycles - counters->overhead : 0;
+
+	uint32_t bucket = 0;
+	while (bucket < VM_COUNTER_BUCKETS - 1 && (cycles >> bucket) != 0) {
+		bucket += 1;
+	}
+
+	counter->executed += 1;
+	counter->cycles += cycles;
+	counter->histogram[bucket] += 1;
+}
+
+// Zeroes the counters and calibrates the read overhead
+void VM_InitCounters(struct VM_Counters* counters);
+
+// One row per mnemonic that ran, with the median and 99th percentile taken from the histogram
+void VM_PrintCounters(const struct VM_Counters* counters);
+
+// Same data with the whole histograms
+void VM_WriteCountersJson(const struct VM_Counters* counters, FILE* out);
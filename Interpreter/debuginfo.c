@@ -0,0 +1,110 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "image.h"
+#include "debuginfo.h"
+
+static int VM_CompareDebugSymbols(const void* a, const void* b) {
+	const struct VM_DebugSymbol* left = a;
+	const struct VM_DebugSymbol* right = b;
+	return left->offset < right->offset ? -1 : left->offset > right->offset;
+}
+
+bool VM_LoadDebugInfo(struct VM_DebugInfo* info, const struct IL_Image* image) {
+	memset(info, 0, sizeof(*info));
+
+	size_t symbol_count = IL_GetImageSymbolCount(image);
+	if (symbol_count > 0) {
+		info->symbols = malloc(symbol_count * sizeof(struct VM_DebugSymbol));
+		if (info->symbols == NULL) {
+			return false;
+		}
+
+		for (size_t i = 0; i < symbol_count; ++i) {
+			info->symbols[i].name = IL_GetImageSymbol(image, i, &info->symbols[i].offset);
+		}
+
+		qsort(info->symbols, symbol_count, sizeof(struct VM_DebugSymbol), VM_CompareDebugSymbols);
+		info->symbol_count = symbol_count;
+	}
+
+	size_t line_count = IL_GetImageLineCount(image);
+	if (line_count > 0) {
+		info->lines = malloc(line_count * sizeof(struct VM_DebugLine));
+		if (info->lines == NULL) {
+			VM_FreeDebugInfo(info);
+			return false;
+		}
+
+		// Rows come in code order, a truncated table keeps what was read
+		struct IL_LineReader reader;
+		IL_InitLineReader(image, &reader);
+		while (info->line_count < line_count && IL_ReadLine(&reader, &info->lines[info->line_count].offset, &info->lines[info->line_count].line)) {
+			info->line_count += 1;
+		}
+	}
+
+	return true;
+}
+
+void VM_FreeDebugInfo(struct VM_DebugInfo* info) {
+	free(info->symbols);
+	free(info->lines);
+	memset(info, 0, sizeof(*info));
+}
+
+const struct VM_DebugSymbol* VM_FindDebugSymbol(const struct VM_DebugInfo* info, uint64_t offset) {
+	size_t low = 0;
+	size_t high = info->symbol_count;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (info->symbols[middle].offset <= offset) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	return low > 0 ? &info->symbols[low - 1] : NULL;
+}
+
+uint32_t VM_FindDebugLine(const struct VM_DebugInfo* info, uint64_t offset) {
+	size_t low = 0;
+	size_t high = info->line_count;
+	while (low < high) {
+		size_t middle = low + (high - low) / 2;
+		if (info->lines[middle].offset <= offset) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	return low > 0 ? info->lines[low - 1].line : 0;
+}
+
+size_t VM_FormatLocation(const struct VM_DebugInfo* info, uint64_t offset, char* buffer, size_t size) {
+	const struct VM_DebugSymbol* symbol = VM_FindDebugSymbol(info, offset);
+	uint32_t line = VM_FindDebugLine(info, offset);
+
+	int used = 0;
+	if (symbol == NULL) {
+		used = snprintf(buffer, size, "0x%llx", (unsigned long long)offset);
+	}
+	else if (symbol->offset == offset) {
+		used = snprintf(buffer, size, "@%s", symbol->name);
+	}
+	else {
+		used = snprintf(buffer, size, "@%s+%llu", symbol->name, (unsigned long long)(offset - symbol->offset));
+	}
+
+	if (line != 0 && used >= 0 && (size_t)used < size) {
+		used += snprintf(buffer + used, size - used, " (line %u)", line);
+	}
+
+	return used < 0 ? 0 : (size_t)used < size ? (size_t)used : size - 1;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "image.h"
+
+struct VM_DebugSymbol {
+	uint64_t offset;
+	const char* name;
+};
+
+struct VM_DebugLine {
+	uint64_t offset;
+	uint32_t line;
+};
+
+// Symbols and line table of an image sorted for lookups, only loaded by what prints code locations.
+// Names point into the image, it has to outlive the info.
+struct VM_DebugInfo {
+	struct VM_DebugSymbol* symbols;
+	size_t symbol_count;
+
+	// Empty unless the image was assembled with -g
+	struct VM_DebugLine* lines;
+	size_t line_count;
+};
+
+bool VM_LoadDebugInfo(struct VM_DebugInfo* info, const struct IL_Image* image);
+void VM_FreeDebugInfo(struct VM_DebugInfo* info);
+
+// Last symbol at or before a code offset, NULL if there is none
+const struct VM_DebugSymbol* VM_FindDebugSymbol(const struct VM_DebugInfo* info, uint64_t offset);
+
+// Source line of the instruction at or before a code offset, 0 if unknown
+uint32_t VM_FindDebugLine(const struct VM_DebugInfo* info, uint64_t offset);
+
+// "@pow+3 (line 12)", parts that aren't known are left out and the offset is printed in hex instead
+size_t VM_FormatLocation(const struct VM_DebugInfo* info, uint64_t offset, char* buffer, size_t size);
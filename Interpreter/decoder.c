@@ -0,0 +1,322 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "il.h"
+#include "decoder.h"
+#include "variants.h"
+#include "verifier.h"
+
+static void* VM_AllocateAligned(size_t size, size_t alignment) {
+#ifdef _MSC_VER
+	return _aligned_malloc(size, alignment);
+#else
+	return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+}
+
+static void VM_FreeAligned(void* data) {
+#ifdef _MSC_VER
+	_aligned_free(data);
+#else
+	free(data);
+#endif
+}
+
+// Returns the size of the code at offset, the image has been verified
+static size_t VM_MeasureCode(const uint8_t* data, size_t offset) {
+	struct IL_Code* code = (struct IL_Code*)(data + offset);
+
+	size_t code_size = sizeof(struct IL_Code);
+	uint8_t op_count = IL_GetCodeOperandCount(code);
+	for (uint8_t i = 0; i < op_count; ++i) {
+		code_size += IL_GetOperandSize((struct IL_Operand*)(data + offset + code_size));
+	}
+
+	return code_size;
+}
+
+static void VM_DecodeOperand(struct VM_DecodedOperand* decoded, struct IL_Operand* op) {
+	memset(decoded, 0, sizeof(*decoded));
+	decoded->type = IL_GetOperandType(op);
+
+	switch (IL_GetOperandType(op)) {
+	case IL_OPERAND_TYPE_REGISTER: {
+		struct IL_OperandRegister* reg = IL_GetOperandRegister(op);
+		decoded->reg = reg->id;
+		decoded->size = reg->size;
+		break;
+	}
+	case IL_OPERAND_TYPE_IMMEDIATE: {
+		decoded->size = IL_GetOperandDataSize(op);
+		IL_ReadOperandData(op, &decoded->value, decoded->size);
+		break;
+	}
+	case IL_OPERAND_TYPE_VECTOR: {
+		struct IL_OperandVector* vec = IL_GetOperandVector(op);
+		decoded->reg = vec->id;
+		decoded->size = vec->wide ? IL_VECTOR_SIZE : IL_VECTOR_SIZE / 2;
+		decoded->lane = (uint8_t)(1 << vec->lane);
+		break;
+	}
+	}
+}
+
+#define VM_VARIANT_BASE(Y, name, expr) [IL_MNEMONIC_##name] = VM_HANDLER_##name##_R8_IMM,
+
+// First variant of each specialized mnemonic, 0 if it only has the generic handler
+static const uint16_t VM_ALU_VARIANT_BASES[IL_MNEMONIC_COUNT] = {
+	VM_ALU_OPERATIONS(VM_VARIANT_BASE, _)
+};
+
+#undef VM_VARIANT_BASE
+
+static int VM_GetWidthIndex(uint8_t size) {
+	switch (size) {
+	case 1: return 0;
+	case 2: return 1;
+	case 4: return 2;
+	case 8: return 3;
+	default: return -1;
+	}
+}
+
+static bool VM_IsSizedOperand(const struct VM_DecodedOperand* op) {
+	bool scalar = op->type == IL_OPERAND_TYPE_IMMEDIATE || (op->type == IL_OPERAND_TYPE_REGISTER && op->reg != IL_CD_REG);
+	return scalar && VM_GetWidthIndex(op->size) >= 0;
+}
+
+// LOAD and STORE on the width they move, BRANCH on the width of an immediate offset
+static uint16_t VM_SelectSizedHandler(const struct VM_DecodedCode* decoded) {
+	const struct VM_DecodedOperand* op0 = &decoded->ops[0];
+	const struct VM_DecodedOperand* op1 = &decoded->ops[1];
+
+	switch (decoded->mnemonic) {
+	case IL_MNEMONIC_LOAD:
+		if (decoded->operand_count == 2 && op0->type == IL_OPERAND_TYPE_REGISTER && VM_IsSizedOperand(op0) && VM_IsSizedOperand(op1)) {
+			return (uint16_t)(VM_HANDLER_LOAD_8 + VM_GetWidthIndex(op0->size));
+		}
+		break;
+	case IL_MNEMONIC_STORE:
+		if (decoded->operand_count == 2 && VM_IsSizedOperand(op0) && VM_IsSizedOperand(op1)) {
+			return (uint16_t)(VM_HANDLER_STORE_8 + VM_GetWidthIndex(op1->size));
+		}
+		break;
+	case IL_MNEMONIC_BRANCH:
+		if (decoded->operand_count == 1 && op0->type == IL_OPERAND_TYPE_IMMEDIATE && VM_IsSizedOperand(op0)) {
+			return (uint16_t)(VM_HANDLER_BRANCH_8 + VM_GetWidthIndex(op0->size));
+		}
+		break;
+	}
+
+	return decoded->mnemonic;
+}
+
+static uint16_t VM_SelectHandler(const struct VM_DecodedCode* decoded) {
+	uint16_t base = VM_ALU_VARIANT_BASES[decoded->mnemonic];
+	if (decoded->mnemonic == IL_MNEMONIC_CMP) {
+		base = VM_HANDLER_CMP_R8_IMM;
+	}
+
+	if (base == 0) {
+		return VM_SelectSizedHandler(decoded);
+	}
+
+	if (decoded->operand_count != 2) {
+		return decoded->mnemonic;
+	}
+
+	const struct VM_DecodedOperand* op0 = &decoded->ops[0];
+	const struct VM_DecodedOperand* op1 = &decoded->ops[1];
+	if (op0->type != IL_OPERAND_TYPE_REGISTER) {
+		return decoded->mnemonic;
+	}
+
+	// Variants access registers directly, CD goes through VM_ReadRegisterValue for the lazy conditions
+	if (op0->reg == IL_CD_REG || (op1->type == IL_OPERAND_TYPE_REGISTER && op1->reg == IL_CD_REG)) {
+		return decoded->mnemonic;
+	}
+
+	int dst = VM_GetWidthIndex(op0->size);
+	int src = VM_GetWidthIndex(op1->size);
+	if (dst < 0 || src < 0) {
+		return decoded->mnemonic;
+	}
+
+	int form = op1->type == IL_OPERAND_TYPE_IMMEDIATE ? 0 : 1 + src;
+	return (uint16_t)(base + dst * VM_VARIANT_FORM_COUNT + form);
+}
+
+// ALU handlers only read min(source, destination) bytes of an immediate
+static void VM_TruncateImmediate(struct VM_DecodedCode* decoded) {
+	if (VM_ALU_VARIANT_BASES[decoded->mnemonic] == 0 || decoded->operand_count != 2) {
+		return;
+	}
+
+	const struct VM_DecodedOperand* op0 = &decoded->ops[0];
+	struct VM_DecodedOperand* op1 = &decoded->ops[1];
+	if (op0->type != IL_OPERAND_TYPE_REGISTER || op1->type != IL_OPERAND_TYPE_IMMEDIATE) {
+		return;
+	}
+
+	uint8_t size = op0->size < op1->size ? op0->size : op1->size;
+	if (size < sizeof(uint64_t)) {
+		op1->value &= (UINT64_C(1) << (size * 8)) - 1;
+	}
+}
+
+static void VM_DecodeCode(struct VM_DecodedCode* decoded, struct IL_Code* code, size_t code_size) {
+	memset(decoded, 0, sizeof(*decoded));
+	decoded->mnemonic = IL_GetCodeMnemonic(code);
+	decoded->conditions = IL_GetCodeConditions(code) & VM_PREDICATE_CONDITIONS;
+	decoded->operand_count = IL_GetCodeOperandCount(code);
+	decoded->size = (uint8_t)code_size;
+	decoded->length = 1;
+	decoded->target = VM_CODE_INVALID;
+
+	for (uint8_t i = 0; i < decoded->operand_count; ++i) {
+		VM_DecodeOperand(&decoded->ops[i], IL_GetCodeOperand(code, i));
+	}
+
+	VM_TruncateImmediate(decoded);
+	decoded->handler = VM_SelectHandler(decoded);
+
+	// Any write to IP breaks the sequential flow
+	if (decoded->operand_count > 0) {
+		const struct VM_DecodedOperand* op0 = &decoded->ops[0];
+		if (op0->type == IL_OPERAND_TYPE_REGISTER && op0->reg == IL_IP_REG) {
+			decoded->flags |= VM_CODE_FLAG_REDIRECT;
+		}
+	}
+}
+
+static void VM_ResolveTarget(struct VM_Program* program, struct VM_DecodedCode* decoded, uint64_t offset) {
+	if (decoded->mnemonic != IL_MNEMONIC_BRANCH && decoded->mnemonic != IL_MNEMONIC_CALL) {
+		return;
+	}
+
+	const struct VM_DecodedOperand* op = &decoded->ops[0];
+	if (decoded->operand_count != 1 || op->type != IL_OPERAND_TYPE_IMMEDIATE) {
+		return;
+	}
+
+	// Offsets are relative to the branching instruction
+	uint64_t target = offset + op->value;
+	if (target >= program->size || program->map[target] == VM_CODE_INVALID) {
+		return;
+	}
+
+	decoded->target = program->map[target];
+	decoded->flags |= VM_CODE_FLAG_DIRECT;
+}
+
+// Only codes that can't fall through end a block, a predicated jump that isn't taken keeps going
+static bool VM_AlwaysJumps(const struct VM_DecodedCode* decoded) {
+	if (decoded->conditions != IL_CONDITIONS_NONE) {
+		return false;
+	}
+
+	switch (decoded->mnemonic) {
+	case IL_MNEMONIC_BRANCH:
+	case IL_MNEMONIC_CALL:
+	case IL_MNEMONIC_RETURN:
+		return true;
+	default:
+		return (decoded->flags & VM_CODE_FLAG_REDIRECT) != 0;
+	}
+}
+
+static void VM_MeasureBlocks(struct VM_Program* program) {
+	// The last codes fall through to the sentinel, a halt there gives its cost back like anywhere else
+	uint32_t cost = 1;
+	for (size_t i = program->count; i-- > 0;) {
+		struct VM_DecodedCode* decoded = &program->codes[i];
+		cost = VM_AlwaysJumps(decoded) ? 1 : cost + 1;
+		decoded->cost = cost;
+	}
+}
+
+bool VM_DecodeProgram(struct VM_Program* program, uint8_t* data, size_t size, struct VM_VerifyError* error) {
+	memset(program, 0, sizeof(*program));
+
+	struct VM_VerifyError ignored;
+	if (error == NULL) {
+		error = &ignored;
+	}
+
+	if (!VM_VerifyImage(data, size, error)) {
+		return false;
+	}
+
+	program->base = data;
+	program->size = size;
+
+	error->offset = 0;
+	error->reason = "out of memory";
+
+	program->map = malloc((size + 1) * sizeof(uint32_t));
+	if (program->map == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < size; ++i) {
+		program->map[i] = VM_CODE_INVALID;
+	}
+
+	// Mark boundaries first so targets can be resolved
+	size_t offset = 0;
+	while (offset < size) {
+		size_t code_size = VM_MeasureCode(data, offset);
+		program->map[offset] = (uint32_t)program->count++;
+		offset += code_size;
+	}
+
+	program->codes = VM_AllocateAligned((program->count + 1) * sizeof(struct VM_DecodedCode), sizeof(struct VM_DecodedCode));
+	if (program->codes == NULL) {
+		VM_FreeProgram(program);
+		return false;
+	}
+
+	offset = 0;
+	for (size_t i = 0; i < program->count; ++i) {
+		size_t code_size = VM_MeasureCode(data, offset);
+		VM_DecodeCode(&program->codes[i], (struct IL_Code*)(data + offset), code_size);
+		offset += code_size;
+	}
+
+	offset = 0;
+	for (size_t i = 0; i < program->count; ++i) {
+		struct VM_DecodedCode* decoded = &program->codes[i];
+		VM_ResolveTarget(program, decoded, offset);
+		offset += decoded->size;
+	}
+
+	VM_MeasureBlocks(program);
+
+	struct VM_DecodedCode* sentinel = &program->codes[program->count];
+	memset(sentinel, 0, sizeof(*sentinel));
+	sentinel->mnemonic = VM_MNEMONIC_BAD;
+	sentinel->handler = VM_HANDLER_BAD;
+	sentinel->flags = VM_CODE_FLAG_REDIRECT;
+	sentinel->length = 1;
+	sentinel->cost = 1;
+	sentinel->target = VM_CODE_INVALID;
+
+	return true;
+}
+
+void VM_FreeProgram(struct VM_Program* program) {
+	VM_FreeAligned(program->codes);
+	free(program->map);
+	memset(program, 0, sizeof(*program));
+}
+
+const struct VM_DecodedCode* VM_LookupCode(const struct VM_Program* program, uint64_t ip) {
+	uint64_t offset = ip - (uint64_t)program->base;
+	if (offset >= program->size || program->map[offset] == VM_CODE_INVALID) {
+		return &program->codes[program->count];
+	}
+
+	return &program->codes[program->map[offset]];
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "il.h"
+
+// IL_Code can encode up to 3 operands (2 bits)
+#define VM_CODE_MAX_OPERANDS 3
+
+// Index used for unresolved targets and bytes that are not an instruction boundary
+#define VM_CODE_INVALID UINT32_MAX
+
+// Conditions a predicate can test, NI is never checked
+#define VM_PREDICATE_CONDITIONS ((1 << IL_CONDITIONS_COUNT) - 1)
+
+// Mnemonic of the sentinel code placed after the last decoded instruction
+#define VM_MNEMONIC_BAD IL_MNEMONIC_COUNT
+
+struct VM_Jit;
+struct VM_DebugInfo;
+struct VM_VerifyError;
+
+enum VM_CodeFlags {
+	VM_CODE_FLAG_NONE = 0,
+	VM_CODE_FLAG_DIRECT = 1 << 0, // Branch target is resolved, see VM_DecodedCode::target
+	VM_CODE_FLAG_REDIRECT = 1 << 1, // Writes IP, the next code has to be looked up
+};
+
+struct VM_DecodedOperand {
+	uint8_t type; // enum IL_OperandType
+	uint8_t reg; // Register or vector register id
+	uint8_t size; // Register size, vector view size or immediate data size
+	uint8_t lane; // Vector lane size
+	uint64_t value; // Immediate value, zero extended to 64 bits
+};
+
+// Fixed size form of an IL_Code, one cache line each
+struct VM_DecodedCode {
+	_Alignas(64) uint8_t mnemonic;
+	uint8_t conditions; // Predicate, masked with VM_PREDICATE_CONDITIONS
+	uint8_t operand_count;
+	uint8_t size; // Size of the raw IL_Code(s), next ip is ip + size
+	uint8_t flags; // enum VM_CodeFlags
+	uint8_t length; // Decoded codes covered, more than 1 for fused codes
+	uint16_t handler; // Index in VM_HANDLERS, see variants.h
+	uint32_t target; // Index of the BRANCH/CALL target
+	uint32_t cost; // Codes from this one to the next that always jumps, the fuel a jump here is charged
+	struct VM_DecodedOperand ops[VM_CODE_MAX_OPERANDS];
+};
+
+_Static_assert(sizeof(struct VM_DecodedCode) == 64, "VM_DecodedCode must fit a cache line");
+
+struct VM_Program {
+	uint8_t* base; // Raw IL image
+	size_t size;
+
+	// count + 1 entries, the last one is a VM_MNEMONIC_BAD sentinel
+	struct VM_DecodedCode* codes;
+	size_t count;
+
+	// Raw offset -> index in codes, VM_CODE_INVALID if not an instruction boundary
+	uint32_t* map;
+
+	// Native blocks, NULL unless VM_CreateJit, see jit.h
+	struct VM_Jit* jit;
+
+	// Names code locations in traces, profiles and faults, NULL unless set by the caller, see debuginfo.h
+	const struct VM_DebugInfo* debug;
+};
+
+// Verifies the image first, error is filled when it's rejected and may be NULL.
+// Every code is decoded up front into a private array, load time and memory grow with the image size.
+bool VM_DecodeProgram(struct VM_Program* program, uint8_t* data, size_t size, struct VM_VerifyError* error);
+void VM_FreeProgram(struct VM_Program* program);
+
+const struct VM_DecodedCode* VM_LookupCode(const struct VM_Program* program, uint64_t ip);
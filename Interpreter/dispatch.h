@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "il.h"
+#include "vm.h"
+#include "decoder.h"
+
+#ifdef _MSC_VER
+#define VM_FORCEINLINE __forceinline
+#else
+#define VM_FORCEINLINE inline __attribute__((always_inline))
+#endif
+
+// Charges the codes from code to the end of its block, suspends the VM instead if there isn't enough fuel left
+static inline bool VM_ChargeFuel(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	if (vm->fuel < code->cost) {
+		VM_SuspendExecution(vm, VM_SUSPEND_FUEL);
+		return false;
+	}
+
+	vm->fuel -= code->cost;
+	return true;
+}
+
+// Shared by the execution engines, kept inline so each dispatch site gets its own copy
+static inline const struct VM_DecodedCode* VM_GetNextCode(struct IL_VirtualMachine* vm, const struct VM_Program* program, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedCode* next = NULL;
+
+	if (vm->conditions & IL_CONDITIONS_NI) {
+		vm->ip += code->size;
+
+		// Codes are laid out in the same order as the raw image, and already paid for
+		if (!(code->flags & VM_CODE_FLAG_REDIRECT)) {
+			return code + code->length;
+		}
+
+		next = VM_LookupCode(program, vm->ip);
+	}
+	else {
+		// Don't increment and enable the flag for the next instruction
+		vm->conditions |= IL_CONDITIONS_NI;
+		next = code->flags & VM_CODE_FLAG_DIRECT ? &program->codes[code->target] : VM_LookupCode(program, vm->ip);
+	}
+
+	// The rest of the block that was left is given back, a suspended VM resumes at next
+	vm->fuel += code->cost - code->length;
+	VM_ChargeFuel(vm, next);
+	return next;
+}
+
+// A predicate holds when all of its conditions are set
+static inline bool VM_ShouldSkipCode(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	if (code->conditions == IL_CONDITIONS_NONE) {
+		return false;
+	}
+
+	VM_MaterializeConditions(vm);
+	return (vm->conditions & code->conditions) != code->conditions;
+}
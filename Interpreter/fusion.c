@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "il.h"
+#include "decoder.h"
+#include "variants.h"
+#include "fusion.h"
+
+// Number of unfused pairs listed by VM_PrintFusionStats
+#define VM_FUSION_CANDIDATES 8
+
+struct VM_FusionRule {
+	uint8_t first;
+	uint8_t second;
+	uint16_t handler;
+};
+
+#define VM_FUSION_RULE(first, second) { IL_MNEMONIC_##first, IL_MNEMONIC_##second, VM_HANDLER_##first##_##second },
+
+static const struct VM_FusionRule VM_FUSION_RULES[VM_FUSED_COUNT] = {
+	VM_FUSED_HANDLERS(VM_FUSION_RULE)
+};
+
+#undef VM_FUSION_RULE
+
+// Fused handlers assume IP and the conditions only change where the pair allows it
+static bool VM_UsesControlRegister(const struct VM_DecodedCode* code) {
+	for (uint8_t i = 0; i < code->operand_count; ++i) {
+		const struct VM_DecodedOperand* op = &code->ops[i];
+		if (op->type == IL_OPERAND_TYPE_REGISTER && (op->reg == IL_IP_REG || op->reg == IL_CD_REG)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Fused handlers read ALU and CMP operands with the widths checked by the specialization
+static bool VM_HasFusableOperands(const struct VM_DecodedCode* code) {
+	switch (code->mnemonic) {
+	case IL_MNEMONIC_BRANCH:
+		return code->operand_count == 1;
+	case IL_MNEMONIC_RETURN:
+		return true;
+	default:
+		return code->handler != code->mnemonic;
+	}
+}
+
+static uint16_t VM_SelectFusion(const struct VM_DecodedCode* first, const struct VM_DecodedCode* second) {
+	if (first->conditions != IL_CONDITIONS_NONE || first->length != 1 || (second->flags & VM_CODE_FLAG_REDIRECT)) {
+		return VM_HANDLER_BAD;
+	}
+
+	if (VM_UsesControlRegister(first) || VM_UsesControlRegister(second)) {
+		return VM_HANDLER_BAD;
+	}
+
+	for (size_t i = 0; i < VM_FUSED_COUNT; ++i) {
+		const struct VM_FusionRule* rule = &VM_FUSION_RULES[i];
+		if (rule->first == first->mnemonic && rule->second == second->mnemonic) {
+			return VM_HasFusableOperands(first) && VM_HasFusableOperands(second) ? rule->handler : VM_HANDLER_BAD;
+		}
+	}
+
+	return VM_HANDLER_BAD;
+}
+
+size_t VM_FuseProgram(struct VM_Program* program, struct VM_FusionStats* stats) {
+	if (stats != NULL) {
+		memset(stats, 0, sizeof(*stats));
+
+		for (size_t i = 0; i + 1 < program->count; ++i) {
+			stats->pairs[program->codes[i].mnemonic][program->codes[i + 1].mnemonic] += 1;
+		}
+	}
+
+	size_t fused = 0;
+	for (size_t i = 0; i + 1 < program->count; ++i) {
+		struct VM_DecodedCode* first = &program->codes[i];
+		const struct VM_DecodedCode* second = &program->codes[i + 1];
+
+		uint16_t handler = VM_SelectFusion(first, second);
+		if (handler == VM_HANDLER_BAD) {
+			continue;
+		}
+
+		// Flow leaves the pair like it leaves the second code
+		first->handler = handler;
+		first->size += second->size;
+		first->length = 2;
+		first->flags |= second->flags & VM_CODE_FLAG_DIRECT;
+		first->target = second->target;
+
+		if (stats != NULL) {
+			stats->fused[handler - VM_FUSED_BASE] += 1;
+		}
+
+		// The second code stays a single instruction, it's the target of jumps into the pair
+		++fused;
+		++i;
+	}
+
+	return fused;
+}
+
+void VM_PrintFusionStats(const struct VM_FusionStats* stats) {
+	printf("============= FUSION STATS =============\n");
+	printf("Static pairs in the image, not executions\n");
+
+	// Few rules, a selection sort keeps the most fused first
+	bool printed[VM_FUSED_COUNT] = { 0 };
+	for (size_t n = 0; n < VM_FUSED_COUNT; ++n) {
+		size_t best = VM_FUSED_COUNT;
+		for (size_t i = 0; i < VM_FUSED_COUNT; ++i) {
+			if (!printed[i] && (best == VM_FUSED_COUNT || stats->fused[i] > stats->fused[best])) {
+				best = i;
+			}
+		}
+
+		const struct VM_FusionRule* rule = &VM_FUSION_RULES[best];
+		printf("%s+%s: %u fused\n", IL_FormatMnemonic(rule->first), IL_FormatMnemonic(rule->second), stats->fused[best]);
+		printed[best] = true;
+	}
+
+	// Pairs that are adjacent but have no rule or didn't qualify
+	printf("Unfused candidates:\n");
+
+	uint32_t listed[IL_MNEMONIC_COUNT][IL_MNEMONIC_COUNT] = { 0 };
+	for (size_t n = 0; n < VM_FUSION_CANDIDATES; ++n) {
+		uint32_t best_count = 0;
+		size_t best_first = 0;
+		size_t best_second = 0;
+
+		for (size_t first = 0; first < IL_MNEMONIC_COUNT; ++first) {
+			for (size_t second = 0; second < IL_MNEMONIC_COUNT; ++second) {
+				uint32_t count = stats->pairs[first][second];
+				for (size_t i = 0; i < VM_FUSED_COUNT; ++i) {
+					if (VM_FUSION_RULES[i].first == first && VM_FUSION_RULES[i].second == second) {
+						count -= stats->fused[i];
+					}
+				}
+
+				if (!listed[first][second] && count > best_count) {
+					best_count = count;
+					best_first = first;
+					best_second = second;
+				}
+			}
+		}
+
+		if (best_count == 0) {
+			break;
+		}
+
+		printf("%s+%s: %u\n", IL_FormatMnemonic(best_first), IL_FormatMnemonic(best_second), best_count);
+		listed[best_first][best_second] = 1;
+	}
+
+	printf("=======================================\n");
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "il.h"
+#include "decoder.h"
+#include "variants.h"
+
+#define VM_FUSED_ONE(first, second) + 1
+
+enum {
+	VM_FUSED_COUNT = 0 VM_FUSED_HANDLERS(VM_FUSED_ONE),
+	VM_FUSED_BASE = VM_HANDLER_COUNT - VM_FUSED_COUNT, // Handler index of the first superinstruction
+};
+
+#undef VM_FUSED_ONE
+
+// Static counts over the image, each pair of adjacent codes counts once however often it runs
+struct VM_FusionStats {
+	uint32_t pairs[IL_MNEMONIC_COUNT][IL_MNEMONIC_COUNT]; // Adjacent mnemonics, fused or not
+	uint32_t fused[VM_FUSED_COUNT]; // Indexed by handler - VM_FUSED_BASE
+};
+
+// Rewrites adjacent codes of the decoded stream into superinstructions, returns the number of fused pairs.
+// The second code of a pair is left as is so it can still be jumped to. stats can be NULL.
+// Traces print one line per dispatch, run traced programs unfused.
+size_t VM_FuseProgram(struct VM_Program* program, struct VM_FusionStats* stats);
+void VM_PrintFusionStats(const struct VM_FusionStats* stats);
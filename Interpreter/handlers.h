@@ -2,30 +2,61 @@
 
 #include "il.h"
 #include "vm.h"
+#include "decoder.h"
+#include "variants.h"
 
-typedef void (*VM_HandlerFn_t)(struct IL_VirtualMachine* vm, struct IL_Code* code);
-
-void VM_Handler_SET(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_ADD(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_SUB(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_CMP(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_LOAD(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_STORE(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_BRANCH(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_MUL(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_AND(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_OR(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_XOR(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_NOT(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_SHIFTR(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_SHIFTL(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_PUSH(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_POP(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_CALL(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_RETURN(struct IL_VirtualMachine* vm, struct IL_Code* code);
-void VM_Handler_HALT(struct IL_VirtualMachine* vm, struct IL_Code* code);
-
-const VM_HandlerFn_t VM_HANDLERS[] = {
+typedef void (*VM_HandlerFn_t)(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+
+void VM_Handler_SET(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_ADD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_SUB(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_CMP(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_LOAD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_STORE(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_BRANCH(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_MUL(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_AND(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_OR(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_XOR(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_NOT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_SHIFTR(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_SHIFTL(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_PUSH(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_POP(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_CALL(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_RETURN(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_HALT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_HOSTCALL(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_MEMCPY(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_MEMSET(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_MEMCMP(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VLOAD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VSTORE(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VSPLAT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VMASK(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VADD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VSUB(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VMUL(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VAND(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VOR(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VXOR(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VCMPEQ(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VCMPGT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_VSHUF(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+void VM_Handler_BAD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+
+#define VM_FUSED_DECLARATION(first, second) void VM_Handler_##first##_##second(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
+
+VM_FUSED_HANDLERS(VM_FUSED_DECLARATION)
+
+#undef VM_FUSED_DECLARATION
+
+#define VM_VARIANT_HANDLER(name, dst, dst_bits, src, src_bits, src_imm) [VM_HANDLER_##name##_##dst##_##src] = VM_Handler_##name##_##dst##_##src,
+#define VM_SIZED_HANDLER(name, bits) [VM_HANDLER_##name##_##bits] = VM_Handler_##name##_##bits,
+#define VM_FUSED_HANDLER(first, second) [VM_HANDLER_##first##_##second] = VM_Handler_##first##_##second,
+
+// Indexed by VM_DecodedCode::handler
+static const VM_HandlerFn_t VM_HANDLERS[VM_HANDLER_COUNT] = {
 	[IL_MNEMONIC_SET] = VM_Handler_SET,
 	[IL_MNEMONIC_ADD] = VM_Handler_ADD,
 	[IL_MNEMONIC_SUB] = VM_Handler_SUB,
@@ -45,4 +76,29 @@ const VM_HandlerFn_t VM_HANDLERS[] = {
 	[IL_MNEMONIC_CALL] = VM_Handler_CALL,
 	[IL_MNEMONIC_RETURN] = VM_Handler_RETURN,
 	[IL_MNEMONIC_HALT] = VM_Handler_HALT,
-};
\ No newline at end of file
+	[IL_MNEMONIC_HOSTCALL] = VM_Handler_HOSTCALL,
+	[IL_MNEMONIC_MEMCPY] = VM_Handler_MEMCPY,
+	[IL_MNEMONIC_MEMSET] = VM_Handler_MEMSET,
+	[IL_MNEMONIC_MEMCMP] = VM_Handler_MEMCMP,
+	[IL_MNEMONIC_VLOAD] = VM_Handler_VLOAD,
+	[IL_MNEMONIC_VSTORE] = VM_Handler_VSTORE,
+	[IL_MNEMONIC_VSPLAT] = VM_Handler_VSPLAT,
+	[IL_MNEMONIC_VMASK] = VM_Handler_VMASK,
+	[IL_MNEMONIC_VADD] = VM_Handler_VADD,
+	[IL_MNEMONIC_VSUB] = VM_Handler_VSUB,
+	[IL_MNEMONIC_VMUL] = VM_Handler_VMUL,
+	[IL_MNEMONIC_VAND] = VM_Handler_VAND,
+	[IL_MNEMONIC_VOR] = VM_Handler_VOR,
+	[IL_MNEMONIC_VXOR] = VM_Handler_VXOR,
+	[IL_MNEMONIC_VCMPEQ] = VM_Handler_VCMPEQ,
+	[IL_MNEMONIC_VCMPGT] = VM_Handler_VCMPGT,
+	[IL_MNEMONIC_VSHUF] = VM_Handler_VSHUF,
+	[VM_HANDLER_BAD] = VM_Handler_BAD,
+	VM_SPECIALIZED_HANDLERS(VM_VARIANT_HANDLER)
+	VM_SIZED_HANDLERS(VM_SIZED_HANDLER)
+	VM_FUSED_HANDLERS(VM_FUSED_HANDLER)
+};
+
+#undef VM_VARIANT_HANDLER
+#undef VM_SIZED_HANDLER
+#undef VM_FUSED_HANDLER
\ No newline at end of file
@@ -0,0 +1,10 @@
+#include <stdint.h>
+
+#include "../vm.h"
+#include "il.h"
+
+// Runs when IP leaves the decoded code, e.g. a register BRANCH off an instruction boundary
+void VM_Handler_BAD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	(void)code;
+	VM_RaiseFault(vm, VM_FAULT_BAD_CODE, 0);
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <stdint.h>
+
+#include "../vm.h"
+#include "../dispatch.h"
+#include "../variants.h"
+#include "../handlers.h"
+#include "il.h"
+
+// Fused handlers run the code they replace and the untouched one that follows it (code + 1).
+// The fusion pass only pairs unpredicated first codes that got a specialized handler,
+// the second keeps its predicate and sees the conditions written by the first.
+
+static inline uint64_t VM_LoadAluSource(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+	return VM_LoadSource(vm, op1, op0->size < op1->size ? op0->size : op1->size);
+}
+
+static inline void VM_Compare(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	VM_SetCompare(vm, VM_LoadDestination(vm, &code->ops[0]), VM_LoadSource(vm, &code->ops[1], code->ops[1].size));
+}
+
+void VM_Handler_CMP_BRANCH(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedCode* branch = code + 1;
+
+	VM_Compare(vm, code);
+	vm->steps += 1;
+
+	if (VM_ShouldSkipCode(vm, branch)) {
+		return;
+	}
+
+	uint64_t offset = 0;
+	VM_ReadOperandValue(vm, &branch->ops[0], &offset, branch->ops[0].size);
+
+	// Offset is relative to the BRANCH, which starts where the CMP ends
+	vm->ip += code->size - branch->size + offset;
+	VM_ToggleCondition(vm, IL_CONDITIONS_NI, false);
+}
+
+void VM_Handler_CMP_RETURN(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedCode* ret = code + 1;
+
+	VM_Compare(vm, code);
+	vm->steps += 1;
+
+	if (VM_ShouldSkipCode(vm, ret)) {
+		return;
+	}
+
+	// The RETURN can fault on its stack read, IP has to be on it then like without fusion
+	vm->ip += code->size - ret->size;
+	VM_Handler_RETURN(vm, ret);
+}
+
+void VM_Handler_SUB_CMP(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedCode* cmp = code + 1;
+
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	VM_StoreDestination(vm, op0, VM_LoadDestination(vm, op0) - VM_LoadAluSource(vm, code));
+	vm->steps += 1;
+
+	if (VM_ShouldSkipCode(vm, cmp)) {
+		return;
+	}
+
+	VM_Compare(vm, cmp);
+}
+
+void VM_Handler_SET_SET(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedCode* set = code + 1;
+
+	VM_StoreDestination(vm, &code->ops[0], VM_LoadAluSource(vm, code));
+	vm->steps += 1;
+
+	if (VM_ShouldSkipCode(vm, set)) {
+		return;
+	}
+
+	VM_StoreDestination(vm, &set->ops[0], VM_LoadAluSource(vm, set));
+}
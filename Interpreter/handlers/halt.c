@@ -3,6 +3,7 @@
 #include "../vm.h"
 #include "il.h"
 
-void VM_Handler_HALT(struct IL_VirtualMachine* vm, struct IL_Code* code) {
+void VM_Handler_HALT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	(void)code;
 	VM_ToggleCondition(vm, IL_CONDITIONS_HLT, true);
 }
\ No newline at end of file
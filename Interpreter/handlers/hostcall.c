@@ -0,0 +1,18 @@
+#include <stdint.h>
+
+#include "../vm.h"
+#include "../host.h"
+#include "il.h"
+
+void VM_Handler_HOSTCALL(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op = &code->ops[0];
+
+	uint64_t index = 0;
+	VM_ReadOperandValue(vm, op, &index, op->size);
+	VM_CallHost(vm, index);
+
+	// Faults leave IP on the call, like they do when raised halfway through any other handler
+	if (vm->fault != VM_FAULT_NONE) {
+		VM_ToggleCondition(vm, IL_CONDITIONS_NI, false);
+	}
+}
@@ -0,0 +1,32 @@
+#include <stdint.h>
+
+#include "../vm.h"
+#include "../block.h"
+#include "il.h"
+
+void VM_Handler_MEMCMP(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	uint64_t a_address = 0;
+	VM_ReadOperandValue(vm, &code->ops[0], &a_address, code->ops[0].size);
+
+	uint64_t b_address = 0;
+	VM_ReadOperandValue(vm, &code->ops[1], &b_address, code->ops[1].size);
+
+	uint64_t size = 0;
+	VM_ReadOperandValue(vm, &code->ops[2], &size, code->ops[2].size);
+
+	const uint8_t* a = VM_GetMemoryRange(vm, a_address, size);
+	const uint8_t* b = a != NULL ? VM_GetMemoryRange(vm, b_address, size) : NULL;
+	if (b == NULL) {
+		VM_ToggleCondition(vm, IL_CONDITIONS_NI, false);
+		return;
+	}
+
+	// Unsigned like CMP, equal blocks compare as equal bytes
+	size_t index = VM_FindMismatch(a, b, (size_t)size);
+	if (index == size) {
+		VM_SetCompare(vm, 0, 0);
+	}
+	else {
+		VM_SetCompare(vm, a[index], b[index]);
+	}
+}
@@ -0,0 +1,26 @@
+#include <stdint.h>
+
+#include "../vm.h"
+#include "../block.h"
+#include "il.h"
+
+void VM_Handler_MEMCPY(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	uint64_t dst_address = 0;
+	VM_ReadOperandValue(vm, &code->ops[0], &dst_address, code->ops[0].size);
+
+	uint64_t src_address = 0;
+	VM_ReadOperandValue(vm, &code->ops[1], &src_address, code->ops[1].size);
+
+	uint64_t size = 0;
+	VM_ReadOperandValue(vm, &code->ops[2], &size, code->ops[2].size);
+
+	// Nothing is written unless both ranges are valid, IP is then left on the code
+	uint8_t* src = VM_GetMemoryRange(vm, src_address, size);
+	uint8_t* dst = src != NULL ? VM_GetMemoryRange(vm, dst_address, size) : NULL;
+	if (dst == NULL) {
+		VM_ToggleCondition(vm, IL_CONDITIONS_NI, false);
+		return;
+	}
+
+	VM_CopyBlock(dst, src, (size_t)size);
+}
@@ -0,0 +1,24 @@
+#include <stdint.h>
+
+#include "../vm.h"
+#include "../block.h"
+#include "il.h"
+
+void VM_Handler_MEMSET(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	uint64_t dst_address = 0;
+	VM_ReadOperandValue(vm, &code->ops[0], &dst_address, code->ops[0].size);
+
+	uint64_t value = 0;
+	VM_ReadOperandValue(vm, &code->ops[1], &value, code->ops[1].size);
+
+	uint64_t size = 0;
+	VM_ReadOperandValue(vm, &code->ops[2], &size, code->ops[2].size);
+
+	uint8_t* dst = VM_GetMemoryRange(vm, dst_address, size);
+	if (dst == NULL) {
+		VM_ToggleCondition(vm, IL_CONDITIONS_NI, false);
+		return;
+	}
+
+	VM_FillBlock(dst, (uint8_t)value, (size_t)size);
+}
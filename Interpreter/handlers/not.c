@@ -1,21 +1,14 @@
 #include <stdint.h>
-#include <assert.h>
 #include <stdlib.h>
 
 #include "../vm.h"
 #include "il.h"
 
-void VM_Handler_NOT(struct IL_VirtualMachine* vm, struct IL_Code* code) {
-	assert(IL_GetCodeOperandCount(code) == 1);
-
-	struct IL_Operand* op0 = IL_GetCodeOperand(code, 0);
-	assert(IL_GetOperandType(op0) == IL_OPERAND_TYPE_REGISTER);
-
-	struct IL_OperandRegister* reg0 = IL_GetOperandRegister(op0);
-	uint8_t reg0_size = reg0->size;
+void VM_Handler_NOT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
 
 	uint64_t value = 0;
-	VM_ReadOperandValue(vm, op0, &value, reg0_size);
+	VM_ReadOperandValue(vm, op0, &value, op0->size);
 	value = ~value;
-	VM_WriteOperandValue(vm, op0, &value, reg0_size);
+	VM_WriteOperandValue(vm, op0, &value, op0->size);
 }
\ No newline at end of file
@@ -1,12 +1,13 @@
 #include <stdint.h>
-#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "../vm.h"
 #include "il.h"
 
-void VM_Handler_RETURN(struct IL_VirtualMachine* vm, struct IL_Code* code) {
+void VM_Handler_RETURN(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	(void)code;
+
 	// Read the return address that was pushed on the stack by the expected CALL instruction
 	uint64_t ip = 0;
 	VM_ReadMemoryValue(vm, vm->sp, &ip, sizeof(ip));
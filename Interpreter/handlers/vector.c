@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "../vm.h"
+#include "../vector.h"
+#include "il.h"
+
+// Sources are read at the width of the destination view
+static inline uint8_t* VM_GetVectorRegister(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op) {
+	return vm->vregs[op->reg];
+}
+
+static inline void VM_ClearUpperHalf(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op) {
+	if (op->size < IL_VECTOR_SIZE) {
+		memset(vm->vregs[op->reg] + op->size, 0, IL_VECTOR_SIZE - op->size);
+	}
+}
+
+void VM_Handler_VLOAD(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	uint64_t address = 0;
+	VM_ReadOperandValue(vm, op1, &address, op1->size);
+
+	// One access like LOAD, the guard regions are larger than a view
+	VM_ReadMemoryValue(vm, address, VM_GetVectorRegister(vm, op0), op0->size);
+	VM_ClearUpperHalf(vm, op0);
+}
+
+void VM_Handler_VSTORE(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	uint64_t address = 0;
+	VM_ReadOperandValue(vm, op0, &address, op0->size);
+	VM_WriteMemoryValue(vm, address, VM_GetVectorRegister(vm, op1), op1->size);
+}
+
+void VM_Handler_VSPLAT(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	uint64_t value = 0;
+	VM_ReadOperandValue(vm, op1, &value, op1->size);
+
+	VM_VectorSplat(VM_GetVectorRegister(vm, op0), value, op0->size, op0->lane);
+	VM_ClearUpperHalf(vm, op0);
+}
+
+void VM_Handler_VMASK(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	uint64_t mask = VM_VectorMask(VM_GetVectorRegister(vm, op1), op1->size, op1->lane);
+	VM_WriteOperandValue(vm, op0, &mask, op0->size);
+}
+
+#define VM_VECTOR_HANDLER(name, kernel) \
+	void VM_Handler_##name(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) { \
+		const struct VM_DecodedOperand* op0 = &code->ops[0]; \
+		const struct VM_DecodedOperand* op1 = &code->ops[1]; \
+		kernel(VM_GetVectorRegister(vm, op0), VM_GetVectorRegister(vm, op1), op0->size, op0->lane); \
+		VM_ClearUpperHalf(vm, op0); \
+	}
+
+VM_VECTOR_HANDLER(VADD, VM_VectorAdd)
+VM_VECTOR_HANDLER(VSUB, VM_VectorSub)
+VM_VECTOR_HANDLER(VMUL, VM_VectorMul)
+VM_VECTOR_HANDLER(VAND, VM_VectorAnd)
+VM_VECTOR_HANDLER(VOR, VM_VectorOr)
+VM_VECTOR_HANDLER(VXOR, VM_VectorXor)
+VM_VECTOR_HANDLER(VCMPEQ, VM_VectorCompareEqual)
+VM_VECTOR_HANDLER(VCMPGT, VM_VectorCompareGreater)
+
+#undef VM_VECTOR_HANDLER
+
+void VM_Handler_VSHUF(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	VM_VectorShuffle(VM_GetVectorRegister(vm, op0), VM_GetVectorRegister(vm, op1), op0->size);
+	VM_ClearUpperHalf(vm, op0);
+}
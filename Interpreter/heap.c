@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#include <crtdbg.h>
+#endif
+
+#include "heap.h"
+#include "platform.h"
+
+static VM_THREAD_LOCAL bool vm_heap_counting = false;
+static VM_THREAD_LOCAL uint64_t vm_heap_count = 0;
+static VM_Atomic_t vm_heap_total = 0;
+
+#ifdef VM_HEAP_COUNTING
+static void VM_CountAllocation(void) {
+	if (vm_heap_counting) {
+		vm_heap_count += 1;
+	}
+}
+#endif
+
+#if defined(VM_HEAP_COUNTING) && defined(_MSC_VER)
+
+// The hook is process wide, it's installed once and only counts on threads that asked for it
+static _CRT_ALLOC_HOOK vm_previous_hook = NULL;
+static bool vm_hook_installed = false;
+
+static int VM_AllocationHook(int type, void* data, size_t size, int block_type, long request, const unsigned char* file, int line) {
+	if (type == _HOOK_ALLOC || type == _HOOK_REALLOC) {
+		VM_CountAllocation();
+	}
+
+	return vm_previous_hook != NULL ? vm_previous_hook(type, data, size, block_type, request, file, line) : TRUE;
+}
+
+#elif defined(VM_HEAP_COUNTING)
+
+// glibc keeps its allocator reachable under these names, the definitions below take precedence over libc's
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* data, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) {
+	VM_CountAllocation();
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	VM_CountAllocation();
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* data, size_t size) {
+	VM_CountAllocation();
+	return __libc_realloc(data, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	VM_CountAllocation();
+	return __libc_memalign(alignment, size);
+}
+
+#endif
+
+void VM_BeginHeapCount(void) {
+#if defined(VM_HEAP_COUNTING) && defined(_MSC_VER)
+	if (!vm_hook_installed) {
+		vm_previous_hook = _CrtSetAllocHook(VM_AllocationHook);
+		vm_hook_installed = true;
+	}
+#endif
+
+	vm_heap_count = 0;
+	vm_heap_counting = true;
+}
+
+uint64_t VM_EndHeapCount(void) {
+	vm_heap_counting = false;
+	VM_AtomicAdd(&vm_heap_total, (int64_t)vm_heap_count);
+	return vm_heap_count;
+}
+
+uint64_t VM_GetHeapCountTotal(void) {
+	return (uint64_t)VM_AtomicLoad(&vm_heap_total);
+}
+
+bool VM_PauseHeapCount(void) {
+	bool counting = vm_heap_counting;
+	vm_heap_counting = false;
+	return counting;
+}
+
+void VM_ResumeHeapCount(bool counting) {
+	vm_heap_counting = counting;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+// Heap allocations can only be observed in debug builds, through the CRT allocation hook with MSVC
+// and by wrapping the allocator with glibc. Define VM_NO_HEAP_COUNTING to opt out, or VM_HEAP_COUNTING
+// to count in a glibc release build.
+#if !defined(VM_NO_HEAP_COUNTING) && !defined(VM_HEAP_COUNTING)
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define VM_HEAP_COUNTING
+#elif defined(__GLIBC__) && !defined(NDEBUG)
+#define VM_HEAP_COUNTING
+#endif
+#endif
+
+// Counts the allocations made by the calling thread until VM_EndHeapCount, calls can't be nested
+void VM_BeginHeapCount(void);
+uint64_t VM_EndHeapCount(void);
+
+// What every VM_EndHeapCount returned so far, on any thread
+uint64_t VM_GetHeapCountTotal(void);
+
+// Leaves out the allocations of a call the VM doesn't control, returns whether the thread was counting
+bool VM_PauseHeapCount(void);
+void VM_ResumeHeapCount(bool counting);
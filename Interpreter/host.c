@@ -0,0 +1,345 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "vm.h"
+#include "host.h"
+#include "platform.h"
+#include "heap.h"
+
+// Longest the timer thread sleeps without a deadline, in milliseconds
+#define VM_HOST_TIMER_IDLE_WAIT_MS 100
+
+void VM_CallHost(struct IL_VirtualMachine* vm, uint64_t index) {
+	const struct VM_HostTable* table = vm->host;
+	if (table == NULL || index >= table->count) {
+		VM_RaiseFault(vm, VM_FAULT_HOST_CALL, index);
+		return;
+	}
+
+	const struct VM_HostFunction* function = &table->functions[index];
+
+	enum VM_HostStatus status;
+	if (function->flags & VM_HOST_FLAG_NONBLOCKING) {
+		status = function->fn(vm, function->user);
+	}
+	else {
+		// Blocking functions may allocate, e.g. stdio buffers on their first write
+		bool counting = VM_PauseHeapCount();
+		status = function->fn(vm, function->user);
+		VM_ResumeHeapCount(counting);
+	}
+
+	if (status == VM_HOST_PENDING) {
+		VM_SuspendExecution(vm, VM_SUSPEND_HOST_CALL);
+	}
+}
+
+// The owner parking the VM and the host completing the call can come in either order, on any thread
+static bool VM_ArriveHostCall(struct IL_VirtualMachine* vm) {
+	VM_Atomic_t* arrivals = (VM_Atomic_t*)&vm->wake_arrivals;
+	if (VM_AtomicAdd(arrivals, 1) < 2) {
+		return false;
+	}
+
+	VM_AtomicStore(arrivals, 0);
+	return true;
+}
+
+void VM_CompleteHostCall(struct IL_VirtualMachine* vm) {
+	if (VM_ArriveHostCall(vm)) {
+		vm->wake(vm, vm->wake_user);
+	}
+}
+
+bool VM_ParkHostCall(struct IL_VirtualMachine* vm) {
+	return VM_ArriveHostCall(vm);
+}
+
+struct VM_HostWaiter {
+	VM_Mutex_t mutex;
+	VM_Cond_t cond;
+	bool woken;
+};
+
+static void VM_WakeWaiter(struct IL_VirtualMachine* vm, void* user) {
+	(void)vm;
+	struct VM_HostWaiter* waiter = user;
+
+	VM_LockMutex(&waiter->mutex);
+	waiter->woken = true;
+	VM_SignalCond(&waiter->cond);
+	VM_UnlockMutex(&waiter->mutex);
+}
+
+uint64_t VM_ExecuteWaiting(struct IL_VirtualMachine* vm, const struct VM_Program* program, enum VM_Engine engine) {
+	struct VM_HostWaiter waiter;
+	VM_InitMutex(&waiter.mutex);
+	VM_InitCond(&waiter.cond);
+	waiter.woken = false;
+
+	vm->wake = VM_WakeWaiter;
+	vm->wake_user = &waiter;
+
+	// The VM may come in suspended already, e.g. from a lockstep lane
+	uint64_t pending = 0;
+	for (;;) {
+		if (vm->suspend == VM_SUSPEND_HOST_CALL) {
+			pending += 1;
+			if (!VM_ParkHostCall(vm)) {
+				VM_LockMutex(&waiter.mutex);
+				while (!waiter.woken) {
+					VM_WaitCond(&waiter.cond, &waiter.mutex, VM_HOST_TIMER_IDLE_WAIT_MS);
+				}
+
+				waiter.woken = false;
+				VM_UnlockMutex(&waiter.mutex);
+			}
+
+			VM_Resume(vm);
+		}
+		else if (vm->conditions & IL_CONDITIONS_HLT) {
+			break;
+		}
+
+		VM_Execute(vm, program, engine);
+	}
+
+	vm->wake = NULL;
+	vm->wake_user = NULL;
+	VM_FreeCond(&waiter.cond);
+	VM_FreeMutex(&waiter.mutex);
+	return pending;
+}
+
+void* VM_GetGuestBuffer(struct IL_VirtualMachine* vm, uint64_t address, uint64_t size) {
+	// Host code reads the buffer directly, it has to lie in pages already committed
+	uint8_t* buffer = VM_GetGuestRange(vm->memory, address, size, true);
+	if (buffer == NULL) {
+		VM_RaiseFault(vm, VM_FAULT_MEMORY, address);
+	}
+
+	return buffer;
+}
+
+struct VM_TimerEntry {
+	double deadline;
+	struct IL_VirtualMachine* vm;
+};
+
+// Completes sleeps on a thread of its own, started by the first one. Entries are a min-heap on the deadline.
+struct VM_HostTimer {
+	VM_Mutex_t mutex;
+	VM_Cond_t cond;
+	struct VM_Thread thread;
+
+	struct VM_TimerEntry* entries;
+	size_t count;
+	size_t capacity;
+};
+
+static struct VM_HostTimer vm_host_timer;
+static VM_Once_t vm_host_timer_once = VM_ONCE_INIT;
+static bool vm_host_timer_started = false;
+
+static void VM_SwapTimerEntries(struct VM_TimerEntry* a, struct VM_TimerEntry* b) {
+	struct VM_TimerEntry entry = *a;
+	*a = *b;
+	*b = entry;
+}
+
+static void VM_PopTimerEntry(struct VM_HostTimer* timer) {
+	timer->entries[0] = timer->entries[--timer->count];
+
+	size_t i = 0;
+	for (;;) {
+		size_t smallest = i;
+		size_t left = i * 2 + 1;
+		size_t right = left + 1;
+
+		if (left < timer->count && timer->entries[left].deadline < timer->entries[smallest].deadline) {
+			smallest = left;
+		}
+
+		if (right < timer->count && timer->entries[right].deadline < timer->entries[smallest].deadline) {
+			smallest = right;
+		}
+
+		if (smallest == i) {
+			break;
+		}
+
+		VM_SwapTimerEntries(&timer->entries[i], &timer->entries[smallest]);
+		i = smallest;
+	}
+}
+
+static bool VM_PushTimerEntry(struct VM_HostTimer* timer, struct VM_TimerEntry entry) {
+	if (timer->count == timer->capacity) {
+		size_t capacity = timer->capacity != 0 ? timer->capacity * 2 : 64;
+		struct VM_TimerEntry* entries = realloc(timer->entries, capacity * sizeof(struct VM_TimerEntry));
+		if (entries == NULL) {
+			return false;
+		}
+
+		timer->entries = entries;
+		timer->capacity = capacity;
+	}
+
+	size_t i = timer->count++;
+	timer->entries[i] = entry;
+	while (i > 0 && timer->entries[(i - 1) / 2].deadline > timer->entries[i].deadline) {
+		VM_SwapTimerEntries(&timer->entries[i], &timer->entries[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+
+	return true;
+}
+
+static void VM_RunHostTimer(void* context) {
+	struct VM_HostTimer* timer = context;
+
+	VM_LockMutex(&timer->mutex);
+	for (;;) {
+		double now = VM_GetTime();
+		if (timer->count > 0 && timer->entries[0].deadline <= now) {
+			struct IL_VirtualMachine* vm = timer->entries[0].vm;
+			VM_PopTimerEntry(timer);
+
+			VM_UnlockMutex(&timer->mutex);
+			VM_CompleteHostCall(vm);
+			VM_LockMutex(&timer->mutex);
+			continue;
+		}
+
+		uint32_t wait = VM_HOST_TIMER_IDLE_WAIT_MS;
+		if (timer->count > 0 && (timer->entries[0].deadline - now) * 1e3 < wait) {
+			wait = (uint32_t)((timer->entries[0].deadline - now) * 1e3) + 1;
+		}
+
+		VM_WaitCond(&timer->cond, &timer->mutex, wait);
+	}
+}
+
+static void VM_StartHostTimer(void) {
+	struct VM_HostTimer* timer = &vm_host_timer;
+	VM_InitMutex(&timer->mutex);
+	VM_InitCond(&timer->cond);
+
+	// Lives as long as the process
+	vm_host_timer_started = VM_StartThread(&timer->thread, VM_RunHostTimer, timer);
+}
+
+static struct VM_HostTimer* VM_GetHostTimer(void) {
+	VM_CallOnce(&vm_host_timer_once, VM_StartHostTimer);
+	return vm_host_timer_started ? &vm_host_timer : NULL;
+}
+
+// R0 = FNV-1a of the R1 bytes at R0
+static enum VM_HostStatus VM_Host_Hash(struct IL_VirtualMachine* vm, void* user) {
+	(void)user;
+	const uint8_t* data = VM_GetGuestBuffer(vm, vm->r0, vm->r1);
+	if (data == NULL) {
+		return VM_HOST_DONE;
+	}
+
+	uint64_t hash = UINT64_C(0xCBF29CE484222325);
+	for (uint64_t i = 0; i < vm->r1; ++i) {
+		hash = (hash ^ data[i]) * UINT64_C(0x100000001B3);
+	}
+
+	vm->r0 = hash;
+	return VM_HOST_DONE;
+}
+
+// R0 = splitmix64 finalizer of R0
+static enum VM_HostStatus VM_Host_Mix(struct IL_VirtualMachine* vm, void* user) {
+	(void)user;
+	uint64_t x = vm->r0;
+	x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+	vm->r0 = x ^ (x >> 31);
+	return VM_HOST_DONE;
+}
+
+// R0 = monotonic nanoseconds
+static enum VM_HostStatus VM_Host_Clock(struct IL_VirtualMachine* vm, void* user) {
+	(void)user;
+	vm->r0 = (uint64_t)(VM_GetTime() * 1e9);
+	return VM_HOST_DONE;
+}
+
+// Writes the R1 bytes at R0 to stdout, R0 = bytes written
+static enum VM_HostStatus VM_Host_Write(struct IL_VirtualMachine* vm, void* user) {
+	(void)user;
+	const void* data = VM_GetGuestBuffer(vm, vm->r0, vm->r1);
+	if (data == NULL) {
+		return VM_HOST_DONE;
+	}
+
+	vm->r0 = fwrite(data, 1, vm->r1, stdout);
+	return VM_HOST_DONE;
+}
+
+// Pending for R0 microseconds, R0 = 0 once done. Stands in for slow I/O, the VM doesn't hold its thread meanwhile.
+static enum VM_HostStatus VM_Host_Sleep(struct IL_VirtualMachine* vm, void* user) {
+	(void)user;
+	struct VM_HostTimer* timer = VM_GetHostTimer();
+	if (timer == NULL) {
+		vm->r0 = UINT64_MAX;
+		return VM_HOST_DONE;
+	}
+
+	struct VM_TimerEntry entry = { VM_GetTime() + (double)vm->r0 / 1e6, vm };
+	vm->r0 = 0;
+
+	VM_LockMutex(&timer->mutex);
+	bool queued = VM_PushTimerEntry(timer, entry);
+	if (queued && timer->entries[0].vm == vm) {
+		VM_SignalCond(&timer->cond);
+	}
+
+	VM_UnlockMutex(&timer->mutex);
+
+	if (!queued) {
+		vm->r0 = UINT64_MAX;
+		return VM_HOST_DONE;
+	}
+
+	return VM_HOST_PENDING;
+}
+
+// Pending and already complete, the cost of a suspend and resume round trip
+static enum VM_HostStatus VM_Host_Yield(struct IL_VirtualMachine* vm, void* user) {
+	(void)user;
+	VM_CompleteHostCall(vm);
+	return VM_HOST_PENDING;
+}
+
+static enum VM_HostStatus VM_Host_Nop(struct IL_VirtualMachine* vm, void* user) {
+	(void)vm;
+	(void)user;
+	return VM_HOST_DONE;
+}
+
+#define VM_BUILTIN_HOST_FUNCTIONS(yield) { \
+	{ "hash", VM_Host_Hash, VM_HOST_FLAG_NONBLOCKING, NULL }, \
+	{ "mix", VM_Host_Mix, VM_HOST_FLAG_PURE | VM_HOST_FLAG_NONBLOCKING, NULL }, \
+	{ "clock", VM_Host_Clock, VM_HOST_FLAG_NONBLOCKING, NULL }, \
+	{ "write", VM_Host_Write, VM_HOST_FLAG_NONE, NULL }, \
+	{ "sleep", VM_Host_Sleep, VM_HOST_FLAG_NONE, NULL }, \
+	{ "yield", yield, VM_HOST_FLAG_NONBLOCKING, NULL }, \
+}
+
+static const struct VM_HostFunction VM_BUILTIN_FUNCTIONS[] = VM_BUILTIN_HOST_FUNCTIONS(VM_Host_Yield);
+static const struct VM_HostFunction VM_BUILTIN_INLINE_FUNCTIONS[] = VM_BUILTIN_HOST_FUNCTIONS(VM_Host_Nop);
+
+const struct VM_HostTable VM_BUILTIN_HOST_TABLE = {
+	VM_BUILTIN_FUNCTIONS,
+	sizeof(VM_BUILTIN_FUNCTIONS) / sizeof(VM_BUILTIN_FUNCTIONS[0]),
+};
+
+const struct VM_HostTable VM_BUILTIN_INLINE_HOST_TABLE = {
+	VM_BUILTIN_INLINE_FUNCTIONS,
+	sizeof(VM_BUILTIN_INLINE_FUNCTIONS) / sizeof(VM_BUILTIN_INLINE_FUNCTIONS[0]),
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vm.h"
+
+// Functions the guest calls with HOSTCALL <index>. Arguments are read from R0-R12 and results are
+// written back to them, buffers are passed as guest addresses and used in place through VM_GetGuestBuffer.
+// A function may raise a fault, IP is then left on the HOSTCALL.
+//
+// A function that starts a slow operation can return VM_HOST_PENDING instead of waiting for it. The VM
+// is suspended past the call and its owner parks it with VM_ParkHostCall, the host writes the results
+// and calls VM_CompleteHostCall from any thread once the operation is done, which wakes the VM.
+
+enum VM_HostFlags {
+	VM_HOST_FLAG_NONE = 0,
+	VM_HOST_FLAG_PURE = 1 << 0, // Only writes its result registers, never faults nor is pending
+	VM_HOST_FLAG_NONBLOCKING = 1 << 1, // Doesn't wait on I/O or locks nor allocate, native blocks call it inline
+};
+
+enum VM_HostStatus {
+	VM_HOST_DONE,
+	VM_HOST_PENDING, // Results come with VM_CompleteHostCall
+};
+
+typedef enum VM_HostStatus (*VM_HostFn_t)(struct IL_VirtualMachine* vm, void* user);
+
+struct VM_HostFunction {
+	const char* name;
+	VM_HostFn_t fn;
+	uint32_t flags; // enum VM_HostFlags
+	void* user;
+};
+
+// Read only once registered, VMs and compiled blocks keep pointers to it
+struct VM_HostTable {
+	const struct VM_HostFunction* functions;
+	size_t count;
+};
+
+// hash, mix, clock, write, sleep and yield, see host.c
+extern const struct VM_HostTable VM_BUILTIN_HOST_TABLE;
+
+// Same functions with a yield that returns without suspending, what the suspend costs is the difference
+extern const struct VM_HostTable VM_BUILTIN_INLINE_HOST_TABLE;
+
+// Called after VM_Init, forks and snapshots keep the table
+static inline void VM_RegisterHostTable(struct IL_VirtualMachine* vm, const struct VM_HostTable* table) {
+	vm->host = table;
+}
+
+// Runs host function index, raises VM_FAULT_HOST_CALL if the table doesn't have it
+void VM_CallHost(struct IL_VirtualMachine* vm, uint64_t index);
+
+// Called by the host once the results of a pending call are in R0-R12, the VM is woken through
+// vm->wake if its owner already parked it
+void VM_CompleteHostCall(struct IL_VirtualMachine* vm);
+
+// Called by the owner of a VM that stopped with VM_SUSPEND_HOST_CALL, with vm->wake set. Returns true
+// if the call already completed and the VM can be resumed now, otherwise vm->wake is called later.
+bool VM_ParkHostCall(struct IL_VirtualMachine* vm);
+
+// VM_Execute that waits on the calling thread for the host calls to complete, returns how many were pending
+uint64_t VM_ExecuteWaiting(struct IL_VirtualMachine* vm, const struct VM_Program* program, enum VM_Engine engine);
+
+// Host pointer to size committed bytes at a guest address, raises VM_FAULT_MEMORY and returns NULL otherwise
+void* VM_GetGuestBuffer(struct IL_VirtualMachine* vm, uint64_t address, uint64_t size);
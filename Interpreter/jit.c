@@ -0,0 +1,1144 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "il.h"
+#include "vm.h"
+#include "memory.h"
+#include "decoder.h"
+#include "handlers.h"
+#include "dispatch.h"
+#include "jit.h"
+#include "host.h"
+
+#define VM_JIT_REG_OFFSET(id) ((int32_t)offsetof(struct IL_VirtualMachine, regs) + (int32_t)(id) * 8)
+#define VM_JIT_CD_OFFSET VM_JIT_REG_OFFSET(IL_CD_REG)
+#define VM_JIT_IP_OFFSET VM_JIT_REG_OFFSET(IL_IP_REG)
+#define VM_JIT_STEPS_OFFSET ((int32_t)offsetof(struct IL_VirtualMachine, steps))
+#define VM_JIT_HOST_OFFSET ((int32_t)offsetof(struct IL_VirtualMachine, host))
+#define VM_JIT_SUSPEND_OFFSET ((int32_t)offsetof(struct IL_VirtualMachine, suspend))
+#define VM_JIT_FUEL_LIMIT_OFFSET ((int32_t)offsetof(struct IL_VirtualMachine, fuel_limit))
+#define VM_JIT_SP_OFFSET VM_JIT_REG_OFFSET(IL_SP_REG)
+#define VM_JIT_MEMORY_OFFSET ((int32_t)offsetof(struct IL_VirtualMachine, memory))
+#define VM_JIT_BASE_OFFSET ((int32_t)offsetof(struct VM_Memory, base))
+
+// Host registers, rbx holds the VM for the whole block, r8 the step counter and r9 the base of the guest space
+enum VM_HostRegister {
+	VM_HOST_RAX = 0, // First operand
+	VM_HOST_RCX = 1, // Second operand
+	VM_HOST_RDX = 2, // Conditions
+	VM_HOST_RBX = 3,
+	VM_HOST_RSI = 6,
+	VM_HOST_RDI = 7,
+};
+
+// Integer arguments of host calls
+#ifdef _WIN32
+#define VM_HOST_ARG0 VM_HOST_RCX
+#define VM_HOST_ARG1 VM_HOST_RDX
+#else
+#define VM_HOST_ARG0 VM_HOST_RDI
+#define VM_HOST_ARG1 VM_HOST_RSI
+#endif
+
+// x86 condition codes
+enum VM_HostCondition {
+	VM_HOST_B = 0x2,
+	VM_HOST_AE = 0x3,
+	VM_HOST_E = 0x4,
+	VM_HOST_NE = 0x5,
+	VM_HOST_BE = 0x6,
+	VM_HOST_A = 0x7,
+};
+
+// `op rax, rcx` opcodes
+enum VM_HostAlu {
+	VM_HOST_ADD = 0x01,
+	VM_HOST_OR = 0x09,
+	VM_HOST_AND = 0x21,
+	VM_HOST_SUB = 0x29,
+	VM_HOST_XOR = 0x31,
+	VM_HOST_CMP = 0x39,
+	VM_HOST_MOV = 0x89,
+};
+
+struct VM_Emitter {
+	uint8_t* data;
+	size_t size;
+	size_t used;
+	bool overflow;
+};
+
+struct VM_JitFixup {
+	size_t at; // rel32 to patch
+	size_t target; // Index of the target code in the block
+};
+
+struct VM_JitBlockBuilder {
+	struct VM_Emitter emitter;
+	const struct VM_Program* program;
+	const struct VM_Jit* jit;
+	const struct VM_HostTable* host; // Of the VM that got the block compiled
+	size_t start;
+	size_t end;
+
+	// Steps not yet added to r8
+	uint32_t pending;
+
+	// rax and rcx still hold the operands of the last CMP
+	bool compare_live;
+
+	bool targets[VM_JIT_MAX_BLOCK];
+	size_t labels[VM_JIT_MAX_BLOCK];
+	struct VM_JitFixup fixups[VM_JIT_MAX_BLOCK];
+	size_t fixup_count;
+};
+
+static void* VM_AllocateExecutable(size_t size) {
+#ifdef _WIN32
+	return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READ);
+#else
+	void* memory = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return memory == MAP_FAILED ? NULL : memory;
+#endif
+}
+
+static void VM_FreeExecutable(void* memory, size_t size) {
+#ifdef _WIN32
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, size);
+#endif
+}
+
+// Memory is never writable and executable at the same time
+static bool VM_ProtectExecutable(void* memory, size_t size, bool writable) {
+#ifdef _WIN32
+	DWORD old;
+	return VirtualProtect(memory, size, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old) != 0;
+#else
+	return mprotect(memory, size, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+static void VM_Emit(struct VM_Emitter* e, const void* data, size_t size) {
+	if (e->overflow || e->size - e->used < size) {
+		e->overflow = true;
+		return;
+	}
+
+	memcpy(e->data + e->used, data, size);
+	e->used += size;
+}
+
+static void VM_Emit8(struct VM_Emitter* e, uint8_t value) {
+	VM_Emit(e, &value, sizeof(value));
+}
+
+static void VM_Emit32(struct VM_Emitter* e, uint32_t value) {
+	VM_Emit(e, &value, sizeof(value));
+}
+
+static void VM_Emit64(struct VM_Emitter* e, uint64_t value) {
+	VM_Emit(e, &value, sizeof(value));
+}
+
+static void VM_Patch32(struct VM_Emitter* e, size_t at, size_t target) {
+	if (e->overflow) {
+		return;
+	}
+
+	int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+	memcpy(e->data + at, &rel, sizeof(rel));
+}
+
+// [rbx + disp32] with reg in the ModRM reg field
+static void VM_EmitMemory(struct VM_Emitter* e, uint8_t reg, int32_t disp) {
+	VM_Emit8(e, 0x80 | (reg << 3) | VM_HOST_RBX);
+	VM_Emit32(e, (uint32_t)disp);
+}
+
+// mov reg, qword [rbx + disp]
+static void VM_EmitLoad(struct VM_Emitter* e, uint8_t reg, int32_t disp) {
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, reg, disp);
+}
+
+// mov [rbx + disp], reg with the low size bytes of reg, the rest of the slot is left untouched
+static void VM_EmitStore(struct VM_Emitter* e, uint8_t reg, int32_t disp, uint8_t size) {
+	if (size == 2) {
+		VM_Emit8(e, 0x66);
+	}
+	else if (size == 8) {
+		VM_Emit8(e, 0x48);
+	}
+
+	VM_Emit8(e, size == 1 ? 0x88 : 0x89);
+	VM_EmitMemory(e, reg, disp);
+}
+
+static void VM_EmitZeroExtend(struct VM_Emitter* e, uint8_t reg, uint8_t size) {
+	uint8_t modrm = 0xC0 | (reg << 3) | reg;
+	switch (size) {
+	case 1:
+		VM_Emit(e, (uint8_t[]) { 0x0F, 0xB6, modrm }, 3);
+		break;
+	case 2:
+		VM_Emit(e, (uint8_t[]) { 0x0F, 0xB7, modrm }, 3);
+		break;
+	case 4:
+		VM_Emit(e, (uint8_t[]) { 0x89, modrm }, 2);
+		break;
+	}
+}
+
+// mov reg, imm64
+static void VM_EmitMoveImmediate(struct VM_Emitter* e, uint8_t reg, uint64_t value) {
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0xB8 + reg);
+	VM_Emit64(e, value);
+}
+
+// op rax, rcx
+static void VM_EmitAlu(struct VM_Emitter* e, enum VM_HostAlu op) {
+	VM_Emit(e, (uint8_t[]) { 0x48, (uint8_t)op, 0xC8 }, 3);
+}
+
+// op edx, imm32 with op the /digit of the 0x81 group
+static void VM_EmitConditionsImmediate(struct VM_Emitter* e, uint8_t digit, uint32_t value) {
+	VM_Emit8(e, 0x81);
+	VM_Emit8(e, 0xC0 | (digit << 3) | VM_HOST_RDX);
+	VM_Emit32(e, value);
+}
+
+// jcc rel32, returns the position of the rel32
+static size_t VM_EmitJcc(struct VM_Emitter* e, enum VM_HostCondition condition) {
+	VM_Emit8(e, 0x0F);
+	VM_Emit8(e, 0x80 | condition);
+	size_t at = e->used;
+	VM_Emit32(e, 0);
+	return at;
+}
+
+static size_t VM_EmitJmp(struct VM_Emitter* e) {
+	VM_Emit8(e, 0xE9);
+	size_t at = e->used;
+	VM_Emit32(e, 0);
+	return at;
+}
+
+static void VM_FlushSteps(struct VM_JitBlockBuilder* b) {
+	if (b->pending == 0) {
+		return;
+	}
+
+	// add r8, imm32
+	VM_Emit(&b->emitter, (uint8_t[]) { 0x49, 0x81, 0xC0 }, 3);
+	VM_Emit32(&b->emitter, b->pending);
+	b->pending = 0;
+}
+
+// r8 and r9, on entry and after calls that may have clobbered them
+static void VM_EmitLoadState(struct VM_Emitter* e) {
+	// mov r8, [rbx + steps]
+	VM_Emit8(e, 0x4C);
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, 0, VM_JIT_STEPS_OFFSET);
+
+	// mov r9, [rbx + memory], mov r9, [r9 + base]
+	VM_Emit8(e, 0x4C);
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, 1, VM_JIT_MEMORY_OFFSET);
+	VM_Emit(e, (uint8_t[]) { 0x4D, 0x8B, 0x89 }, 3);
+	VM_Emit32(e, (uint32_t)VM_JIT_BASE_OFFSET);
+}
+
+static void VM_EmitPrologue(struct VM_JitBlockBuilder* b) {
+	struct VM_Emitter* e = &b->emitter;
+
+	// push rbx, mov rbx, <first argument>
+	VM_Emit8(e, 0x53);
+#ifdef _WIN32
+	VM_Emit(e, (uint8_t[]) { 0x48, 0x89, 0xCB }, 3);
+#else
+	VM_Emit(e, (uint8_t[]) { 0x48, 0x89, 0xFB }, 3);
+#endif
+
+	VM_EmitLoadState(e);
+}
+
+// Leaves the block with IP at rax
+static void VM_EmitLeave(struct VM_Emitter* e) {
+	// mov [rbx + ip], rax, mov [rbx + steps], r8
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x89);
+	VM_EmitMemory(e, VM_HOST_RAX, VM_JIT_IP_OFFSET);
+	VM_Emit8(e, 0x4C);
+	VM_Emit8(e, 0x89);
+	VM_EmitMemory(e, 0, VM_JIT_STEPS_OFFSET);
+
+	// pop rbx, ret
+	VM_Emit8(e, 0x5B);
+	VM_Emit8(e, 0xC3);
+}
+
+// Leaves the block with IP at the given decoded code, pending steps have to be flushed
+static void VM_EmitExit(struct VM_JitBlockBuilder* b, size_t index) {
+	assert(b->pending == 0);
+	VM_EmitMoveImmediate(&b->emitter, VM_HOST_RAX, (uint64_t)b->program->base + b->jit->offsets[index]);
+	VM_EmitLeave(&b->emitter);
+}
+
+static bool VM_IsJitWidth(uint8_t size) {
+	return size == 1 || size == 2 || size == 4 || size == 8;
+}
+
+static bool VM_IsJitRegister(const struct VM_DecodedOperand* op) {
+	return op->type == IL_OPERAND_TYPE_REGISTER && VM_IsJitWidth(op->size) && op->reg != IL_IP_REG && op->reg != IL_CD_REG;
+}
+
+static bool VM_IsJitSource(const struct VM_DecodedOperand* op) {
+	return op->type == IL_OPERAND_TYPE_IMMEDIATE || VM_IsJitRegister(op);
+}
+
+// Non blocking functions of the table the block is compiled against are called from native code
+static const struct VM_HostFunction* VM_GetJitHostFunction(const struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code) {
+	const struct VM_DecodedOperand* op = &code->ops[0];
+	if (code->operand_count != 1 || op->type != IL_OPERAND_TYPE_IMMEDIATE || b->host == NULL || op->value >= b->host->count) {
+		return NULL;
+	}
+
+	const struct VM_HostFunction* function = &b->host->functions[op->value];
+	return (function->flags & VM_HOST_FLAG_NONBLOCKING) ? function : NULL;
+}
+
+static bool VM_CanCompile(const struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code) {
+	switch (code->mnemonic) {
+	case IL_MNEMONIC_SET:
+	case IL_MNEMONIC_ADD:
+	case IL_MNEMONIC_SUB:
+	case IL_MNEMONIC_MUL:
+	case IL_MNEMONIC_AND:
+	case IL_MNEMONIC_OR:
+	case IL_MNEMONIC_XOR:
+	case IL_MNEMONIC_SHIFTR:
+	case IL_MNEMONIC_SHIFTL:
+	case IL_MNEMONIC_CMP:
+		return code->operand_count == 2 && VM_IsJitRegister(&code->ops[0]) && VM_IsJitSource(&code->ops[1]);
+	case IL_MNEMONIC_LOAD:
+		return code->operand_count == 2 && VM_IsJitRegister(&code->ops[0]) && VM_IsJitSource(&code->ops[1]);
+	case IL_MNEMONIC_STORE:
+		return code->operand_count == 2 && VM_IsJitSource(&code->ops[0]) && VM_IsJitSource(&code->ops[1]);
+	case IL_MNEMONIC_NOT:
+	case IL_MNEMONIC_POP:
+		return code->operand_count == 1 && VM_IsJitRegister(&code->ops[0]);
+	case IL_MNEMONIC_PUSH:
+		return code->operand_count == 1 && VM_IsJitSource(&code->ops[0]);
+	case IL_MNEMONIC_BRANCH:
+	case IL_MNEMONIC_CALL:
+		return code->operand_count == 1 && (code->flags & VM_CODE_FLAG_DIRECT);
+	case IL_MNEMONIC_RETURN:
+		return true;
+	case IL_MNEMONIC_HALT:
+		return true;
+	case IL_MNEMONIC_HOSTCALL:
+		return VM_GetJitHostFunction(b, code) != NULL;
+	default:
+		return false;
+	}
+}
+
+// Skips the rest of the code when its predicate doesn't hold, returns the rel32 to patch or SIZE_MAX
+static size_t VM_EmitPredicate(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code) {
+	struct VM_Emitter* e = &b->emitter;
+	uint32_t predicate = code->conditions;
+	if (predicate == 0) {
+		return SIZE_MAX;
+	}
+
+	// Right after a CMP the host flags can be recomputed from its operands
+	if (b->compare_live) {
+		enum VM_HostCondition skip;
+		bool direct = true;
+		switch (predicate) {
+		case IL_CONDITIONS_EQ: skip = VM_HOST_NE; break;
+		case IL_CONDITIONS_NEQ: skip = VM_HOST_E; break;
+		case IL_CONDITIONS_LT: skip = VM_HOST_AE; break;
+		case IL_CONDITIONS_GT: skip = VM_HOST_BE; break;
+		default: direct = false; break;
+		}
+
+		if (direct) {
+			VM_EmitAlu(e, VM_HOST_CMP);
+			return VM_EmitJcc(e, skip);
+		}
+	}
+
+	// mov edx, [cd], and edx, predicate, cmp edx, predicate
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, VM_HOST_RDX, VM_JIT_CD_OFFSET);
+	VM_EmitConditionsImmediate(e, 4, predicate);
+	VM_EmitConditionsImmediate(e, 7, predicate);
+	return VM_EmitJcc(e, VM_HOST_NE);
+}
+
+// Loads both operands of a `dst op src` code in rax and rcx, zero extended to their width
+static void VM_EmitOperands(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, uint8_t src_size) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	VM_EmitLoad(e, VM_HOST_RAX, VM_JIT_REG_OFFSET(op0->reg));
+	VM_EmitZeroExtend(e, VM_HOST_RAX, op0->size);
+
+	// Immediates are already zero extended by the decoder
+	if (op1->type == IL_OPERAND_TYPE_IMMEDIATE) {
+		VM_EmitMoveImmediate(e, VM_HOST_RCX, op1->value);
+	}
+	else {
+		VM_EmitLoad(e, VM_HOST_RCX, VM_JIT_REG_OFFSET(op1->reg));
+		VM_EmitZeroExtend(e, VM_HOST_RCX, src_size);
+	}
+}
+
+static void VM_EmitArithmetic(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	VM_EmitOperands(b, code, op0->size < op1->size ? op0->size : op1->size);
+
+	switch (code->mnemonic) {
+	case IL_MNEMONIC_SET: VM_EmitAlu(e, VM_HOST_MOV); break;
+	case IL_MNEMONIC_ADD: VM_EmitAlu(e, VM_HOST_ADD); break;
+	case IL_MNEMONIC_SUB: VM_EmitAlu(e, VM_HOST_SUB); break;
+	case IL_MNEMONIC_AND: VM_EmitAlu(e, VM_HOST_AND); break;
+	case IL_MNEMONIC_OR: VM_EmitAlu(e, VM_HOST_OR); break;
+	case IL_MNEMONIC_XOR: VM_EmitAlu(e, VM_HOST_XOR); break;
+	case IL_MNEMONIC_MUL: VM_Emit(e, (uint8_t[]) { 0x48, 0x0F, 0xAF, 0xC1 }, 4); break; // imul rax, rcx
+	case IL_MNEMONIC_SHIFTR: VM_Emit(e, (uint8_t[]) { 0x48, 0xD3, 0xE8 }, 3); break; // shr rax, cl
+	case IL_MNEMONIC_SHIFTL: VM_Emit(e, (uint8_t[]) { 0x48, 0xD3, 0xE0 }, 3); break; // shl rax, cl
+	}
+
+	VM_EmitStore(e, VM_HOST_RAX, VM_JIT_REG_OFFSET(op0->reg), op0->size);
+}
+
+static void VM_EmitCompare(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code) {
+	struct VM_Emitter* e = &b->emitter;
+	VM_EmitOperands(b, code, code->ops[1].size);
+
+	// mov edx, [cd], and edx, ~compare conditions
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, VM_HOST_RDX, VM_JIT_CD_OFFSET);
+	VM_EmitConditionsImmediate(e, 4, ~(uint32_t)VM_COMPARE_CONDITIONS);
+
+	// Same result as VM_SetCompareConditions, rel8 offsets count the 6 byte `or edx, imm32`
+	VM_EmitAlu(e, VM_HOST_CMP);
+	VM_Emit(e, (uint8_t[]) { 0x70 | VM_HOST_NE, 8 }, 2);
+	VM_EmitConditionsImmediate(e, 1, IL_CONDITIONS_EQ);
+	VM_Emit(e, (uint8_t[]) { 0xEB, 16 }, 2);
+	VM_Emit(e, (uint8_t[]) { 0x70 | VM_HOST_B, 8 }, 2);
+	VM_EmitConditionsImmediate(e, 1, IL_CONDITIONS_NEQ | IL_CONDITIONS_GT);
+	VM_Emit(e, (uint8_t[]) { 0xEB, 6 }, 2);
+	VM_EmitConditionsImmediate(e, 1, IL_CONDITIONS_NEQ | IL_CONDITIONS_LT);
+
+	// mov [cd], edx
+	VM_Emit8(e, 0x89);
+	VM_EmitMemory(e, VM_HOST_RDX, VM_JIT_CD_OFFSET);
+}
+
+static void VM_EmitNot(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+
+	VM_EmitLoad(e, VM_HOST_RAX, VM_JIT_REG_OFFSET(op0->reg));
+	VM_Emit(e, (uint8_t[]) { 0x48, 0xF7, 0xD0 }, 3); // not rax
+	VM_EmitStore(e, VM_HOST_RAX, VM_JIT_REG_OFFSET(op0->reg), op0->size);
+}
+
+static void VM_EmitJump(struct VM_JitBlockBuilder* b, size_t target) {
+	struct VM_Emitter* e = &b->emitter;
+
+	// Targets inside the block are native jumps, the others leave it
+	if (target < b->start || target >= b->end) {
+		VM_EmitExit(b, target);
+		return;
+	}
+
+	// Pays for the block jumped to like VM_ChargeFuel, lea rax, [r8 + cost], cmp rax, [rbx + fuel_limit]
+	VM_Emit(e, (uint8_t[]) { 0x49, 0x8D, 0x80 }, 3);
+	VM_Emit32(e, b->program->codes[target].cost);
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x3B);
+	VM_EmitMemory(e, VM_HOST_RAX, VM_JIT_FUEL_LIMIT_OFFSET);
+
+	struct VM_JitFixup* fixup = &b->fixups[b->fixup_count++];
+	fixup->at = VM_EmitJcc(e, VM_HOST_BE);
+	fixup->target = target - b->start;
+
+	// mov dword [rbx + suspend], VM_SUSPEND_FUEL, or dword [cd], HLT
+	VM_Emit8(e, 0xC7);
+	VM_EmitMemory(e, 0, VM_JIT_SUSPEND_OFFSET);
+	VM_Emit32(e, VM_SUSPEND_FUEL);
+	VM_Emit8(e, 0x81);
+	VM_EmitMemory(e, 1, VM_JIT_CD_OFFSET);
+	VM_Emit32(e, IL_CONDITIONS_HLT);
+	VM_EmitExit(b, target);
+}
+
+// A guest access that faults leaves the VM like the interpreter does, IP on the code and its step not counted.
+// Pending steps include the code.
+static void VM_EmitFaultState(struct VM_JitBlockBuilder* b, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+
+	VM_EmitMoveImmediate(e, VM_HOST_RAX, (uint64_t)b->program->base + b->jit->offsets[index]);
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x89);
+	VM_EmitMemory(e, VM_HOST_RAX, VM_JIT_IP_OFFSET);
+
+	// lea rax, [r8 + pending - 1], mov [rbx + steps], rax
+	VM_Emit(e, (uint8_t[]) { 0x49, 0x8D, 0x80 }, 3);
+	VM_Emit32(e, (uint32_t)((int32_t)b->pending - 1));
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x89);
+	VM_EmitMemory(e, VM_HOST_RAX, VM_JIT_STEPS_OFFSET);
+}
+
+// Loads an operand in reg, guest addresses are the low 32 bits
+static void VM_EmitSource(struct VM_Emitter* e, uint8_t reg, const struct VM_DecodedOperand* op, bool address) {
+	if (op->type == IL_OPERAND_TYPE_IMMEDIATE) {
+		VM_EmitMoveImmediate(e, reg, address ? (uint32_t)op->value : op->value);
+		return;
+	}
+
+	VM_EmitLoad(e, reg, VM_JIT_REG_OFFSET(op->reg));
+	if (address) {
+		VM_EmitZeroExtend(e, reg, op->size < 4 ? op->size : 4);
+	}
+}
+
+// mov ecx, dword [rbx + sp]
+static void VM_EmitStackAddress(struct VM_Emitter* e) {
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, VM_HOST_RCX, VM_JIT_SP_OFFSET);
+}
+
+// add or sub qword [rbx + sp], size with digit the /digit of the 0x81 group
+static void VM_EmitStackAdjust(struct VM_Emitter* e, uint8_t digit, uint8_t size) {
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x81);
+	VM_EmitMemory(e, digit, VM_JIT_SP_OFFSET);
+	VM_Emit32(e, size);
+}
+
+// mov [r9 + rcx], rax with the low size bytes of rax
+static void VM_EmitGuestStore(struct VM_Emitter* e, uint8_t size) {
+	switch (size) {
+	case 1: VM_Emit(e, (uint8_t[]) { 0x41, 0x88, 0x04, 0x09 }, 4); break;
+	case 2: VM_Emit(e, (uint8_t[]) { 0x66, 0x41, 0x89, 0x04, 0x09 }, 5); break;
+	case 4: VM_Emit(e, (uint8_t[]) { 0x41, 0x89, 0x04, 0x09 }, 4); break;
+	case 8: VM_Emit(e, (uint8_t[]) { 0x49, 0x89, 0x04, 0x09 }, 4); break;
+	}
+}
+
+// mov rax, [r9 + rcx] zero extended from size bytes
+static void VM_EmitGuestLoad(struct VM_Emitter* e, uint8_t size) {
+	switch (size) {
+	case 1: VM_Emit(e, (uint8_t[]) { 0x41, 0x0F, 0xB6, 0x04, 0x09 }, 5); break;
+	case 2: VM_Emit(e, (uint8_t[]) { 0x41, 0x0F, 0xB7, 0x04, 0x09 }, 5); break;
+	case 4: VM_Emit(e, (uint8_t[]) { 0x41, 0x8B, 0x04, 0x09 }, 4); break;
+	case 8: VM_Emit(e, (uint8_t[]) { 0x49, 0x8B, 0x04, 0x09 }, 4); break;
+	}
+}
+
+static void VM_EmitLoadCode(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+
+	VM_EmitFaultState(b, index);
+	VM_EmitSource(e, VM_HOST_RCX, &code->ops[1], true);
+	VM_EmitGuestLoad(e, op0->size);
+	VM_EmitStore(e, VM_HOST_RAX, VM_JIT_REG_OFFSET(op0->reg), op0->size);
+}
+
+static void VM_EmitStoreCode(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+
+	VM_EmitFaultState(b, index);
+	VM_EmitSource(e, VM_HOST_RCX, &code->ops[0], true);
+	VM_EmitSource(e, VM_HOST_RAX, &code->ops[1], false);
+	VM_EmitGuestStore(e, code->ops[1].size);
+}
+
+// SP moves before the write like VM_Handler_PUSH, a push that faults leaves it moved
+static void VM_EmitPush(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_DecodedOperand* op = &code->ops[0];
+
+	VM_EmitFaultState(b, index);
+	VM_EmitSource(e, VM_HOST_RAX, op, false);
+	VM_EmitStackAdjust(e, 5, op->size);
+	VM_EmitStackAddress(e);
+	VM_EmitGuestStore(e, op->size);
+}
+
+static void VM_EmitPop(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_DecodedOperand* op = &code->ops[0];
+
+	VM_EmitFaultState(b, index);
+	VM_EmitStackAddress(e);
+	VM_EmitGuestLoad(e, op->size);
+	VM_EmitStackAdjust(e, 0, op->size);
+	VM_EmitStore(e, VM_HOST_RAX, VM_JIT_REG_OFFSET(op->reg), op->size);
+}
+
+// Pushes the raw offset after the call, pending steps have to be flushed
+static void VM_EmitCallCode(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+
+	VM_EmitFaultState(b, index);
+	VM_EmitMoveImmediate(e, VM_HOST_RAX, (uint64_t)b->program->base + b->jit->offsets[index + 1]);
+	VM_EmitStackAdjust(e, 5, sizeof(uint64_t));
+	VM_EmitStackAddress(e);
+	VM_EmitGuestStore(e, sizeof(uint64_t));
+	VM_EmitJump(b, code->target);
+}
+
+// Leaves the block for the popped address, pending steps have to be flushed
+static void VM_EmitReturn(struct VM_JitBlockBuilder* b, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+
+	VM_EmitFaultState(b, index);
+	VM_EmitStackAddress(e);
+	VM_EmitGuestLoad(e, sizeof(uint64_t));
+	VM_EmitStackAdjust(e, 0, sizeof(uint64_t));
+	VM_EmitLeave(e);
+}
+
+static void VM_EmitHalt(struct VM_JitBlockBuilder* b, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+
+	// or dword [cd], HLT
+	VM_Emit8(e, 0x81);
+	VM_EmitMemory(e, 1, VM_JIT_CD_OFFSET);
+	VM_Emit32(e, IL_CONDITIONS_HLT);
+
+	VM_EmitExit(b, index + 1);
+}
+
+// call rax, steps are kept in the VM across it since r8 is caller saved
+static void VM_EmitCall(struct VM_Emitter* e) {
+#ifdef _WIN32
+	VM_Emit(e, (uint8_t[]) { 0x48, 0x83, 0xEC, 0x20 }, 4); // sub rsp, 32
+#endif
+	VM_Emit(e, (uint8_t[]) { 0xFF, 0xD0 }, 2);
+#ifdef _WIN32
+	VM_Emit(e, (uint8_t[]) { 0x48, 0x83, 0xC4, 0x20 }, 4); // add rsp, 32
+#endif
+}
+
+// Calls the function directly if the VM has the table the block was compiled against and
+// VM_CallHost otherwise. A fault leaves the block on the call and a pending call after it,
+// pending steps have to be flushed.
+static void VM_EmitHostCall(struct VM_JitBlockBuilder* b, const struct VM_DecodedCode* code, size_t index) {
+	struct VM_Emitter* e = &b->emitter;
+	const struct VM_HostFunction* function = VM_GetJitHostFunction(b, code);
+	uint8_t move_vm = 0xC0 | (VM_HOST_RBX << 3) | VM_HOST_ARG0;
+
+	// mov [rbx + steps], r8
+	VM_Emit8(e, 0x4C);
+	VM_Emit8(e, 0x89);
+	VM_EmitMemory(e, 0, VM_JIT_STEPS_OFFSET);
+
+	// cmp [rbx + host], rax
+	VM_EmitMoveImmediate(e, VM_HOST_RAX, (uint64_t)(uintptr_t)b->host);
+	VM_Emit8(e, 0x48);
+	VM_Emit8(e, 0x39);
+	VM_EmitMemory(e, VM_HOST_RAX, VM_JIT_HOST_OFFSET);
+	size_t generic = VM_EmitJcc(e, VM_HOST_NE);
+
+	VM_Emit(e, (uint8_t[]) { 0x48, 0x89, move_vm }, 3);
+	VM_EmitMoveImmediate(e, VM_HOST_ARG1, (uint64_t)(uintptr_t)function->user);
+	VM_EmitMoveImmediate(e, VM_HOST_RAX, (uint64_t)(uintptr_t)function->fn);
+	VM_EmitCall(e);
+
+	// Pure functions can't fault nor be pending, only the generic path is checked for them
+	bool pure = (function->flags & VM_HOST_FLAG_PURE) != 0;
+	size_t done = SIZE_MAX;
+	size_t finished = SIZE_MAX;
+	size_t suspended = SIZE_MAX;
+	if (pure) {
+		done = VM_EmitJmp(e);
+	}
+	else {
+		// test eax, eax, then what VM_CallHost does with VM_HOST_PENDING
+		VM_Emit(e, (uint8_t[]) { 0x85, 0xC0 }, 2);
+		finished = VM_EmitJcc(e, VM_HOST_E);
+
+		// mov dword [rbx + suspend], VM_SUSPEND_HOST_CALL, or dword [cd], HLT
+		VM_Emit8(e, 0xC7);
+		VM_EmitMemory(e, 0, VM_JIT_SUSPEND_OFFSET);
+		VM_Emit32(e, VM_SUSPEND_HOST_CALL);
+		VM_Emit8(e, 0x81);
+		VM_EmitMemory(e, 1, VM_JIT_CD_OFFSET);
+		VM_Emit32(e, IL_CONDITIONS_HLT);
+		suspended = VM_EmitJmp(e);
+	}
+
+	VM_Patch32(e, generic, e->used);
+	VM_Emit(e, (uint8_t[]) { 0x48, 0x89, move_vm }, 3);
+	VM_EmitMoveImmediate(e, VM_HOST_ARG1, code->ops[0].value);
+	VM_EmitMoveImmediate(e, VM_HOST_RAX, (uint64_t)(uintptr_t)VM_CallHost);
+	VM_EmitCall(e);
+
+	if (!pure) {
+		VM_Patch32(e, finished, e->used);
+		VM_Patch32(e, suspended, e->used);
+	}
+
+	// test dword [cd], HLT
+	VM_Emit8(e, 0xF7);
+	VM_EmitMemory(e, 0, VM_JIT_CD_OFFSET);
+	VM_Emit32(e, IL_CONDITIONS_HLT);
+	size_t running = VM_EmitJcc(e, VM_HOST_E);
+
+	// mov r8, [rbx + steps], the exits store it back
+	VM_Emit8(e, 0x4C);
+	VM_Emit8(e, 0x8B);
+	VM_EmitMemory(e, 0, VM_JIT_STEPS_OFFSET);
+
+	// cmp dword [rbx + suspend], 0
+	VM_Emit8(e, 0x83);
+	VM_EmitMemory(e, 7, VM_JIT_SUSPEND_OFFSET);
+	VM_Emit8(e, 0);
+	size_t pending = VM_EmitJcc(e, VM_HOST_NE);
+	VM_EmitExit(b, index);
+
+	VM_Patch32(e, pending, e->used);
+	VM_EmitExit(b, index + 1);
+
+	VM_Patch32(e, running, e->used);
+	if (pure) {
+		VM_Patch32(e, done, e->used);
+	}
+
+	VM_EmitLoadState(e);
+}
+
+static bool VM_IsTerminator(const struct VM_DecodedCode* code) {
+	if (code->conditions != IL_CONDITIONS_NONE) {
+		return false;
+	}
+
+	switch (code->mnemonic) {
+	case IL_MNEMONIC_BRANCH:
+	case IL_MNEMONIC_CALL:
+	case IL_MNEMONIC_RETURN:
+	case IL_MNEMONIC_HALT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Finds the extent of the block and the codes that are jumped to from inside it
+static void VM_ScanBlock(struct VM_JitBlockBuilder* b) {
+	const struct VM_DecodedCode* codes = b->program->codes;
+
+	b->end = b->start;
+	while (b->end < b->program->count && b->end - b->start < VM_JIT_MAX_BLOCK && VM_CanCompile(b, &codes[b->end])) {
+		if (VM_IsTerminator(&codes[b->end++])) {
+			break;
+		}
+	}
+
+	memset(b->targets, 0, sizeof(b->targets));
+	for (size_t i = b->start; i < b->end; ++i) {
+		const struct VM_DecodedCode* code = &codes[i];
+		bool jumps = code->mnemonic == IL_MNEMONIC_BRANCH || code->mnemonic == IL_MNEMONIC_CALL;
+		if (jumps && code->target >= b->start && code->target < b->end) {
+			b->targets[code->target - b->start] = true;
+		}
+	}
+}
+
+static void VM_EmitBlock(struct VM_JitBlockBuilder* b) {
+	const struct VM_DecodedCode* codes = b->program->codes;
+	VM_EmitPrologue(b);
+
+	for (size_t i = b->start; i < b->end; ++i) {
+		const struct VM_DecodedCode* code = &codes[i];
+
+		if (b->targets[i - b->start]) {
+			VM_FlushSteps(b);
+			b->compare_live = false;
+		}
+
+		b->labels[i - b->start] = b->emitter.used;
+
+		// Skipped codes are steps too, codes leaving the block flush before the predicate so both paths agree
+		b->pending += 1;
+		switch (code->mnemonic) {
+		case IL_MNEMONIC_BRANCH:
+		case IL_MNEMONIC_CALL:
+		case IL_MNEMONIC_RETURN:
+		case IL_MNEMONIC_HALT:
+		case IL_MNEMONIC_HOSTCALL:
+			VM_FlushSteps(b);
+			break;
+		}
+
+		size_t skip = VM_EmitPredicate(b, code);
+
+		switch (code->mnemonic) {
+		case IL_MNEMONIC_CMP:
+			VM_EmitCompare(b, code);
+			break;
+		case IL_MNEMONIC_NOT:
+			VM_EmitNot(b, code);
+			break;
+		case IL_MNEMONIC_LOAD:
+			VM_EmitLoadCode(b, code, i);
+			break;
+		case IL_MNEMONIC_STORE:
+			VM_EmitStoreCode(b, code, i);
+			break;
+		case IL_MNEMONIC_PUSH:
+			VM_EmitPush(b, code, i);
+			break;
+		case IL_MNEMONIC_POP:
+			VM_EmitPop(b, code, i);
+			break;
+		case IL_MNEMONIC_BRANCH:
+			VM_EmitJump(b, code->target);
+			break;
+		case IL_MNEMONIC_CALL:
+			VM_EmitCallCode(b, code, i);
+			break;
+		case IL_MNEMONIC_RETURN:
+			VM_EmitReturn(b, i);
+			break;
+		case IL_MNEMONIC_HALT:
+			VM_EmitHalt(b, i);
+			break;
+		case IL_MNEMONIC_HOSTCALL:
+			VM_EmitHostCall(b, code, i);
+			break;
+		default:
+			VM_EmitArithmetic(b, code);
+			break;
+		}
+
+		// A predicated CMP may not have run
+		b->compare_live = code->mnemonic == IL_MNEMONIC_CMP && skip == SIZE_MAX;
+
+		if (skip != SIZE_MAX) {
+			VM_Patch32(&b->emitter, skip, b->emitter.used);
+		}
+	}
+
+	// Falls through to the first code that isn't compiled
+	if (b->end == b->start || !VM_IsTerminator(&codes[b->end - 1])) {
+		VM_FlushSteps(b);
+		VM_EmitExit(b, b->end);
+	}
+
+	for (size_t i = 0; i < b->fixup_count; ++i) {
+		VM_Patch32(&b->emitter, b->fixups[i].at, b->labels[b->fixups[i].target]);
+	}
+}
+
+// Blocks looping inside themselves or leaving on a jump are kept whatever their length
+static bool VM_IsWorthCompiling(const struct VM_JitBlockBuilder* b) {
+	size_t length = b->end - b->start;
+	if (length >= VM_JIT_MIN_BLOCK || VM_IsTerminator(&b->program->codes[b->end - 1])) {
+		return true;
+	}
+
+	for (size_t i = 0; i < length; ++i) {
+		if (b->targets[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Returns NULL with state set to why the block isn't compiled
+static VM_JitBlock_t VM_CompileBlock(struct VM_Jit* jit, const struct VM_Program* program, size_t start, const struct VM_HostTable* host, enum VM_JitState* state) {
+	// Compiling happens while the program runs, the builder is allocated with the JIT
+	struct VM_JitBlockBuilder* b = jit->builder;
+	memset(b, 0, sizeof(*b));
+
+	b->program = program;
+	b->jit = jit;
+	b->host = host;
+	b->start = start;
+
+	VM_ScanBlock(b);
+	*state = VM_JIT_STATE_FAILED;
+	if (b->end == b->start) {
+		return NULL;
+	}
+
+	if (!VM_IsWorthCompiling(b)) {
+		*state = VM_JIT_STATE_SHORT;
+		return NULL;
+	}
+
+	if (!VM_ProtectExecutable(jit->memory, jit->capacity, true)) {
+		return NULL;
+	}
+
+	b->emitter.data = jit->memory + jit->used;
+	b->emitter.size = jit->capacity - jit->used;
+	VM_EmitBlock(b);
+
+	VM_JitBlock_t block = NULL;
+	if (!b->emitter.overflow) {
+		block = (VM_JitBlock_t)(void*)b->emitter.data;
+
+		// Keep blocks 16 byte aligned
+		size_t size = (b->emitter.used + 15) & ~(size_t)15;
+		jit->used += size < b->emitter.size ? size : b->emitter.size;
+	}
+
+	VM_ProtectExecutable(jit->memory, jit->capacity, false);
+	if (block != NULL) {
+		*state = VM_JIT_STATE_COMPILED;
+	}
+
+	return block;
+}
+
+// Counts an entry into the code, returns its block once it's hot
+static VM_JitBlock_t VM_PromoteCode(struct VM_Jit* jit, const struct VM_Program* program, size_t index, const struct VM_HostTable* host) {
+	switch (jit->states[index]) {
+	case VM_JIT_STATE_COMPILED:
+		return jit->blocks[index];
+	case VM_JIT_STATE_FAILED:
+	case VM_JIT_STATE_SHORT:
+		return NULL;
+	}
+
+	if (++jit->counters[index] < jit->threshold) {
+		return NULL;
+	}
+
+	enum VM_JitState state;
+	jit->blocks[index] = VM_CompileBlock(jit, program, index, host, &state);
+	jit->states[index] = (uint8_t)state;
+
+	switch (state) {
+	case VM_JIT_STATE_COMPILED:
+		jit->compiled += 1;
+		break;
+	case VM_JIT_STATE_SHORT:
+		jit->short_blocks += 1;
+		break;
+	default:
+		jit->failed += 1;
+		break;
+	}
+
+	return jit->blocks[index];
+}
+
+bool VM_CreateJit(struct VM_Program* program, uint32_t threshold) {
+#ifndef VM_JIT_SUPPORTED
+	return false;
+#else
+	struct VM_Jit* jit = calloc(1, sizeof(struct VM_Jit));
+	if (jit == NULL) {
+		return false;
+	}
+
+	program->jit = jit;
+	jit->threshold = threshold;
+	jit->capacity = VM_JIT_MEMORY_SIZE;
+	jit->memory = VM_AllocateExecutable(jit->capacity);
+	jit->blocks = calloc(program->count + 1, sizeof(VM_JitBlock_t));
+	jit->states = calloc(program->count + 1, sizeof(uint8_t));
+	jit->offsets = calloc(program->count + 1, sizeof(uint64_t));
+	jit->counters = calloc(program->count + 1, sizeof(uint32_t));
+	jit->builder = malloc(sizeof(struct VM_JitBlockBuilder));
+	if (jit->memory == NULL || jit->blocks == NULL || jit->states == NULL || jit->offsets == NULL || jit->counters == NULL || jit->builder == NULL) {
+		VM_FreeJit(program);
+		return false;
+	}
+
+	// Fused codes cover the following one, their own raw size is what's left
+	uint64_t offset = 0;
+	for (size_t i = 0; i < program->count; ++i) {
+		const struct VM_DecodedCode* code = &program->codes[i];
+		jit->offsets[i] = offset;
+		offset += code->length > 1 ? code->size - code[1].size : code->size;
+	}
+
+	jit->offsets[program->count] = offset;
+	return true;
+#endif
+}
+
+void VM_FreeJit(struct VM_Program* program) {
+	struct VM_Jit* jit = program->jit;
+	if (jit == NULL) {
+		return;
+	}
+
+	if (jit->memory != NULL) {
+		VM_FreeExecutable(jit->memory, jit->capacity);
+	}
+
+	free(jit->blocks);
+	free(jit->states);
+	free(jit->offsets);
+	free(jit->counters);
+	free(jit->builder);
+	free(jit);
+	program->jit = NULL;
+}
+
+// Loop heads and function entries, the code that jumped is the last one of a fused pair
+static bool VM_IsHotEdge(const struct VM_DecodedCode* code, const struct VM_DecodedCode* next) {
+	const struct VM_DecodedCode* last = code + code->length - 1;
+	return last->mnemonic == IL_MNEMONIC_CALL || (last->mnemonic == IL_MNEMONIC_BRANCH && next <= code);
+}
+
+struct VM_NativeContext {
+	struct VM_Jit* jit;
+	struct IL_VirtualMachine* vm;
+	const struct VM_Program* program;
+	const struct VM_DecodedCode* code; // Running, then the one to interpret next
+	VM_JitBlock_t block;
+	uint64_t steps; // When the running block was entered
+};
+
+// Blocks read and write the conditions eagerly, steps rather than fuel are counted in them and what
+// they ran is charged when they return. Jumps inside them check that the block they land in fits
+// under the limit, like the interpreter does.
+static void VM_RunNative(void* context) {
+	struct VM_NativeContext* c = context;
+	struct IL_VirtualMachine* vm = c->vm;
+
+	while (c->block != NULL) {
+		VM_MaterializeConditions(vm);
+		vm->fuel += c->code->cost;
+
+		c->steps = vm->steps;
+		vm->fuel_limit = vm->fuel > UINT64_MAX - c->steps ? UINT64_MAX : c->steps + vm->fuel;
+		c->block(vm);
+
+		uint64_t ran = vm->steps - c->steps;
+		c->jit->native_steps += ran;
+		vm->fuel -= vm->fuel < ran ? vm->fuel : ran;
+
+		// Block exits are edges too, so an outer loop gets promoted after its inner one
+		c->code = VM_LookupCode(c->program, vm->ip);
+
+		// Given back by VM_Execute if the block halted, a block that ran out already left it unpaid
+		if (VM_HasConditions(vm, IL_CONDITIONS_HLT)) {
+			if (vm->suspend != VM_SUSPEND_FUEL) {
+				vm->fuel -= vm->fuel < c->code->cost ? vm->fuel : c->code->cost;
+			}
+
+			return;
+		}
+
+		if (!VM_ChargeFuel(vm, c->code) || c->code->mnemonic == VM_MNEMONIC_BAD) {
+			return;
+		}
+
+		c->block = VM_PromoteCode(c->jit, c->program, (size_t)(c->code - c->program->codes), vm->host);
+	}
+}
+
+// Runs native blocks for as long as execution lands on hot codes, returns the code to interpret next.
+// Entering at the target of a back edge moves a running loop to native code on its next iteration.
+static const struct VM_DecodedCode* VM_EnterNative(struct VM_Jit* jit, struct IL_VirtualMachine* vm, const struct VM_Program* program, const struct VM_DecodedCode* code) {
+	if (code->mnemonic == VM_MNEMONIC_BAD || VM_HasConditions(vm, IL_CONDITIONS_HLT)) {
+		return code;
+	}
+
+	// Cold codes go back to the interpreter without guarding
+	struct VM_NativeContext context = { jit, vm, program, code, NULL, 0 };
+	context.block = VM_PromoteCode(jit, program, (size_t)(code - program->codes), vm->host);
+	if (context.block == NULL) {
+		return code;
+	}
+
+	// Blocks access guest memory unchecked, a fault leaves the one running with IP and steps stored
+	// before its access. It's charged what it ran like a block that halted.
+	uint64_t address = 0;
+	struct VM_Memory* memory = vm->memory;
+	if (!VM_RunGuarded(memory, VM_RunNative, &context, &address)) {
+		uint64_t ran = vm->steps - context.steps;
+		jit->native_steps += ran;
+		vm->fuel -= vm->fuel < ran ? vm->fuel : ran;
+
+		VM_RaiseFault(vm, VM_IsStackGuard(memory, address) ? VM_FAULT_STACK_OVERFLOW : VM_FAULT_MEMORY, address);
+		context.code = VM_LookupCode(program, vm->ip);
+		vm->fuel -= vm->fuel < context.code->cost ? vm->fuel : context.code->cost;
+	}
+
+	return context.code;
+}
+
+void VM_RunJit(struct IL_VirtualMachine* vm, const struct VM_Program* program) {
+	struct VM_Jit* jit = program->jit;
+	if (jit == NULL) {
+		VM_Run(vm, program);
+		return;
+	}
+
+	uint64_t steps = vm->steps;
+	uint64_t native_steps = jit->native_steps;
+
+	const struct VM_DecodedCode* code = VM_EnterNative(jit, vm, program, VM_LookupCode(program, vm->ip));
+
+	// Neither HLT nor NI is lazy, they're tested inline like in VM_Run
+	while (!(vm->conditions & IL_CONDITIONS_HLT)) {
+		// Cold or unsupported code, interpreted like VM_Run does
+		if (!VM_ShouldSkipCode(vm, code)) {
+			VM_HANDLERS[code->handler](vm, code);
+		}
+
+		bool jumped = !(vm->conditions & IL_CONDITIONS_NI);
+		const struct VM_DecodedCode* next = VM_GetNextCode(vm, program, code);
+		vm->steps += 1;
+
+		if (jumped && VM_IsHotEdge(code, next)) {
+			next = VM_EnterNative(jit, vm, program, next);
+		}
+
+		code = next;
+	}
+
+	VM_MaterializeConditions(vm);
+	jit->interpreted_steps += vm->steps - steps - (jit->native_steps - native_steps);
+}
+
+void VM_PrintJitStats(const struct VM_Program* program) {
+	const struct VM_Jit* jit = program->jit;
+	if (jit == NULL) {
+		return;
+	}
+
+	printf("============== TIER STATS ==============\n");
+	printf("Threshold: %u entries\n", jit->threshold);
+	printf("Blocks: %zu compiled, %zu unsupported, %zu too short, %zu bytes\n", jit->compiled, jit->failed, jit->short_blocks, jit->used);
+	printf("Interpreter: %llu insns\n", (unsigned long long)jit->interpreted_steps);
+	printf("Native: %llu insns\n", (unsigned long long)jit->native_steps);
+	printf("=======================================\n");
+}
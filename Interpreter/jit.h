@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vm.h"
+#include "decoder.h"
+
+// Native code is only generated on x86-64 hosts, VM_CreateJit fails everywhere else
+#if defined(_M_X64) || defined(__x86_64__)
+#define VM_JIT_SUPPORTED
+#endif
+
+// Executable memory shared by the blocks of a program
+#define VM_JIT_MEMORY_SIZE (1 << 20)
+
+// Longest run of decoded codes compiled into a single block
+#define VM_JIT_MAX_BLOCK 256
+
+// Blocks handing back to the interpreter pay for entering and leaving native code, shorter ones run slower
+// than interpreted. Blocks that end on a jump chain into other blocks and are compiled at any length.
+#define VM_JIT_MIN_BLOCK 8
+
+// Entries into a code before it's compiled, 0 compiles everything that is reached
+#ifndef VM_JIT_DEFAULT_THRESHOLD
+#define VM_JIT_DEFAULT_THRESHOLD 50
+#endif
+
+typedef void (*VM_JitBlock_t)(struct IL_VirtualMachine* vm);
+
+struct VM_JitBlockBuilder;
+
+enum VM_JitState {
+	VM_JIT_STATE_NONE, // Still cold, interpreted
+	VM_JIT_STATE_COMPILED,
+	VM_JIT_STATE_FAILED, // Starts with an unsupported code, always interpreted
+	VM_JIT_STATE_SHORT, // Covers fewer than VM_JIT_MIN_BLOCK codes before an unsupported one, always interpreted
+};
+
+// Code starts in the interpreter tier. Targets of backward branches, calls and block exits are
+// counted and compiled once they cross the threshold, the next entry runs the native block until
+// an unsupported code, which is handed back to the interpreter. Registers live in the IL_VirtualMachine itself.
+struct VM_Jit {
+	uint8_t* memory;
+	size_t capacity;
+	size_t used;
+
+	// Per decoded code
+	VM_JitBlock_t* blocks;
+	uint8_t* states; // enum VM_JitState
+	uint64_t* offsets; // Raw offset, count + 1 entries
+	uint32_t* counters; // Entries while cold
+
+	struct VM_JitBlockBuilder* builder; // Scratch space of the compiler
+
+	uint32_t threshold;
+	size_t compiled;
+	size_t failed;
+	size_t short_blocks;
+
+	// Steps run by each tier
+	uint64_t interpreted_steps;
+	uint64_t native_steps;
+};
+
+// The JIT is owned by the program, VM_FreeJit has to be called before VM_FreeProgram
+bool VM_CreateJit(struct VM_Program* program, uint32_t threshold);
+void VM_FreeJit(struct VM_Program* program);
+void VM_PrintJitStats(const struct VM_Program* program);
@@ -0,0 +1,126 @@
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "image.h"
+#include "loader.h"
+
+static bool VM_RejectMapping(const char** error, const char* reason) {
+	if (error != NULL) {
+		*error = reason;
+	}
+
+	return false;
+}
+
+#ifdef _WIN32
+
+static bool VM_MapView(const char* path, struct VM_MappedImage* mapped, const char** error) {
+	mapped->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mapped->file == INVALID_HANDLE_VALUE) {
+		mapped->file = NULL;
+		return VM_RejectMapping(error, "can't open file");
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mapped->file, &size) || size.QuadPart == 0) {
+		return VM_RejectMapping(error, "empty file");
+	}
+
+	mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapped->mapping == NULL) {
+		return VM_RejectMapping(error, "can't map file");
+	}
+
+	mapped->view = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapped->view == NULL) {
+		return VM_RejectMapping(error, "can't map file");
+	}
+
+	mapped->size = (size_t)size.QuadPart;
+	return true;
+}
+
+void VM_UnmapImage(struct VM_MappedImage* mapped) {
+	if (mapped->view != NULL) {
+		UnmapViewOfFile(mapped->view);
+	}
+
+	if (mapped->mapping != NULL) {
+		CloseHandle(mapped->mapping);
+	}
+
+	if (mapped->file != NULL) {
+		CloseHandle(mapped->file);
+	}
+
+	memset(mapped, 0, sizeof(*mapped));
+}
+
+#else
+
+static bool VM_MapView(const char* path, struct VM_MappedImage* mapped, const char** error) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return VM_RejectMapping(error, "can't open file");
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return VM_RejectMapping(error, "empty file");
+	}
+
+	// The mapping keeps its own reference to the file
+	void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (view == MAP_FAILED) {
+		return VM_RejectMapping(error, "can't map file");
+	}
+
+	mapped->view = view;
+	mapped->size = (size_t)info.st_size;
+	return true;
+}
+
+void VM_UnmapImage(struct VM_MappedImage* mapped) {
+	if (mapped->view != NULL) {
+		munmap((void*)mapped->view, mapped->size);
+	}
+
+	memset(mapped, 0, sizeof(*mapped));
+}
+
+#endif
+
+bool VM_MapImage(const char* path, struct VM_MappedImage* mapped, const char** error) {
+	memset(mapped, 0, sizeof(*mapped));
+
+	if (!VM_MapView(path, mapped, error)) {
+		VM_UnmapImage(mapped);
+		return false;
+	}
+
+	// Headerless files predate the container
+	if (!IL_IsImage(mapped->view, mapped->size)) {
+		mapped->image.code = mapped->view;
+		mapped->image.code_size = mapped->size;
+		return true;
+	}
+
+	if (!IL_ParseImage(mapped->view, mapped->size, &mapped->image, error)) {
+		VM_UnmapImage(mapped);
+		return false;
+	}
+
+	return true;
+}
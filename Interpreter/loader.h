@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "image.h"
+
+// Read-only view of an image file, processes mapping the same file share its pages.
+// Only the raw bytes are shared, every program decodes its own copy, see VM_DecodeProgram.
+struct VM_MappedImage {
+	const uint8_t* view;
+	size_t size;
+
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+
+	struct IL_Image image;
+};
+
+// Files without the image magic are mapped as a bare code section, error is a static string
+bool VM_MapImage(const char* path, struct VM_MappedImage* mapped, const char** error);
+void VM_UnmapImage(struct VM_MappedImage* mapped);
@@ -0,0 +1,484 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "il.h"
+#include "vm.h"
+#include "decoder.h"
+#include "handlers.h"
+#include "variants.h"
+#include "memory.h"
+#include "lockstep.h"
+
+#if defined(VM_LOCKSTEP_AVX2)
+#include <immintrin.h>
+#elif defined(VM_LOCKSTEP_SSE2)
+#include <emmintrin.h>
+#endif
+
+// Lane vectors, AVX2 and SSE2 have no 64 bit multiply or per lane shift so they're built from what there is.
+// Shift counts are masked like the x86 shift instructions the scalar handlers compile to.
+#if defined(VM_LOCKSTEP_AVX2)
+
+typedef __m256i VM_Lanes_t;
+#define VM_LANES_PER_VECTOR 4
+
+static inline VM_Lanes_t VM_LoadLanes(const uint64_t* lanes) { return _mm256_load_si256((const __m256i*)lanes); }
+static inline void VM_StoreLanes(uint64_t* lanes, VM_Lanes_t value) { _mm256_store_si256((__m256i*)lanes, value); }
+static inline VM_Lanes_t VM_BroadcastLanes(uint64_t value) { return _mm256_set1_epi64x((long long)value); }
+static inline VM_Lanes_t VM_AndLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm256_and_si256(a, b); }
+static inline VM_Lanes_t VM_AndNotLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm256_andnot_si256(a, b); }
+static inline VM_Lanes_t VM_OrLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm256_or_si256(a, b); }
+static inline VM_Lanes_t VM_XorLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm256_xor_si256(a, b); }
+static inline VM_Lanes_t VM_AddLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm256_add_epi64(a, b); }
+static inline VM_Lanes_t VM_SubLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm256_sub_epi64(a, b); }
+
+static inline VM_Lanes_t VM_MulLanes(VM_Lanes_t a, VM_Lanes_t b) {
+	VM_Lanes_t low = _mm256_mul_epu32(a, b);
+	VM_Lanes_t cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+static inline VM_Lanes_t VM_ShiftRightLanes(VM_Lanes_t a, VM_Lanes_t b) {
+	return _mm256_srlv_epi64(a, _mm256_and_si256(b, _mm256_set1_epi64x(63)));
+}
+
+static inline VM_Lanes_t VM_ShiftLeftLanes(VM_Lanes_t a, VM_Lanes_t b) {
+	return _mm256_sllv_epi64(a, _mm256_and_si256(b, _mm256_set1_epi64x(63)));
+}
+
+// mask lanes are all ones or all zeroes
+static inline VM_Lanes_t VM_SelectLanes(VM_Lanes_t mask, VM_Lanes_t a, VM_Lanes_t b) {
+	return _mm256_blendv_epi8(b, a, mask);
+}
+
+#elif defined(VM_LOCKSTEP_SSE2)
+
+typedef __m128i VM_Lanes_t;
+#define VM_LANES_PER_VECTOR 2
+
+static inline VM_Lanes_t VM_LoadLanes(const uint64_t* lanes) { return _mm_load_si128((const __m128i*)lanes); }
+static inline void VM_StoreLanes(uint64_t* lanes, VM_Lanes_t value) { _mm_store_si128((__m128i*)lanes, value); }
+static inline VM_Lanes_t VM_BroadcastLanes(uint64_t value) { return _mm_set1_epi64x((long long)value); }
+static inline VM_Lanes_t VM_AndLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm_and_si128(a, b); }
+static inline VM_Lanes_t VM_AndNotLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm_andnot_si128(a, b); }
+static inline VM_Lanes_t VM_OrLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm_or_si128(a, b); }
+static inline VM_Lanes_t VM_XorLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm_xor_si128(a, b); }
+static inline VM_Lanes_t VM_AddLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm_add_epi64(a, b); }
+static inline VM_Lanes_t VM_SubLanes(VM_Lanes_t a, VM_Lanes_t b) { return _mm_sub_epi64(a, b); }
+
+static inline VM_Lanes_t VM_MulLanes(VM_Lanes_t a, VM_Lanes_t b) {
+	VM_Lanes_t low = _mm_mul_epu32(a, b);
+	VM_Lanes_t cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+	return _mm_add_epi64(low, _mm_slli_epi64(cross, 32));
+}
+
+// Both lanes are shifted by each count, the low result is taken from the first and the high from the second
+static inline VM_Lanes_t VM_MergeShifts(VM_Lanes_t low, VM_Lanes_t high) {
+	return _mm_castpd_si128(_mm_move_sd(_mm_castsi128_pd(high), _mm_castsi128_pd(low)));
+}
+
+static inline VM_Lanes_t VM_ShiftRightLanes(VM_Lanes_t a, VM_Lanes_t b) {
+	b = _mm_and_si128(b, _mm_set1_epi64x(63));
+	return VM_MergeShifts(_mm_srl_epi64(a, b), _mm_srl_epi64(a, _mm_unpackhi_epi64(b, b)));
+}
+
+static inline VM_Lanes_t VM_ShiftLeftLanes(VM_Lanes_t a, VM_Lanes_t b) {
+	b = _mm_and_si128(b, _mm_set1_epi64x(63));
+	return VM_MergeShifts(_mm_sll_epi64(a, b), _mm_sll_epi64(a, _mm_unpackhi_epi64(b, b)));
+}
+
+static inline VM_Lanes_t VM_SelectLanes(VM_Lanes_t mask, VM_Lanes_t a, VM_Lanes_t b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+#else
+
+typedef uint64_t VM_Lanes_t;
+#define VM_LANES_PER_VECTOR 1
+
+static inline VM_Lanes_t VM_LoadLanes(const uint64_t* lanes) { return *lanes; }
+static inline void VM_StoreLanes(uint64_t* lanes, VM_Lanes_t value) { *lanes = value; }
+static inline VM_Lanes_t VM_BroadcastLanes(uint64_t value) { return value; }
+static inline VM_Lanes_t VM_AndLanes(VM_Lanes_t a, VM_Lanes_t b) { return a & b; }
+static inline VM_Lanes_t VM_AndNotLanes(VM_Lanes_t a, VM_Lanes_t b) { return ~a & b; }
+static inline VM_Lanes_t VM_OrLanes(VM_Lanes_t a, VM_Lanes_t b) { return a | b; }
+static inline VM_Lanes_t VM_XorLanes(VM_Lanes_t a, VM_Lanes_t b) { return a ^ b; }
+static inline VM_Lanes_t VM_AddLanes(VM_Lanes_t a, VM_Lanes_t b) { return a + b; }
+static inline VM_Lanes_t VM_SubLanes(VM_Lanes_t a, VM_Lanes_t b) { return a - b; }
+static inline VM_Lanes_t VM_MulLanes(VM_Lanes_t a, VM_Lanes_t b) { return a * b; }
+static inline VM_Lanes_t VM_ShiftRightLanes(VM_Lanes_t a, VM_Lanes_t b) { return a >> (b & 63); }
+static inline VM_Lanes_t VM_ShiftLeftLanes(VM_Lanes_t a, VM_Lanes_t b) { return a << (b & 63); }
+static inline VM_Lanes_t VM_SelectLanes(VM_Lanes_t mask, VM_Lanes_t a, VM_Lanes_t b) { return (mask & a) | (~mask & b); }
+
+#endif
+
+_Static_assert(VM_LOCKSTEP_MAX_LANES % VM_LANES_PER_VECTOR == 0, "VM_LOCKSTEP_MAX_LANES must be a multiple of the vector width");
+
+// Registers up to IP are lanes, CD is kept per lane as conditions
+#define VM_LOCKSTEP_REGISTERS IL_CD_REG
+
+struct VM_LockstepState {
+	_Alignas(32) uint64_t regs[VM_LOCKSTEP_REGISTERS][VM_LOCKSTEP_MAX_LANES];
+	_Alignas(32) uint64_t compare_a[VM_LOCKSTEP_MAX_LANES];
+	_Alignas(32) uint64_t compare_b[VM_LOCKSTEP_MAX_LANES];
+	_Alignas(32) uint64_t pcs[VM_LOCKSTEP_MAX_LANES]; // Index of the next code
+	_Alignas(32) uint64_t steps[VM_LOCKSTEP_MAX_LANES]; // Added to the VMs once the group is done
+
+	// All ones for the lanes at the current code and the ones its predicate holds for
+	_Alignas(32) uint64_t step[VM_LOCKSTEP_MAX_LANES];
+	_Alignas(32) uint64_t exec[VM_LOCKSTEP_MAX_LANES];
+
+	enum IL_Conditions conditions[VM_LOCKSTEP_MAX_LANES];
+	uint32_t lazy; // Lanes with the compare bits still in compare_a/compare_b
+	uint32_t live; // Lanes that haven't halted
+
+	uint32_t count;
+	uint32_t width; // count rounded up to whole vectors
+
+	struct IL_VirtualMachine** vms;
+	const struct VM_Program* program;
+};
+
+typedef void (*VM_LockstepKernel_t)(struct VM_LockstepState* state, const struct VM_DecodedCode* code);
+
+static inline VM_Lanes_t VM_LaneOp_SET(VM_Lanes_t a, VM_Lanes_t b) { (void)a; return b; }
+static inline VM_Lanes_t VM_LaneOp_ADD(VM_Lanes_t a, VM_Lanes_t b) { return VM_AddLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_SUB(VM_Lanes_t a, VM_Lanes_t b) { return VM_SubLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_MUL(VM_Lanes_t a, VM_Lanes_t b) { return VM_MulLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_AND(VM_Lanes_t a, VM_Lanes_t b) { return VM_AndLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_OR(VM_Lanes_t a, VM_Lanes_t b) { return VM_OrLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_XOR(VM_Lanes_t a, VM_Lanes_t b) { return VM_XorLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_SHIFTR(VM_Lanes_t a, VM_Lanes_t b) { return VM_ShiftRightLanes(a, b); }
+static inline VM_Lanes_t VM_LaneOp_SHIFTL(VM_Lanes_t a, VM_Lanes_t b) { return VM_ShiftLeftLanes(a, b); }
+
+// Same widths as the specialized handlers, an immediate has no source register and a zero mask
+struct VM_LaneOperands {
+	const uint64_t* src;
+	VM_Lanes_t dst_mask;
+	VM_Lanes_t src_mask;
+	VM_Lanes_t value;
+};
+
+static inline void VM_PrepareOperands(struct VM_LockstepState* state, const struct VM_DecodedCode* code, uint8_t src_size, struct VM_LaneOperands* operands) {
+	const struct VM_DecodedOperand* op0 = &code->ops[0];
+	const struct VM_DecodedOperand* op1 = &code->ops[1];
+
+	operands->dst_mask = VM_BroadcastLanes(VM_WIDTH_MASK(op0->size * 8));
+	if (op1->type == IL_OPERAND_TYPE_IMMEDIATE) {
+		operands->src = state->regs[0];
+		operands->src_mask = VM_BroadcastLanes(0);
+		operands->value = VM_BroadcastLanes(op1->value);
+	}
+	else {
+		operands->src = state->regs[op1->reg];
+		operands->src_mask = VM_BroadcastLanes(VM_WIDTH_MASK(src_size * 8));
+		operands->value = VM_BroadcastLanes(0);
+	}
+}
+
+#define VM_DEFINE_LOCKSTEP_ALU(Y, name, expr) \
+	static void VM_Lockstep_##name(struct VM_LockstepState* state, const struct VM_DecodedCode* code) { \
+		uint8_t src_size = VM_MIN_BITS(code->ops[0].size, code->ops[1].size); \
+		struct VM_LaneOperands operands; \
+		VM_PrepareOperands(state, code, src_size, &operands); \
+		uint64_t* dst = state->regs[code->ops[0].reg]; \
+		for (uint32_t i = 0; i < state->width; i += VM_LANES_PER_VECTOR) { \
+			VM_Lanes_t old = VM_LoadLanes(dst + i); \
+			VM_Lanes_t a = VM_AndLanes(old, operands.dst_mask); \
+			VM_Lanes_t b = VM_OrLanes(VM_AndLanes(VM_LoadLanes(operands.src + i), operands.src_mask), operands.value); \
+			VM_Lanes_t value = VM_OrLanes(VM_AndNotLanes(operands.dst_mask, old), VM_AndLanes(VM_LaneOp_##name(a, b), operands.dst_mask)); \
+			VM_StoreLanes(dst + i, VM_SelectLanes(VM_LoadLanes(state->exec + i), value, old)); \
+		} \
+	}
+
+VM_ALU_OPERATIONS(VM_DEFINE_LOCKSTEP_ALU, _)
+
+#undef VM_DEFINE_LOCKSTEP_ALU
+
+// Only records the operands, like VM_SetCompare
+static void VM_Lockstep_CMP(struct VM_LockstepState* state, const struct VM_DecodedCode* code) {
+	struct VM_LaneOperands operands;
+	VM_PrepareOperands(state, code, code->ops[1].size, &operands);
+
+	const uint64_t* dst = state->regs[code->ops[0].reg];
+	for (uint32_t i = 0; i < state->width; i += VM_LANES_PER_VECTOR) {
+		VM_Lanes_t exec = VM_LoadLanes(state->exec + i);
+		VM_Lanes_t a = VM_AndLanes(VM_LoadLanes(dst + i), operands.dst_mask);
+		VM_Lanes_t b = VM_OrLanes(VM_AndLanes(VM_LoadLanes(operands.src + i), operands.src_mask), operands.value);
+		VM_StoreLanes(state->compare_a + i, VM_SelectLanes(exec, a, VM_LoadLanes(state->compare_a + i)));
+		VM_StoreLanes(state->compare_b + i, VM_SelectLanes(exec, b, VM_LoadLanes(state->compare_b + i)));
+	}
+}
+
+#define VM_LOCKSTEP_KERNEL(Y, name, expr) [IL_MNEMONIC_##name] = VM_Lockstep_##name,
+
+static const VM_LockstepKernel_t VM_LOCKSTEP_KERNELS[IL_MNEMONIC_COUNT] = {
+	VM_ALU_OPERATIONS(VM_LOCKSTEP_KERNEL, _)
+	[IL_MNEMONIC_CMP] = VM_Lockstep_CMP,
+};
+
+#undef VM_LOCKSTEP_KERNEL
+
+// Codes that got a specialized handler only touch registers below CD, anything writing IP is left to the handlers
+static bool VM_HasLockstepKernel(const struct VM_DecodedCode* code) {
+	return code->mnemonic < IL_MNEMONIC_COUNT && VM_LOCKSTEP_KERNELS[code->mnemonic] != NULL &&
+		code->handler != code->mnemonic && code->length == 1 && !(code->flags & VM_CODE_FLAG_REDIRECT);
+}
+
+static void VM_LoadLane(struct VM_LockstepState* state, uint32_t lane) {
+	const struct IL_VirtualMachine* vm = state->vms[lane];
+	for (uint32_t i = 0; i < VM_LOCKSTEP_REGISTERS; ++i) {
+		state->regs[i][lane] = vm->regs[i];
+	}
+
+	state->conditions[lane] = vm->conditions;
+	state->compare_a[lane] = vm->compare_a;
+	state->compare_b[lane] = vm->compare_b;
+
+	uint32_t bit = 1u << lane;
+	state->lazy = vm->lazy_conditions ? state->lazy | bit : state->lazy & ~bit;
+	state->live = vm->conditions & IL_CONDITIONS_HLT ? state->live & ~bit : state->live | bit;
+}
+
+static void VM_StoreLane(struct VM_LockstepState* state, uint32_t lane) {
+	struct IL_VirtualMachine* vm = state->vms[lane];
+	for (uint32_t i = 0; i < VM_LOCKSTEP_REGISTERS; ++i) {
+		vm->regs[i] = state->regs[i][lane];
+	}
+
+	vm->conditions = state->conditions[lane];
+	vm->compare_a = state->compare_a[lane];
+	vm->compare_b = state->compare_b[lane];
+	vm->lazy_conditions = (state->lazy >> lane) & 1;
+}
+
+static bool VM_LaneHolds(struct VM_LockstepState* state, uint32_t lane, enum IL_Conditions predicate) {
+	if ((state->lazy >> lane) & 1) {
+		enum IL_Conditions compare = VM_CompareConditions(state->compare_a[lane], state->compare_b[lane]);
+		state->conditions[lane] = (state->conditions[lane] & ~VM_COMPARE_CONDITIONS) | compare;
+		state->lazy &= ~(1u << lane);
+	}
+
+	return (state->conditions[lane] & predicate) == predicate;
+}
+
+// VM_GetNextCode for one lane, without the budget
+static void VM_AdvanceLane(struct VM_LockstepState* state, uint32_t lane, const struct VM_DecodedCode* code) {
+	const struct VM_Program* program = state->program;
+	uint64_t* ip = &state->regs[IL_IP_REG][lane];
+
+	if (state->conditions[lane] & IL_CONDITIONS_NI) {
+		*ip += code->size;
+		if (!(code->flags & VM_CODE_FLAG_REDIRECT)) {
+			state->pcs[lane] += code->length;
+			return;
+		}
+	}
+	else {
+		state->conditions[lane] |= IL_CONDITIONS_NI;
+		if (code->flags & VM_CODE_FLAG_DIRECT) {
+			state->pcs[lane] = code->target;
+			return;
+		}
+	}
+
+	state->pcs[lane] = VM_LookupCode(program, *ip) - program->codes;
+}
+
+// Kernels never write IP or clear NI, every lane at the code moves to the next one
+static void VM_AdvanceLanes(struct VM_LockstepState* state, const struct VM_DecodedCode* code) {
+	VM_Lanes_t size = VM_BroadcastLanes(code->size);
+	VM_Lanes_t length = VM_BroadcastLanes(code->length);
+	VM_Lanes_t one = VM_BroadcastLanes(1);
+
+	for (uint32_t i = 0; i < state->width; i += VM_LANES_PER_VECTOR) {
+		VM_Lanes_t step = VM_LoadLanes(state->step + i);
+		uint64_t* ip = state->regs[IL_IP_REG] + i;
+		VM_StoreLanes(ip, VM_AddLanes(VM_LoadLanes(ip), VM_AndLanes(size, step)));
+		VM_StoreLanes(state->pcs + i, VM_AddLanes(VM_LoadLanes(state->pcs + i), VM_AndLanes(length, step)));
+		VM_StoreLanes(state->steps + i, VM_AddLanes(VM_LoadLanes(state->steps + i), VM_AndLanes(one, step)));
+	}
+}
+
+struct VM_LaneCode {
+	struct IL_VirtualMachine* vm;
+	const struct VM_DecodedCode* code;
+};
+
+static void VM_RunLaneCode(void* context) {
+	struct VM_LaneCode* lane = context;
+	VM_HANDLERS[lane->code->handler](lane->vm, lane->code);
+}
+
+// Runs the handler on the lane's own VM, a fault leaves the lane on the faulting code like VM_Execute does
+static void VM_StepLane(struct VM_LockstepState* state, uint32_t lane, const struct VM_DecodedCode* code) {
+	struct VM_LaneCode context = { state->vms[lane], code };
+	struct IL_VirtualMachine* vm = context.vm;
+
+	VM_StoreLane(state, lane);
+
+	uint64_t address = 0;
+	if (!VM_RunGuarded(vm->memory, VM_RunLaneCode, &context, &address)) {
+		VM_RaiseFault(vm, VM_IsStackGuard(vm->memory, address) ? VM_FAULT_STACK_OVERFLOW : VM_FAULT_MEMORY, address);
+		VM_LoadLane(state, lane);
+		return;
+	}
+
+	VM_LoadLane(state, lane);
+	VM_AdvanceLane(state, lane, code);
+	state->steps[lane] += 1;
+
+	if (state->conditions[lane] & IL_CONDITIONS_HLT) {
+		state->live &= ~(1u << lane);
+	}
+}
+
+// Lanes furthest behind run first, lanes that branched ahead wait for them to catch up
+static const struct VM_DecodedCode* VM_SelectNextCode(struct VM_LockstepState* state, uint32_t* lanes) {
+	uint64_t pc = UINT64_MAX;
+	*lanes = 0;
+
+	for (uint32_t i = 0; i < state->count; ++i) {
+		if (!((state->live >> i) & 1) || state->pcs[i] > pc) {
+			continue;
+		}
+
+		*lanes = state->pcs[i] < pc ? 0 : *lanes;
+		*lanes |= 1u << i;
+		pc = state->pcs[i];
+	}
+
+	return &state->program->codes[pc];
+}
+
+static uint32_t VM_CountLanes(uint32_t lanes) {
+	uint32_t count = 0;
+	for (; lanes != 0; lanes &= lanes - 1) {
+		++count;
+	}
+
+	return count;
+}
+
+static void VM_Step(struct VM_LockstepState* state, const struct VM_DecodedCode* code, uint32_t lanes, struct VM_LockstepStats* stats) {
+	uint32_t exec = lanes;
+	if (code->conditions != IL_CONDITIONS_NONE) {
+		for (uint32_t i = 0; i < state->count; ++i) {
+			if (((lanes >> i) & 1) && !VM_LaneHolds(state, i, code->conditions)) {
+				exec &= ~(1u << i);
+			}
+		}
+	}
+
+	if (VM_HasLockstepKernel(code)) {
+		for (uint32_t i = 0; i < state->width; ++i) {
+			state->step[i] = (lanes >> i) & 1 ? UINT64_MAX : 0;
+			state->exec[i] = (exec >> i) & 1 ? UINT64_MAX : 0;
+		}
+
+		VM_LOCKSTEP_KERNELS[code->mnemonic](state, code);
+		if (code->mnemonic == IL_MNEMONIC_CMP) {
+			state->lazy |= exec;
+		}
+
+		VM_AdvanceLanes(state, code);
+		stats->vector_steps += 1;
+		return;
+	}
+
+	// Relative jumps are done here, the rest need the lane's registers in its VM
+	bool branch = code->mnemonic == IL_MNEMONIC_BRANCH && (code->flags & VM_CODE_FLAG_DIRECT);
+
+	for (uint32_t i = 0; i < state->count; ++i) {
+		if (!((lanes >> i) & 1)) {
+			continue;
+		}
+
+		if (((exec >> i) & 1) && !branch) {
+			VM_StepLane(state, i, code);
+			continue;
+		}
+
+		if ((exec >> i) & 1) {
+			state->regs[IL_IP_REG][i] += code->ops[0].value;
+			state->conditions[i] &= ~IL_CONDITIONS_NI;
+		}
+
+		VM_AdvanceLane(state, i, code);
+		state->steps[i] += 1;
+	}
+}
+
+void VM_RunLockstep(struct IL_VirtualMachine** vms, uint32_t count, const struct VM_Program* program, struct VM_LockstepStats* stats) {
+	struct VM_LockstepState state;
+	memset(&state, 0, sizeof(state));
+	stats->groups += 1;
+
+	state.vms = vms;
+	state.program = program;
+	state.count = count < VM_LOCKSTEP_MAX_LANES ? count : VM_LOCKSTEP_MAX_LANES;
+	state.width = (state.count + VM_LANES_PER_VECTOR - 1) / VM_LANES_PER_VECTOR * VM_LANES_PER_VECTOR;
+
+	for (uint32_t i = 0; i < state.count; ++i) {
+		VM_LoadLane(&state, i);
+		state.pcs[i] = VM_LookupCode(program, vms[i]->ip) - program->codes;
+	}
+
+	bool diverged = false;
+	uint64_t window_steps = 0;
+	uint64_t window_lanes = 0;
+	uint64_t window_live = 0;
+
+	while (state.live != 0) {
+		uint32_t lanes = 0;
+		const struct VM_DecodedCode* code = VM_SelectNextCode(&state, &lanes);
+
+		uint32_t ran = VM_CountLanes(lanes);
+		window_lanes += ran;
+		window_live += VM_CountLanes(state.live);
+		stats->lane_steps += ran;
+		stats->steps += 1;
+
+		VM_Step(&state, code, lanes, stats);
+
+		if (++window_steps < VM_LOCKSTEP_WINDOW) {
+			continue;
+		}
+
+		// Each step serves too few lanes to pay for the lockstep
+		if (window_lanes * 100 < window_live * VM_LOCKSTEP_MIN_OCCUPANCY) {
+			diverged = true;
+			break;
+		}
+
+		window_steps = 0;
+		window_lanes = 0;
+		window_live = 0;
+	}
+
+	for (uint32_t i = 0; i < state.count; ++i) {
+		VM_StoreLane(&state, i);
+		VM_MaterializeConditions(vms[i]);
+		vms[i]->steps += state.steps[i];
+	}
+
+	if (diverged) {
+		stats->diverged += 1;
+	}
+
+	for (uint32_t i = 0; diverged && i < state.count; ++i) {
+		if (!(vms[i]->conditions & IL_CONDITIONS_HLT)) {
+			VM_Execute(vms[i], program, VM_ENGINE_THREADED);
+		}
+	}
+}
+
+void VM_PrintLockstepStats(const struct VM_LockstepStats* stats, uint32_t lanes) {
+	printf("============= LOCKSTEP STATS ============\n");
+	printf("Lanes: %u, %u per vector\n", lanes, VM_LANES_PER_VECTOR);
+	printf("Steps: %llu, %llu vector\n", (unsigned long long)stats->steps, (unsigned long long)stats->vector_steps);
+	printf("Occupancy: %.1f%%\n", stats->steps > 0 ? stats->lane_steps * 100.0 / ((double)stats->steps * lanes) : 0);
+	printf("Groups: %llu, %llu diverged\n", (unsigned long long)stats->groups, (unsigned long long)stats->diverged);
+	printf("=======================================\n");
+}
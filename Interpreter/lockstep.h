@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vm.h"
+#include "decoder.h"
+
+// Lanes are kept as 64 bit elements, 4 per AVX2 vector, 2 per SSE2 vector and 1 without either.
+// AVX2 is picked at compile time, build with -mavx2 or /arch:AVX2 to get it.
+#if defined(__AVX2__)
+#define VM_LOCKSTEP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#define VM_LOCKSTEP_SSE2
+#endif
+
+#define VM_LOCKSTEP_MAX_LANES 8
+
+// Codes between divergence checks
+#define VM_LOCKSTEP_WINDOW 1024
+
+// Lanes run alone once fewer than this percent of the live lanes share each code
+#ifndef VM_LOCKSTEP_MIN_OCCUPANCY
+#define VM_LOCKSTEP_MIN_OCCUPANCY 50
+#endif
+
+// Runs up to VM_LOCKSTEP_MAX_LANES VMs of one program together. Registers are kept in
+// structure of arrays form, every step runs the code of the lanes furthest behind, under a lane
+// mask that also holds the predicate. Register ALU codes and CMP run as vector kernels, the
+// rest go through the handlers one lane at a time. Lanes that took different sides of a branch
+// meet again at the first code both sides reach, if they don't the lanes finish on their own.
+struct VM_LockstepStats {
+	uint64_t groups;
+	uint64_t diverged; // Groups whose lanes finished one by one
+	uint64_t steps; // Codes dispatched for a whole group
+	uint64_t vector_steps;
+	uint64_t lane_steps; // Sum of the lanes each step ran for
+};
+
+// Every VM must be initialized with its own memory, they run until they halt or fault without using fuel.
+// stats are added to, zero them before the first group.
+void VM_RunLockstep(struct IL_VirtualMachine** vms, uint32_t count, const struct VM_Program* program, struct VM_LockstepStats* stats);
+void VM_PrintLockstepStats(const struct VM_LockstepStats* stats, uint32_t lanes);
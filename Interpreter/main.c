@@ -1,58 +1,704 @@
 	#include <stdint.h>
-#include <Windows.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "vm.h"
 #include "il.h"
+#include "decoder.h"
+#include "verifier.h"
+#include "loader.h"
+#include "memory.h"
+#include "bench.h"
+#include "fusion.h"
+#include "jit.h"
+#include "pool.h"
+#include "lockstep.h"
+#include "snapshot.h"
+#include "host.h"
+#include "counters.h"
+#include "profiler.h"
+#include "debuginfo.h"
+#include "platform.h"
 
-uint8_t* LoadFile(const char* path) {
-	FILE* file = fopen(path, "rb");
-	if (!file) {
-		return NULL;
-	}	
+void PrintImage(const struct IL_Image* image) {
+	printf("Version: %u\n", image->version);
+	printf("Code: %zu bytes\n", image->code_size);
+	printf("Rodata: %zu bytes\n", image->rodata_size);
+	printf("Metadata:\n%.*s", (int)image->metadata_size, image->metadata != NULL ? (const char*)image->metadata : "");
 
-	fseek(file, 0, SEEK_END);	
-	size_t size = ftell(file);
-	fseek(file, 0, SEEK_SET);
+	size_t count = IL_GetImageSymbolCount(image);
+	printf("Symbols: %zu\n", count);
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t offset = 0;
+		const char* name = IL_GetImageSymbol(image, i, &offset);
+		printf("  %08llx %s\n", (unsigned long long)offset, name);
+	}
+
+	printf("Lines: %zu\n", IL_GetImageLineCount(image));
+}
+
+void PrintUsage(const char* name) {
+	printf("Usage: %s [options] <input file>\n", name);
+	printf("  --engine <table|threaded|jit>  Dispatch engine, jit compiles blocks to x86-64\n");
+	printf("  --bench <iterations>       Compare the engines instead of running once\n");
+	printf("  --trace                    Print every executed instruction (table engine, unfused)\n");
+	printf("  --counters                 Print per-opcode counts and handler cycles (table engine, unfused)\n");
+	printf("  --counters-json <file>     Write the per-opcode counters to file as JSON\n");
+	printf("  --profile <file>           Sample the guest call stack, write folded stacks to file\n");
+	printf("  --profile-period <insns>   Instructions between samples\n");
+	printf("  --jit-threshold <entries>  Entries into a loop or function before it's compiled\n");
+	printf("  --check                    Run the table engine too and compare the final state\n");
+	printf("  --no-fusion                Don't fuse instruction pairs into superinstructions\n");
+	printf("  --fusion-stats             Print the fused and most frequent adjacent pairs of the image\n");
+	printf("  --info                     Print the image sections and symbols instead of running\n");
+	printf("  --memory <bytes>           Committed guest memory from address 0\n");
+	printf("  --stack <bytes>            Maximum guest stack size, committed as it grows\n");
+	printf("  --instances <count>        Run count VMs on a worker pool, R0 is the instance index\n");
+	printf("  --workers <count>          Pool threads, one per core by default\n");
+	printf("  --budget <insns>           Fuel a pooled VM gets per slice before yielding\n");
+	printf("  --fuel <insns>             Instructions the VM may run, it stops once they're used up\n");
+	printf("  --lockstep <lanes>         Run the instances in groups of lanes on this thread instead\n");
+	printf("  --fork <count>             Snapshot the VM, then finish the run again in count forks and a restore\n");
+	printf("  --snapshot-at <insns>      Instructions run before the snapshot is taken\n");
+}
+
+bool ParseEngine(const char* name, enum VM_Engine* engine) {
+	if (strcmp(name, "table") == 0) {
+		*engine = VM_ENGINE_TABLE;
+	}
+	else if (strcmp(name, "threaded") == 0) {
+		*engine = VM_ENGINE_THREADED;
+	}
+	else if (strcmp(name, "jit") == 0) {
+		*engine = VM_ENGINE_JIT;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+int RunBenchmark(const struct VM_Program* program, uint64_t iterations, size_t memory_size, size_t stack_size) {
+	const struct VM_HostTable* host = &VM_BUILTIN_HOST_TABLE;
+
+	struct VM_BenchResult table;
+	VM_Benchmark(program, VM_ENGINE_TABLE, host, iterations, memory_size, stack_size, &table);
+
+	struct VM_BenchResult threaded;
+	VM_Benchmark(program, VM_ENGINE_THREADED, host, iterations, memory_size, stack_size, &threaded);
+
+	printf("%llu iterations\n", (unsigned long long)iterations);
+	VM_PrintBenchmark("table", &table, NULL);
+	VM_PrintBenchmark("threaded", &threaded, &table);
+
+	if (program->jit != NULL) {
+		struct VM_BenchResult jit;
+		VM_Benchmark(program, VM_ENGINE_JIT, host, iterations, memory_size, stack_size, &jit);
+		VM_PrintBenchmark("jit", &jit, &table);
+	}
+
+	// Same run with the yields completing inline, what's left over is leaving and reentering the engine
+	if (table.suspends > 0) {
+		struct VM_BenchResult inline_calls;
+		VM_Benchmark(program, VM_ENGINE_TABLE, &VM_BUILTIN_INLINE_HOST_TABLE, iterations, memory_size, stack_size, &inline_calls);
+		VM_PrintBenchmark("inline", &inline_calls, &table);
+
+		double cost = (table.seconds - inline_calls.seconds) * 1e9 / (double)table.suspends;
+		printf("Suspend and resume: %llu pending host calls, %.1f ns each\n", (unsigned long long)table.suspends, cost);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Guest addresses don't depend on where the memory was reserved, every register can be compared
+bool IsSameState(const struct IL_VirtualMachine* a, const struct IL_VirtualMachine* b) {
+	bool same = a->steps == b->steps && a->ip == b->ip && a->conditions == b->conditions;
+	same = same && a->fault == b->fault && a->fault_address == b->fault_address;
+	for (uint8_t i = 0; i < IL_IP_REG; ++i) {
+		same = same && a->regs[i] == b->regs[i];
+	}
+
+	same = same && memcmp(a->vregs, b->vregs, sizeof(a->vregs)) == 0;
+
+	return same;
+}
+
+bool CheckRun(const struct VM_Program* program, const struct IL_VirtualMachine* vm, uint64_t r0, size_t memory_size, size_t stack_size) {
+	struct VM_Memory memory;
+	if (!VM_CreateMemory(&memory, memory_size, stack_size)) {
+		return false;
+	}
+
+	struct IL_VirtualMachine reference;
+	VM_Init(&reference);
+	VM_RegisterHostTable(&reference, &VM_BUILTIN_HOST_TABLE);
+
+	reference.r0 = r0;
+	reference.memory = &memory;
+	reference.ip = (uint64_t)program->base;
+	reference.sp = memory.stack_top;
+	VM_ExecuteWaiting(&reference, program, VM_ENGINE_TABLE);
+
+	bool same = IsSameState(&reference, vm);
+	if (!same) {
+		printf("Check failed, table engine state:\n");
+		VM_PrintContext(&reference);
+	}
+
+	VM_FreeMemory(&memory);
+	return same;
+}
+
+int RunPool(const struct VM_Program* program, enum VM_Engine engine, const struct VM_PoolConfig* base, size_t instances, bool check, size_t memory_size, size_t stack_size) {
+	struct VM_Task* tasks = calloc(instances, sizeof(struct VM_Task));
+	if (tasks == NULL) {
+		printf("Failed to allocate %zu instances\n", instances);
+		return EXIT_FAILURE;
+	}
+
+	size_t created = 0;
+	for (; created < instances; ++created) {
+		if (!VM_InitTask(&tasks[created], program, memory_size, stack_size)) {
+			break;
+		}
+
+		VM_RegisterHostTable(&tasks[created].vm, &VM_BUILTIN_HOST_TABLE);
+		tasks[created].vm.regs[0] = created;
+	}
+
+	int status = EXIT_FAILURE;
+	struct VM_PoolConfig config = *base;
+	config.engine = engine;
+
+	struct VM_Pool* pool = NULL;
+	if (created < instances) {
+		printf("Failed to reserve the guest memory of instance %zu\n", created);
+	}
+	else if ((pool = VM_CreatePool(program, &config)) == NULL) {
+		printf("Failed to start the pool\n");
+	}
+	else {
+		double start = VM_GetTime();
+		for (size_t i = 0; i < instances; ++i) {
+			VM_SubmitTask(pool, &tasks[i]);
+		}
+
+		VM_WaitPool(pool);
+		double seconds = VM_GetTime() - start;
+
+		size_t faulted = 0;
+		uint64_t slices = 0;
+		for (size_t i = 0; i < instances; ++i) {
+			faulted += tasks[i].vm.fault != VM_FAULT_NONE;
+			slices += tasks[i].slices;
+		}
+
+		printf("Instances: %zu, %zu halted, %zu faulted, %llu slices\n", instances, instances - faulted, faulted, (unsigned long long)slices);
+		VM_PrintPoolStats(pool, seconds);
+		VM_FreePool(pool);
+		status = faulted == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+		for (size_t i = 0; check && i < instances; ++i) {
+			if (!CheckRun(program, &tasks[i].vm, i, memory_size, stack_size)) {
+				printf("Instance %zu differs\n", i);
+				status = EXIT_FAILURE;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < created; ++i) {
+		VM_FreeTask(&tasks[i]);
+	}
+
+	free(tasks);
+	return status;
+}
+
+// Every copy of the snapshot has to end like the run it was taken from, and that run like one never snapshotted
+int RunFork(const struct VM_Program* program, enum VM_Engine engine, size_t forks, uint64_t snapshot_at, size_t memory_size, size_t stack_size) {
+	struct VM_Memory memory;
+	if (!VM_CreateMemory(&memory, memory_size, stack_size)) {
+		printf("Failed to reserve the guest memory\n");
+		return EXIT_FAILURE;
+	}
+
+	struct IL_VirtualMachine vm;
+	VM_Init(&vm);
+	VM_RegisterHostTable(&vm, &VM_BUILTIN_HOST_TABLE);
+
+	vm.memory = &memory;
+	vm.ip = (uint64_t)program->base;
+	vm.sp = memory.stack_top;
+	VM_SetFuel(&vm, snapshot_at);
+	VM_ExecuteWaiting(&vm, program, engine);
+
+	// Copies run to the end
+	VM_SetFuel(&vm, VM_FUEL_UNLIMITED);
+
+	struct VM_Snapshot snapshot;
+	double start = VM_GetTime();
+	if (!VM_CaptureSnapshot(&snapshot, &vm)) {
+		printf("Failed to capture the snapshot\n");
+		VM_FreeMemory(&memory);
+		return EXIT_FAILURE;
+	}
+
+	double capture = VM_GetTime() - start;
+	printf("Snapshot at %llu insns, captured in %.1f us\n", (unsigned long long)vm.steps, capture * 1e6);
+
+	VM_Resume(&vm);
+	VM_ExecuteWaiting(&vm, program, engine);
+	struct IL_VirtualMachine reference = vm;
+	bool straight = CheckRun(program, &reference, 0, memory_size, stack_size);
+
+	double fork_time = 0;
+	size_t matched = 0;
+	size_t forked = 0;
+	for (; forked < forks; ++forked) {
+		struct IL_VirtualMachine clone;
+		struct VM_Memory clone_memory;
+
+		start = VM_GetTime();
+		if (!VM_ForkSnapshot(&snapshot, &clone, &clone_memory)) {
+			printf("Failed to fork the snapshot\n");
+			break;
+		}
+
+		fork_time += VM_GetTime() - start;
+
+		VM_Resume(&clone);
+		VM_ExecuteWaiting(&clone, program, engine);
+		matched += IsSameState(&reference, &clone);
+		VM_FreeMemory(&clone_memory);
+	}
+
+	start = VM_GetTime();
+	bool restored = VM_RestoreSnapshot(&snapshot, &vm);
+	double restore = VM_GetTime() - start;
+
+	// The restored pages are mapped but not read yet, a snapshot of them has to keep them all
+	struct VM_Snapshot recapture;
+	bool recaptured = restored && VM_CaptureSnapshot(&recapture, &vm);
+
+	if (restored) {
+		VM_Resume(&vm);
+		VM_ExecuteWaiting(&vm, program, engine);
+		restored = IsSameState(&reference, &vm);
+	}
+
+	if (recaptured) {
+		struct IL_VirtualMachine clone;
+		struct VM_Memory clone_memory;
+
+		recaptured = VM_ForkSnapshot(&recapture, &clone, &clone_memory);
+		if (recaptured) {
+			VM_Resume(&clone);
+			VM_ExecuteWaiting(&clone, program, engine);
+			recaptured = IsSameState(&reference, &clone);
+			VM_FreeMemory(&clone_memory);
+		}
 
-	uint8_t* buffer = (uint8_t*)malloc(size);
-	if (!buffer) {
-		fclose(file);
-		return NULL;
+		VM_FreeSnapshot(&recapture);
 	}
 
-	fread(buffer, 1, size, file);
-	fclose(file);
+	printf("Forks: %zu, %.1f us each, %zu matched\n", forked, forked > 0 ? fork_time * 1e6 / forked : 0, matched);
+	printf("Restore: %.1f us, %s\n", restore * 1e6, restored ? "matched" : "failed");
+	printf("Recapture: %s\n", recaptured ? "matched" : "failed");
+	printf("Straight run: %s\n", straight ? "matched" : "differs");
+	VM_PrintContext(&vm);
+
+	VM_FreeSnapshot(&snapshot);
+	VM_FreeMemory(&memory);
+	return forked == forks && matched == forks && restored && recaptured && straight ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int RunLockstep(const struct VM_Program* program, size_t instances, uint32_t lanes, bool check, size_t memory_size, size_t stack_size) {
+	struct VM_Task* tasks = calloc(instances, sizeof(struct VM_Task));
+	if (tasks == NULL) {
+		printf("Failed to allocate %zu instances\n", instances);
+		return EXIT_FAILURE;
+	}
+
+	size_t created = 0;
+	for (; created < instances; ++created) {
+		if (!VM_InitTask(&tasks[created], program, memory_size, stack_size)) {
+			break;
+		}
+
+		VM_RegisterHostTable(&tasks[created].vm, &VM_BUILTIN_HOST_TABLE);
+		tasks[created].vm.regs[0] = created;
+
+		// Lanes aren't metered, nor is the engine finishing a diverged group
+		VM_SetFuel(&tasks[created].vm, VM_FUEL_UNLIMITED);
+	}
+
+	int status = EXIT_FAILURE;
+	if (created < instances) {
+		printf("Failed to reserve the guest memory of instance %zu\n", created);
+	}
+	else {
+		struct VM_LockstepStats stats = { 0 };
+		double start = VM_GetTime();
+
+		for (size_t i = 0; i < instances; i += lanes) {
+			struct IL_VirtualMachine* vms[VM_LOCKSTEP_MAX_LANES];
+			uint32_t count = 0;
+			for (; count < lanes && i + count < instances; ++count) {
+				vms[count] = &tasks[i + count].vm;
+			}
+
+			VM_RunLockstep(vms, count, program, &stats);
+		}
+
+		// Lanes stopped on a pending host call finish on their own
+		for (size_t i = 0; i < instances; ++i) {
+			if (tasks[i].vm.suspend == VM_SUSPEND_HOST_CALL) {
+				VM_ExecuteWaiting(&tasks[i].vm, program, VM_ENGINE_THREADED);
+			}
+		}
+
+		double seconds = VM_GetTime() - start;
+
+		size_t faulted = 0;
+		uint64_t steps = 0;
+		for (size_t i = 0; i < instances; ++i) {
+			faulted += tasks[i].vm.fault != VM_FAULT_NONE;
+			steps += tasks[i].vm.steps;
+		}
+
+		printf("Instances: %zu, %zu halted, %zu faulted\n", instances, instances - faulted, faulted);
+		printf("Total: %llu insns in %.3f ms, %.0f insns/s\n", (unsigned long long)steps, seconds * 1e3, seconds > 0 ? (double)steps / seconds : 0);
+		VM_PrintLockstepStats(&stats, lanes);
+		status = faulted == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+		for (size_t i = 0; check && i < instances; ++i) {
+			if (!CheckRun(program, &tasks[i].vm, i, memory_size, stack_size)) {
+				printf("Instance %zu differs\n", i);
+				status = EXIT_FAILURE;
+				break;
+			}
+		}
+	}
 
-	return buffer;
+	for (size_t i = 0; i < created; ++i) {
+		VM_FreeTask(&tasks[i]);
+	}
+
+	free(tasks);
+	return status;
+}
+
+bool RunProfiled(struct IL_VirtualMachine* vm, const struct VM_Program* program, enum VM_Engine engine, const char* path, uint64_t period) {
+	FILE* out = fopen(path, "w");
+	if (out == NULL) {
+		printf("Failed to open %s\n", path);
+		return false;
+	}
+
+	struct VM_Profiler profiler;
+	if (!VM_InitProfiler(&profiler, program, period)) {
+		printf("Failed to allocate the profiler\n");
+		VM_FreeProfiler(&profiler);
+		fclose(out);
+		return false;
+	}
+
+	VM_ExecuteProfiled(&profiler, vm, engine);
+	VM_PrintProfile(&profiler);
+	VM_WriteFoldedStacks(&profiler, out);
+
+	VM_FreeProfiler(&profiler);
+	fclose(out);
+	return true;
 }
 
 int main(int argc, char* argv[]) {
-	if (argc != 2) {
-		printf("Usage: %s <input file>\n", argv[0]);
+	enum VM_Engine engine = VM_DEFAULT_ENGINE;
+	uint64_t bench_iterations = 0;
+	bool trace = false;
+	bool counters = false;
+	const char* counters_json = NULL;
+	const char* profile = NULL;
+	uint64_t profile_period = VM_PROFILE_DEFAULT_PERIOD;
+	bool check = false;
+	uint32_t jit_threshold = VM_JIT_DEFAULT_THRESHOLD;
+	bool fusion = true;
+	bool fusion_stats = false;
+	bool info = false;
+	size_t memory_size = VM_DEFAULT_MEMORY_SIZE;
+	size_t stack_size = VM_DEFAULT_STACK_SIZE;
+	size_t instances = 0;
+	struct VM_PoolConfig pool = { 0 };
+	uint32_t lockstep = 0;
+	size_t forks = 0;
+	uint64_t fuel = VM_FUEL_UNLIMITED;
+	uint64_t snapshot_at = 0;
+	const char* path = NULL;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+			if (!ParseEngine(argv[++i], &engine)) {
+				PrintUsage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--trace") == 0) {
+			trace = true;
+		}
+		else if (strcmp(argv[i], "--counters") == 0) {
+			counters = true;
+		}
+		else if (strcmp(argv[i], "--counters-json") == 0 && i + 1 < argc) {
+			counters = true;
+			counters_json = argv[++i];
+		}
+		else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--profile-period") == 0 && i + 1 < argc) {
+			profile_period = strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--jit-threshold") == 0 && i + 1 < argc) {
+			jit_threshold = (uint32_t)strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--check") == 0) {
+			check = true;
+		}
+		else if (strcmp(argv[i], "--no-fusion") == 0) {
+			fusion = false;
+		}
+		else if (strcmp(argv[i], "--fusion-stats") == 0) {
+			fusion_stats = true;
+		}
+		else if (strcmp(argv[i], "--info") == 0) {
+			info = true;
+		}
+		else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+			memory_size = (size_t)strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--stack") == 0 && i + 1 < argc) {
+			stack_size = (size_t)strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			instances = (size_t)strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			pool.workers = (uint32_t)strtoul(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+			pool.budget = strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc) {
+			lockstep = (uint32_t)strtoul(argv[++i], NULL, 0);
+			if (lockstep == 0 || lockstep > VM_LOCKSTEP_MAX_LANES) {
+				printf("Lockstep groups have 1 to %u lanes\n", VM_LOCKSTEP_MAX_LANES);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--fuel") == 0 && i + 1 < argc) {
+			fuel = strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--fork") == 0 && i + 1 < argc) {
+			forks = (size_t)strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--snapshot-at") == 0 && i + 1 < argc) {
+			snapshot_at = strtoull(argv[++i], NULL, 0);
+		}
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			bench_iterations = strtoull(argv[++i], NULL, 0);
+		}
+		else if (path == NULL && argv[i][0] != '-') {
+			path = argv[i];
+		}
+		else {
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (path == NULL) {
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const char* map_error = NULL;
+	struct VM_MappedImage mapped;
+	if (!VM_MapImage(path, &mapped, &map_error)) {
+		printf("Failed to load %s: %s\n", path, map_error);
+		return EXIT_FAILURE;
+	}
+
+	if (info) {
+		PrintImage(&mapped.image);
+		VM_UnmapImage(&mapped);
+		return EXIT_SUCCESS;
+	}
+
+	// Code is executed in place, the view is read-only
+	uint8_t* code = (uint8_t*)mapped.image.code;
+
+	struct VM_Program program;
+	struct VM_VerifyError error;
+	if (!VM_DecodeProgram(&program, code, mapped.image.code_size, &error)) {
+		printf("Invalid image %s at code offset 0x%zx: %s\n", path, error.offset, error.reason);
+		VM_UnmapImage(&mapped);
 		return EXIT_FAILURE;
 	}
 
-	const char* path = argv[1];
-	uint8_t* alloc = LoadFile(path);
+	// Only what prints code locations pays for sorting the symbols and reading the lines
+	struct VM_DebugInfo debug = { 0 };
+	if ((trace || profile != NULL) && VM_LoadDebugInfo(&debug, &mapped.image)) {
+		program.debug = &debug;
+	}
+
+	// Traces and counters show raw instructions, lockstep kernels work on single codes
+	if (fusion && !trace && !counters && lockstep == 0) {
+		struct VM_FusionStats stats;
+		VM_FuseProgram(&program, &stats);
+
+		if (fusion_stats) {
+			VM_PrintFusionStats(&stats);
+		}
+	}
+
+	if (instances > 0 && lockstep > 0) {
+		int status = RunLockstep(&program, instances, lockstep, check, memory_size, stack_size);
+		VM_FreeProgram(&program);
+		VM_UnmapImage(&mapped);
+		return status;
+	}
+
+	// Workers would race on the compiled blocks, the pool runs threaded
+	if (instances > 0 && engine == VM_ENGINE_JIT) {
+		printf("JIT unavailable in the pool, using the threaded engine\n");
+		engine = VM_ENGINE_THREADED;
+	}
+
+	if (instances > 0) {
+		int status = RunPool(&program, engine, &pool, instances, check, memory_size, stack_size);
+		VM_FreeProgram(&program);
+		VM_UnmapImage(&mapped);
+		return status;
+	}
+
+	if (engine == VM_ENGINE_JIT && !VM_CreateJit(&program, jit_threshold)) {
+		printf("JIT unavailable, using the table engine\n");
+		engine = VM_ENGINE_TABLE;
+	}
+
+	if (forks > 0) {
+		int status = RunFork(&program, engine, forks, snapshot_at, memory_size, stack_size);
+		VM_FreeJit(&program);
+		VM_FreeProgram(&program);
+		VM_UnmapImage(&mapped);
+		return status;
+	}
 
-	void* stack = malloc(4096);
+	if (bench_iterations > 0) {
+		int status = RunBenchmark(&program, bench_iterations, memory_size, stack_size);
+		VM_FreeJit(&program);
+		VM_FreeProgram(&program);
+		VM_UnmapImage(&mapped);
+		return status;
+	}
 
-	printf("Alloc: %p\n", alloc);
-	printf("Stack: %p\n", stack);
+	struct VM_Memory memory;
+	if (!VM_CreateMemory(&memory, memory_size, stack_size)) {
+		printf("Failed to reserve the guest memory\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Code: %p\n", code);
+	printf("Memory: %p, %zu bytes\n", memory.base, memory.size);
 
 	struct IL_VirtualMachine vm;
 	VM_Init(&vm);
+	VM_RegisterHostTable(&vm, &VM_BUILTIN_HOST_TABLE);
 	
-	vm.ip = (uint64_t)alloc;
-	vm.sp = (uint64_t)stack + 4096;
+	vm.memory = &memory;
+	vm.ip = (uint64_t)code;
+	vm.sp = memory.stack_top;
+	VM_SetFuel(&vm, fuel);
+
+	struct VM_Counters* vm_counters = NULL;
+	if (counters) {
+		vm_counters = malloc(sizeof(struct VM_Counters));
+		if (vm_counters == NULL) {
+			printf("Failed to allocate the counters\n");
+			return EXIT_FAILURE;
+		}
+
+		VM_InitCounters(vm_counters);
+		vm.counters = vm_counters;
+	}
+
+	if (trace) {
+		struct VM_Trace vm_trace;
+		if (!VM_InitTrace(&vm_trace, stdout, VM_TRACE_BUFFER_SIZE)) {
+			printf("Failed to allocate the trace buffer\n");
+			return EXIT_FAILURE;
+		}
+
+		VM_ExecuteTraced(&vm, &program, &vm_trace);
+		VM_FreeTrace(&vm_trace);
+	}
+	else if (profile != NULL) {
+		if (!RunProfiled(&vm, &program, engine, profile, profile_period)) {
+			return EXIT_FAILURE;
+		}
+	}
+	else {
+		VM_ExecuteWaiting(&vm, &program, engine);
+	}
 
-	VM_Run(&vm);
 	VM_PrintContext(&vm);
 
-	free(alloc);
-	free(stack);
-	return EXIT_SUCCESS;
+	if (vm.fault != VM_FAULT_NONE && program.debug == NULL && VM_LoadDebugInfo(&debug, &mapped.image)) {
+		program.debug = &debug;
+	}
+
+	VM_PrintFault(&vm, &program);
+
+	if (fuel != VM_FUEL_UNLIMITED) {
+		printf("Fuel: %llu consumed, %llu left%s\n", (unsigned long long)VM_GetFuelConsumed(&vm), (unsigned long long)VM_GetFuel(&vm),
+			vm.suspend == VM_SUSPEND_FUEL ? ", ran out" : "");
+	}
+
+	printf("Stack: %llu of %llu bytes committed\n", (unsigned long long)(memory.stack_top - memory.stack_committed), (unsigned long long)(memory.stack_top - memory.stack_limit));
+	VM_PrintJitStats(&program);
+
+	int status = EXIT_SUCCESS;
+	if (vm_counters != NULL) {
+		VM_PrintCounters(vm_counters);
+
+		if (counters_json != NULL) {
+			FILE* out = fopen(counters_json, "w");
+			if (out != NULL) {
+				VM_WriteCountersJson(vm_counters, out);
+				fclose(out);
+			}
+			else {
+				printf("Failed to open %s\n", counters_json);
+				status = EXIT_FAILURE;
+			}
+		}
+
+		vm.counters = NULL;
+		free(vm_counters);
+	}
+
+	if (check && !CheckRun(&program, &vm, 0, memory_size, stack_size)) {
+		status = EXIT_FAILURE;
+	}
+
+	VM_FreeJit(&program);
+	VM_FreeProgram(&program);
+	VM_FreeDebugInfo(&debug);
+	VM_UnmapImage(&mapped);
+	VM_FreeMemory(&memory);
+	return status;
 }
\ No newline at end of file
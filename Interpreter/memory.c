@@ -0,0 +1,468 @@
+// memfd_create
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <setjmp.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "memory.h"
+#include "platform.h"
+
+#define VM_MEMORY_RESERVATION (VM_MEMORY_GUARD_SIZE + VM_MEMORY_SPACE + VM_MEMORY_GUARD_SIZE)
+
+#define VM_ALIGN_UP(value, alignment) (((value) + (alignment) - 1) & ~(uint64_t)((alignment) - 1))
+#define VM_ALIGN_DOWN(value, alignment) ((value) & ~(uint64_t)((alignment) - 1))
+
+static bool VM_IsGuestFault(const uint8_t* base, const uint8_t* address) {
+	return address >= base - VM_MEMORY_GUARD_SIZE && address < base + VM_MEMORY_SPACE + VM_MEMORY_GUARD_SIZE;
+}
+
+#ifdef _WIN32
+
+static uint8_t* VM_ReserveSpace(void) {
+	return VirtualAlloc(NULL, VM_MEMORY_RESERVATION, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+static void VM_ReleaseSpace(uint8_t* reservation) {
+	VirtualFree(reservation, 0, MEM_RELEASE);
+}
+
+static bool VM_Commit(uint8_t* address, size_t size) {
+	return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+static bool VM_Decommit(uint8_t* address, size_t size) {
+	return size == 0 || VirtualFree(address, size, MEM_DECOMMIT);
+}
+
+static size_t VM_GetPageSize(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
+#else
+
+static uint8_t* VM_ReserveSpace(void) {
+	// Reserved only, pages are backed on first touch once committed
+	uint8_t* reservation = mmap(NULL, VM_MEMORY_RESERVATION, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return reservation == MAP_FAILED ? NULL : reservation;
+}
+
+static void VM_ReleaseSpace(uint8_t* reservation) {
+	munmap(reservation, VM_MEMORY_RESERVATION);
+}
+
+static bool VM_Commit(uint8_t* address, size_t size) {
+	return mprotect(address, size, PROT_READ | PROT_WRITE) == 0;
+}
+
+// Fresh reserved pages replace the committed ones, their contents are dropped
+static bool VM_Decommit(uint8_t* address, size_t size) {
+	return size == 0 || mmap(address, size, PROT_NONE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) != MAP_FAILED;
+}
+
+static size_t VM_GetPageSize(void) {
+	return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+#endif
+
+bool VM_CreateMemory(struct VM_Memory* memory, size_t size, size_t stack_size) {
+	memset(memory, 0, sizeof(*memory));
+
+	memory->stack_top = VM_STACK_TOP;
+	memory->stack_limit = VM_STACK_TOP - VM_ALIGN_UP(stack_size, VM_STACK_CHUNK_SIZE);
+	memory->stack_committed = VM_STACK_TOP;
+
+	// Memory, stack guard and stack must not overlap
+	if (stack_size == 0 || stack_size > VM_STACK_TOP || memory->stack_limit < VM_STACK_GUARD_SIZE || size > memory->stack_limit - VM_STACK_GUARD_SIZE) {
+		return false;
+	}
+
+	uint8_t* reservation = VM_ReserveSpace();
+	if (reservation == NULL) {
+		return false;
+	}
+
+	memory->base = reservation + VM_MEMORY_GUARD_SIZE;
+	memory->stack_committed = VM_STACK_TOP - VM_STACK_CHUNK_SIZE;
+
+	if ((size > 0 && !VM_Commit(memory->base, size)) || !VM_Commit(memory->base + memory->stack_committed, VM_STACK_CHUNK_SIZE)) {
+		VM_ReleaseSpace(reservation);
+		memset(memory, 0, sizeof(*memory));
+		return false;
+	}
+
+	memory->size = size;
+	return true;
+}
+
+void VM_FreeMemory(struct VM_Memory* memory) {
+	if (memory->base != NULL) {
+		VM_ReleaseSpace(memory->base - VM_MEMORY_GUARD_SIZE);
+	}
+
+	memset(memory, 0, sizeof(*memory));
+}
+
+bool VM_IsStackGuard(const struct VM_Memory* memory, uint64_t address) {
+	return address < memory->stack_limit && address >= memory->stack_limit - VM_STACK_GUARD_SIZE;
+}
+
+uint8_t* VM_GetGuestRange(const struct VM_Memory* memory, uint64_t address, uint64_t size, bool committed) {
+	uint64_t start = (uint32_t)address;
+	uint64_t stack_bottom = committed ? memory->stack_committed : memory->stack_limit;
+
+	bool in_memory = start <= memory->size && size <= memory->size - start;
+	bool in_stack = start >= stack_bottom && start <= memory->stack_top && size <= memory->stack_top - start;
+	if (!in_memory && !in_stack) {
+		return NULL;
+	}
+
+	return VM_TranslateAddress(memory->base, address);
+}
+
+static bool VM_IsZeroPage(const uint8_t* source, size_t page) {
+	static const uint64_t zero[64] = { 0 };
+
+	for (size_t i = 0; i < page; i += sizeof(zero)) {
+		if (memcmp(source + i, zero, sizeof(zero)) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Pages still zero aren't copied, the snapshot store starts zeroed. Every committed page is compared,
+// one that isn't resident may still hold data swapped out or mapped from an earlier snapshot.
+static void VM_CopyPages(uint8_t* destination, const uint8_t* source, size_t size, size_t page) {
+	for (size_t offset = 0; offset < size; offset += page) {
+		if (!VM_IsZeroPage(source + offset, page)) {
+			memcpy(destination + offset, source + offset, page);
+		}
+	}
+}
+
+#ifdef _WIN32
+
+// A view can't be mapped over part of a reservation without placeholders, pages are copied out of a private store instead
+static uint8_t* VM_CreateSnapshotStore(struct VM_MemorySnapshot* snapshot, size_t size) {
+	snapshot->store = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	return snapshot->store;
+}
+
+static void VM_CloseSnapshotView(uint8_t* view, size_t size) {
+}
+
+static void VM_ReleaseSnapshotStore(struct VM_MemorySnapshot* snapshot) {
+	if (snapshot->store != NULL) {
+		VirtualFree(snapshot->store, 0, MEM_RELEASE);
+	}
+}
+
+static bool VM_MapSnapshotPages(uint8_t* address, size_t size, const struct VM_MemorySnapshot* snapshot, size_t offset) {
+	if (size == 0) {
+		return true;
+	}
+
+	if (!VM_Decommit(address, size) || !VM_Commit(address, size)) {
+		return false;
+	}
+
+	VM_CopyPages(address, snapshot->store + offset, size, VM_GetPageSize());
+	return true;
+}
+
+#else
+
+static int VM_CreateSharedFile(void) {
+#ifdef __linux__
+	return memfd_create("vm-snapshot", MFD_CLOEXEC);
+#else
+	static VM_Atomic_t counter = 0;
+
+	char name[64];
+	snprintf(name, sizeof(name), "/vm-snapshot-%ld-%lld", (long)getpid(), (long long)VM_AtomicAdd(&counter, 1));
+
+	// Only the descriptor is needed, the name goes away right away
+	int file = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (file >= 0) {
+		shm_unlink(name);
+	}
+
+	return file;
+#endif
+}
+
+// Shared memory file, every copy maps it privately and only the pages it writes become its own
+static uint8_t* VM_CreateSnapshotStore(struct VM_MemorySnapshot* snapshot, size_t size) {
+	snapshot->file = VM_CreateSharedFile();
+	if (snapshot->file < 0) {
+		return NULL;
+	}
+
+	if (ftruncate(snapshot->file, (off_t)size) != 0) {
+		return NULL;
+	}
+
+	uint8_t* view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, snapshot->file, 0);
+	return view == MAP_FAILED ? NULL : view;
+}
+
+static void VM_CloseSnapshotView(uint8_t* view, size_t size) {
+	munmap(view, size);
+}
+
+static void VM_ReleaseSnapshotStore(struct VM_MemorySnapshot* snapshot) {
+	if (snapshot->file >= 0) {
+		close(snapshot->file);
+	}
+}
+
+static bool VM_MapSnapshotPages(uint8_t* address, size_t size, const struct VM_MemorySnapshot* snapshot, size_t offset) {
+	return size == 0 || mmap(address, size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE, snapshot->file, (off_t)offset) != MAP_FAILED;
+}
+
+#endif
+
+static bool VM_MapSnapshot(struct VM_Memory* memory, const struct VM_MemorySnapshot* snapshot) {
+	size_t page = VM_GetPageSize();
+	size_t size = VM_ALIGN_UP(memory->size, page);
+	size_t snapshot_size = VM_ALIGN_UP(snapshot->size, page);
+
+	// Pages the snapshot doesn't have, the others are replaced by the mapping
+	if (size > snapshot_size && !VM_Decommit(memory->base + snapshot_size, size - snapshot_size)) {
+		return false;
+	}
+
+	if (memory->stack_committed < snapshot->stack_committed && !VM_Decommit(memory->base + memory->stack_committed, (size_t)(snapshot->stack_committed - memory->stack_committed))) {
+		return false;
+	}
+
+	size_t stack_size = (size_t)(VM_STACK_TOP - snapshot->stack_committed);
+	if (!VM_MapSnapshotPages(memory->base, snapshot_size, snapshot, 0) || !VM_MapSnapshotPages(memory->base + snapshot->stack_committed, stack_size, snapshot, snapshot_size)) {
+		return false;
+	}
+
+	memory->size = snapshot->size;
+	memory->stack_top = VM_STACK_TOP;
+	memory->stack_limit = snapshot->stack_limit;
+	memory->stack_committed = snapshot->stack_committed;
+	return true;
+}
+
+bool VM_CaptureMemory(struct VM_Memory* memory, struct VM_MemorySnapshot* snapshot) {
+	memset(snapshot, 0, sizeof(*snapshot));
+#ifndef _WIN32
+	snapshot->file = -1;
+#endif
+
+	size_t page = VM_GetPageSize();
+	size_t size = VM_ALIGN_UP(memory->size, page);
+	size_t stack_size = (size_t)(memory->stack_top - memory->stack_committed);
+
+	uint8_t* view = VM_CreateSnapshotStore(snapshot, size + stack_size);
+	if (view == NULL) {
+		VM_ReleaseSnapshotStore(snapshot);
+		return false;
+	}
+
+	VM_CopyPages(view, memory->base, size, page);
+	VM_CopyPages(view + size, memory->base + memory->stack_committed, stack_size, page);
+	VM_CloseSnapshotView(view, size + stack_size);
+
+	snapshot->size = memory->size;
+	snapshot->stack_limit = memory->stack_limit;
+	snapshot->stack_committed = memory->stack_committed;
+
+	// The captured memory becomes a copy too, sharing its pages with the clones
+	if (!VM_MapSnapshot(memory, snapshot)) {
+		VM_FreeMemorySnapshot(snapshot);
+		return false;
+	}
+
+	return true;
+}
+
+bool VM_RestoreMemory(struct VM_Memory* memory, const struct VM_MemorySnapshot* snapshot) {
+	return VM_MapSnapshot(memory, snapshot);
+}
+
+bool VM_CloneMemory(struct VM_Memory* memory, const struct VM_MemorySnapshot* snapshot) {
+	memset(memory, 0, sizeof(*memory));
+
+	uint8_t* reservation = VM_ReserveSpace();
+	if (reservation == NULL) {
+		return false;
+	}
+
+	memory->base = reservation + VM_MEMORY_GUARD_SIZE;
+	memory->stack_committed = VM_STACK_TOP;
+
+	if (!VM_MapSnapshot(memory, snapshot)) {
+		VM_ReleaseSpace(reservation);
+		memset(memory, 0, sizeof(*memory));
+		return false;
+	}
+
+	return true;
+}
+
+void VM_FreeMemorySnapshot(struct VM_MemorySnapshot* snapshot) {
+	VM_ReleaseSnapshotStore(snapshot);
+	memset(snapshot, 0, sizeof(*snapshot));
+#ifndef _WIN32
+	snapshot->file = -1;
+#endif
+}
+
+// Commits the stack down to the chunk holding address, called from the fault handler
+static bool VM_GrowStack(struct VM_Memory* memory, const uint8_t* fault) {
+	uint64_t address = (uint64_t)(fault - memory->base);
+	if (fault < memory->base || address < memory->stack_limit || address >= memory->stack_committed) {
+		return false;
+	}
+
+	uint64_t committed = VM_ALIGN_DOWN(address, VM_STACK_CHUNK_SIZE);
+	if (!VM_Commit(memory->base + committed, (size_t)(memory->stack_committed - committed))) {
+		return false;
+	}
+
+	memory->stack_committed = committed;
+	return true;
+}
+
+#ifdef _WIN32
+
+static int VM_FilterFault(EXCEPTION_POINTERS* info, struct VM_Memory* memory, uint8_t** fault) {
+	EXCEPTION_RECORD* record = info->ExceptionRecord;
+	if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || record->NumberParameters < 2) {
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	uint8_t* address = (uint8_t*)record->ExceptionInformation[1];
+	if (!VM_IsGuestFault(memory->base, address)) {
+		return EXCEPTION_CONTINUE_SEARCH;
+	}
+
+	if (VM_GrowStack(memory, address)) {
+		return EXCEPTION_CONTINUE_EXECUTION;
+	}
+
+	*fault = address;
+	return EXCEPTION_EXECUTE_HANDLER;
+}
+
+bool VM_RunGuarded(struct VM_Memory* memory, VM_GuardedFn_t run, void* context, uint64_t* address) {
+	uint8_t* fault = NULL;
+
+	__try {
+		run(context);
+	}
+	__except (VM_FilterFault(GetExceptionInformation(), memory, &fault)) {
+		*address = (uint64_t)(fault - memory->base);
+		return false;
+	}
+
+	return true;
+}
+
+#else
+
+struct VM_Guard {
+	sigjmp_buf jump;
+	struct VM_Memory* memory;
+	uint8_t* fault;
+	struct VM_Guard* previous;
+};
+
+static _Thread_local struct VM_Guard* vm_guard = NULL;
+
+static pthread_once_t vm_fault_handler_once = PTHREAD_ONCE_INIT;
+static struct sigaction vm_previous_segv;
+static struct sigaction vm_previous_bus;
+
+static void VM_HandleFault(int signal, siginfo_t* info, void* ucontext) {
+	struct VM_Guard* guard = vm_guard;
+	if (guard != NULL && VM_IsGuestFault(guard->memory->base, info->si_addr)) {
+		// Returning runs the access again, now on a committed page
+		if (VM_GrowStack(guard->memory, info->si_addr)) {
+			return;
+		}
+
+		guard->fault = info->si_addr;
+		siglongjmp(guard->jump, 1);
+	}
+
+	// Not a guest access, it's the previous handler's. Ours stays installed for the other threads.
+	const struct sigaction* previous = signal == SIGSEGV ? &vm_previous_segv : &vm_previous_bus;
+	if (previous->sa_flags & SA_SIGINFO) {
+		previous->sa_sigaction(signal, info, ucontext);
+		return;
+	}
+
+	if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN) {
+		previous->sa_handler(signal);
+		return;
+	}
+
+	// A fault can't be ignored, the default action ends the process
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = SIG_DFL;
+	sigemptyset(&action.sa_mask);
+	sigaction(signal, &action, NULL);
+	raise(signal);
+}
+
+static void VM_InstallFaultHandler(void) {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = VM_HandleFault;
+
+	// Not deferred so the jump out of the handler doesn't leave the signal blocked
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+
+	sigaction(SIGSEGV, &action, &vm_previous_segv);
+	sigaction(SIGBUS, &action, &vm_previous_bus);
+}
+
+bool VM_RunGuarded(struct VM_Memory* memory, VM_GuardedFn_t run, void* context, uint64_t* address) {
+	pthread_once(&vm_fault_handler_once, VM_InstallFaultHandler);
+
+	struct VM_Guard guard;
+	guard.memory = memory;
+	guard.fault = NULL;
+	guard.previous = vm_guard;
+	vm_guard = &guard;
+
+	bool completed = true;
+	if (sigsetjmp(guard.jump, 0) == 0) {
+		run(context);
+	}
+	else {
+		completed = false;
+		*address = (uint64_t)(guard.fault - memory->base);
+	}
+
+	vm_guard = guard.previous;
+	return completed;
+}
+
+#endif
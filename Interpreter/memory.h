@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Guest addresses are 32 bit offsets into one reservation surrounded by guard regions.
+// Nothing is checked per access, touching a page that isn't committed faults and
+// VM_RunGuarded turns the fault into a VM trap.
+#define VM_MEMORY_SPACE (UINT64_C(1) << 32)
+
+// Larger than any single access, so one starting below 4 GiB can't reach past the guard
+#define VM_MEMORY_GUARD_SIZE (64 * 1024)
+
+#define VM_DEFAULT_MEMORY_SIZE (1024 * 1024)
+
+// The stack sits at the top of the guest space, below an uncommitted gap that catches underflows.
+// It's committed a chunk at a time as it grows down to stack_limit, the guard under it is never committed.
+#define VM_STACK_CHUNK_SIZE (64 * 1024)
+#define VM_STACK_GUARD_SIZE (64 * 1024)
+#define VM_STACK_TOP (VM_MEMORY_SPACE - VM_MEMORY_GUARD_SIZE)
+
+#define VM_DEFAULT_STACK_SIZE (8 * 1024 * 1024)
+
+struct VM_Memory {
+	uint8_t* base; // Guest address 0
+	size_t size; // Committed bytes from address 0
+
+	// Guest addresses, the stack grows from stack_top down to stack_limit
+	uint64_t stack_top;
+	uint64_t stack_limit;
+	uint64_t stack_committed; // Lowest committed stack address
+};
+
+// Reserves the whole guest space, commits size bytes of it and the first stack chunk
+bool VM_CreateMemory(struct VM_Memory* memory, size_t size, size_t stack_size);
+void VM_FreeMemory(struct VM_Memory* memory);
+
+static inline uint8_t* VM_TranslateAddress(uint8_t* base, uint64_t address) {
+	return base + (uint32_t)address;
+}
+
+// True if address is in the guard under the stack, an access there is a stack overflow
+bool VM_IsStackGuard(const struct VM_Memory* memory, uint64_t address);
+
+// Host pointer to size bytes at a guest address, NULL unless they're all in the memory or in the stack.
+// The stack counts down to stack_limit, or only down to stack_committed when committed is set.
+// No page is touched to check.
+uint8_t* VM_GetGuestRange(const struct VM_Memory* memory, uint64_t address, uint64_t size, bool committed);
+
+// Committed pages frozen in a store that copies map copy-on-write, see VM_CaptureMemory
+struct VM_MemorySnapshot {
+#ifdef _WIN32
+	uint8_t* store;
+#else
+	int file;
+#endif
+
+	size_t size;
+	uint64_t stack_limit;
+	uint64_t stack_committed; // Stack pages follow the memory pages in the store
+};
+
+// Copies the committed pages into a new snapshot, memory is then remapped onto it like any clone
+bool VM_CaptureMemory(struct VM_Memory* memory, struct VM_MemorySnapshot* snapshot);
+
+// Drops every page written since and the stack grown past the snapshot
+bool VM_RestoreMemory(struct VM_Memory* memory, const struct VM_MemorySnapshot* snapshot);
+
+// Reserves a new guest space sharing the snapshot pages, freed with VM_FreeMemory
+bool VM_CloneMemory(struct VM_Memory* memory, const struct VM_MemorySnapshot* snapshot);
+
+// Copies keep their pages, the store goes away with the last mapping
+void VM_FreeMemorySnapshot(struct VM_MemorySnapshot* snapshot);
+
+typedef void (*VM_GuardedFn_t)(void* context);
+
+// Calls run, growing the stack on demand. Returns false if it faulted inside the guest space,
+// address is then the guest address.
+bool VM_RunGuarded(struct VM_Memory* memory, VM_GuardedFn_t run, void* context, uint64_t* address);
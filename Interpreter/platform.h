@@ -0,0 +1,300 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Threads, locks and atomics for the pool, Win32 or pthreads and the GCC/Clang atomic builtins
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#endif
+
+#ifdef _MSC_VER
+#define VM_THREAD_LOCAL __declspec(thread)
+#else
+#define VM_THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*VM_ThreadFn_t)(void* context);
+typedef void (*VM_OnceFn_t)(void);
+
+#ifdef _WIN32
+
+typedef volatile LONG64 VM_Atomic_t;
+
+typedef SRWLOCK VM_Mutex_t;
+typedef CONDITION_VARIABLE VM_Cond_t;
+
+typedef INIT_ONCE VM_Once_t;
+#define VM_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+struct VM_Thread {
+	HANDLE handle;
+	VM_ThreadFn_t run;
+	void* context;
+};
+
+// Interlocked operations are full barriers
+static inline int64_t VM_AtomicLoad(VM_Atomic_t* atomic) {
+	return InterlockedCompareExchange64(atomic, 0, 0);
+}
+
+static inline void VM_AtomicStore(VM_Atomic_t* atomic, int64_t value) {
+	InterlockedExchange64(atomic, value);
+}
+
+static inline int64_t VM_AtomicAdd(VM_Atomic_t* atomic, int64_t value) {
+	return InterlockedExchangeAdd64(atomic, value) + value;
+}
+
+static inline bool VM_AtomicCompareExchange(VM_Atomic_t* atomic, int64_t expected, int64_t desired) {
+	return InterlockedCompareExchange64(atomic, desired, expected) == expected;
+}
+
+static inline void VM_InitMutex(VM_Mutex_t* mutex) {
+	InitializeSRWLock(mutex);
+}
+
+static inline void VM_FreeMutex(VM_Mutex_t* mutex) {
+}
+
+static inline void VM_LockMutex(VM_Mutex_t* mutex) {
+	AcquireSRWLockExclusive(mutex);
+}
+
+static inline void VM_UnlockMutex(VM_Mutex_t* mutex) {
+	ReleaseSRWLockExclusive(mutex);
+}
+
+static inline void VM_InitCond(VM_Cond_t* cond) {
+	InitializeConditionVariable(cond);
+}
+
+static inline void VM_FreeCond(VM_Cond_t* cond) {
+}
+
+static inline void VM_WaitCond(VM_Cond_t* cond, VM_Mutex_t* mutex, uint32_t milliseconds) {
+	SleepConditionVariableSRW(cond, mutex, milliseconds, 0);
+}
+
+static inline void VM_SignalCond(VM_Cond_t* cond) {
+	WakeConditionVariable(cond);
+}
+
+static inline void VM_BroadcastCond(VM_Cond_t* cond) {
+	WakeAllConditionVariable(cond);
+}
+
+static inline BOOL CALLBACK VM_OnceEntry(PINIT_ONCE once, PVOID parameter, PVOID* context) {
+	((VM_OnceFn_t)parameter)();
+	return TRUE;
+}
+
+// Threads that lose the race wait for the winner to return
+static inline void VM_CallOnce(VM_Once_t* once, VM_OnceFn_t run) {
+	InitOnceExecuteOnce(once, VM_OnceEntry, (PVOID)run, NULL);
+}
+
+static inline DWORD WINAPI VM_ThreadEntry(LPVOID parameter) {
+	struct VM_Thread* thread = parameter;
+	thread->run(thread->context);
+	return 0;
+}
+
+static inline bool VM_StartThread(struct VM_Thread* thread, VM_ThreadFn_t run, void* context) {
+	thread->run = run;
+	thread->context = context;
+	thread->handle = CreateThread(NULL, 0, VM_ThreadEntry, thread, 0, NULL);
+	return thread->handle != NULL;
+}
+
+static inline void VM_JoinThread(struct VM_Thread* thread) {
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+static inline uint32_t VM_GetCoreCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+static inline double VM_GetTime(void) {
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+// The peak working set can't be reset, it's the peak of the whole process so far
+static inline void VM_ResetPeakMemory(void) {
+}
+
+static inline size_t VM_GetPeakMemory(void) {
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+
+	return counters.PeakWorkingSetSize;
+}
+
+#else
+
+typedef int64_t VM_Atomic_t;
+
+typedef pthread_mutex_t VM_Mutex_t;
+typedef pthread_cond_t VM_Cond_t;
+
+typedef pthread_once_t VM_Once_t;
+#define VM_ONCE_INIT PTHREAD_ONCE_INIT
+
+struct VM_Thread {
+	pthread_t handle;
+	VM_ThreadFn_t run;
+	void* context;
+};
+
+static inline int64_t VM_AtomicLoad(VM_Atomic_t* atomic) {
+	return __atomic_load_n(atomic, __ATOMIC_SEQ_CST);
+}
+
+static inline void VM_AtomicStore(VM_Atomic_t* atomic, int64_t value) {
+	__atomic_store_n(atomic, value, __ATOMIC_SEQ_CST);
+}
+
+static inline int64_t VM_AtomicAdd(VM_Atomic_t* atomic, int64_t value) {
+	return __atomic_add_fetch(atomic, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool VM_AtomicCompareExchange(VM_Atomic_t* atomic, int64_t expected, int64_t desired) {
+	return __atomic_compare_exchange_n(atomic, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline void VM_InitMutex(VM_Mutex_t* mutex) {
+	pthread_mutex_init(mutex, NULL);
+}
+
+static inline void VM_FreeMutex(VM_Mutex_t* mutex) {
+	pthread_mutex_destroy(mutex);
+}
+
+static inline void VM_LockMutex(VM_Mutex_t* mutex) {
+	pthread_mutex_lock(mutex);
+}
+
+static inline void VM_UnlockMutex(VM_Mutex_t* mutex) {
+	pthread_mutex_unlock(mutex);
+}
+
+static inline void VM_InitCond(VM_Cond_t* cond) {
+	pthread_cond_init(cond, NULL);
+}
+
+static inline void VM_FreeCond(VM_Cond_t* cond) {
+	pthread_cond_destroy(cond);
+}
+
+static inline void VM_WaitCond(VM_Cond_t* cond, VM_Mutex_t* mutex, uint32_t milliseconds) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += milliseconds / 1000;
+	deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+static inline void VM_SignalCond(VM_Cond_t* cond) {
+	pthread_cond_signal(cond);
+}
+
+static inline void VM_BroadcastCond(VM_Cond_t* cond) {
+	pthread_cond_broadcast(cond);
+}
+
+// Threads that lose the race wait for the winner to return
+static inline void VM_CallOnce(VM_Once_t* once, VM_OnceFn_t run) {
+	pthread_once(once, run);
+}
+
+static inline void* VM_ThreadEntry(void* parameter) {
+	struct VM_Thread* thread = parameter;
+	thread->run(thread->context);
+	return NULL;
+}
+
+static inline bool VM_StartThread(struct VM_Thread* thread, VM_ThreadFn_t run, void* context) {
+	thread->run = run;
+	thread->context = context;
+	return pthread_create(&thread->handle, NULL, VM_ThreadEntry, thread) == 0;
+}
+
+static inline void VM_JoinThread(struct VM_Thread* thread) {
+	pthread_join(thread->handle, NULL);
+}
+
+static inline uint32_t VM_GetCoreCount(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+}
+
+static inline double VM_GetTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Linux resets the peak resident size through clear_refs, elsewhere it's the peak of the whole process so far
+static inline void VM_ResetPeakMemory(void) {
+#ifdef __linux__
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (file != NULL) {
+		fputs("5", file);
+		fclose(file);
+	}
+#endif
+}
+
+static inline size_t VM_GetPeakMemory(void) {
+#ifdef __linux__
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file != NULL) {
+		char line[128];
+		unsigned long long kilobytes = 0;
+		while (fgets(line, sizeof(line), file) != NULL) {
+			if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1) {
+				break;
+			}
+		}
+
+		fclose(file);
+		if (kilobytes > 0) {
+			return (size_t)kilobytes * 1024;
+		}
+	}
+#endif
+
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+#ifdef __APPLE__
+	return (size_t)usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+#endif
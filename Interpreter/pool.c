@@ -0,0 +1,402 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vm.h"
+#include "decoder.h"
+#include "memory.h"
+#include "platform.h"
+#include "pool.h"
+#include "host.h"
+
+#define VM_POOL_QUEUE_MASK (VM_POOL_QUEUE_SIZE - 1)
+
+_Static_assert((VM_POOL_QUEUE_SIZE & VM_POOL_QUEUE_MASK) == 0, "VM_POOL_QUEUE_SIZE must be a power of two");
+
+// Idle workers wake up this often to look for tasks to steal
+#define VM_POOL_IDLE_WAIT_MS 1
+
+// Bounded FIFO, only the owner pushes at the tail, any worker takes from the head
+struct VM_RunQueue {
+	_Alignas(64) VM_Atomic_t head;
+	_Alignas(64) VM_Atomic_t tail;
+	_Alignas(64) struct VM_Task* slots[VM_POOL_QUEUE_SIZE];
+};
+
+struct VM_Worker {
+	struct VM_RunQueue queue;
+	struct VM_Pool* pool;
+	uint32_t index;
+	uint32_t seed; // Victim selection
+	struct VM_Thread thread;
+	struct VM_WorkerStats stats; // Only written by the worker
+};
+
+struct VM_Pool {
+	const struct VM_Program* program;
+	struct VM_PoolConfig config;
+
+	VM_Mutex_t mutex;
+	VM_Cond_t work; // Tasks were submitted or queued behind sleeping workers
+	VM_Cond_t done; // The last task is done
+
+	// Submitted tasks and queue overflows, protected by mutex
+	struct VM_Task* shared_first;
+	struct VM_Task* shared_last;
+	VM_Atomic_t shared_count;
+
+	VM_Atomic_t active; // Submitted and not done
+	VM_Atomic_t sleeping;
+	bool stop;
+
+	uint32_t worker_count;
+	struct VM_Worker* workers;
+};
+
+static bool VM_PushTask(struct VM_RunQueue* queue, struct VM_Task* task) {
+	int64_t tail = VM_AtomicLoad(&queue->tail);
+	if (tail - VM_AtomicLoad(&queue->head) >= VM_POOL_QUEUE_SIZE) {
+		return false;
+	}
+
+	queue->slots[tail & VM_POOL_QUEUE_MASK] = task;
+	VM_AtomicStore(&queue->tail, tail + 1);
+	return true;
+}
+
+// The slot is read before the head is claimed, the owner can't reuse it until the claim succeeds
+static struct VM_Task* VM_TakeTask(struct VM_RunQueue* queue) {
+	for (;;) {
+		int64_t head = VM_AtomicLoad(&queue->head);
+		if (head >= VM_AtomicLoad(&queue->tail)) {
+			return NULL;
+		}
+
+		struct VM_Task* task = queue->slots[head & VM_POOL_QUEUE_MASK];
+		if (VM_AtomicCompareExchange(&queue->head, head, head + 1)) {
+			return task;
+		}
+	}
+}
+
+static int64_t VM_GetQueueLength(struct VM_RunQueue* queue) {
+	return VM_AtomicLoad(&queue->tail) - VM_AtomicLoad(&queue->head);
+}
+
+static void VM_PushShared(struct VM_Pool* pool, struct VM_Task* task) {
+	task->next = NULL;
+
+	VM_LockMutex(&pool->mutex);
+	if (pool->shared_last != NULL) {
+		pool->shared_last->next = task;
+	}
+	else {
+		pool->shared_first = task;
+	}
+
+	pool->shared_last = task;
+	VM_AtomicAdd(&pool->shared_count, 1);
+
+	VM_SignalCond(&pool->work);
+	VM_UnlockMutex(&pool->mutex);
+}
+
+// Moves an even share of the shared queue behind the tasks the worker already has
+static void VM_RefillQueue(struct VM_Worker* worker) {
+	struct VM_Pool* pool = worker->pool;
+
+	VM_LockMutex(&pool->mutex);
+	int64_t count = VM_AtomicLoad(&pool->shared_count);
+	int64_t share = count / pool->worker_count;
+	if (share == 0) {
+		share = count;
+	}
+
+	int64_t space = VM_POOL_QUEUE_SIZE - VM_GetQueueLength(&worker->queue);
+	if (share > space) {
+		share = space;
+	}
+
+	for (int64_t i = 0; i < share; ++i) {
+		struct VM_Task* task = pool->shared_first;
+		pool->shared_first = task->next;
+		if (pool->shared_first == NULL) {
+			pool->shared_last = NULL;
+		}
+
+		VM_PushTask(&worker->queue, task);
+	}
+
+	VM_AtomicAdd(&pool->shared_count, -share);
+	VM_UnlockMutex(&pool->mutex);
+}
+
+static struct VM_Task* VM_StealTask(struct VM_Worker* worker) {
+	struct VM_Pool* pool = worker->pool;
+
+	// xorshift, a fixed order would pile every thief on the same victim
+	worker->seed ^= worker->seed << 13;
+	worker->seed ^= worker->seed >> 17;
+	worker->seed ^= worker->seed << 5;
+
+	uint32_t start = worker->seed % pool->worker_count;
+	for (uint32_t i = 0; i < pool->worker_count; ++i) {
+		struct VM_Worker* victim = &pool->workers[(start + i) % pool->worker_count];
+		if (victim == worker) {
+			continue;
+		}
+
+		struct VM_Task* task = VM_TakeTask(&victim->queue);
+		if (task != NULL) {
+			worker->stats.steals += 1;
+			return task;
+		}
+	}
+
+	return NULL;
+}
+
+static void VM_FinishTask(struct VM_Pool* pool, struct VM_Task* task) {
+	if (pool->config.done != NULL) {
+		pool->config.done(task, pool->config.user);
+	}
+
+	if (VM_AtomicAdd(&pool->active, -1) == 0) {
+		VM_LockMutex(&pool->mutex);
+		VM_BroadcastCond(&pool->done);
+		VM_UnlockMutex(&pool->mutex);
+	}
+}
+
+static void VM_RunSlice(struct VM_Worker* worker, struct VM_Task* task) {
+	struct VM_Pool* pool = worker->pool;
+	struct IL_VirtualMachine* vm = &task->vm;
+
+	// Fuel a slice doesn't use up is kept, a block costing more than the budget runs once enough is saved
+	uint64_t steps = vm->steps;
+	VM_AddFuel(vm, pool->config.budget);
+	VM_Resume(vm);
+
+	double start = VM_GetTime();
+	VM_Execute(vm, pool->program, pool->config.engine);
+
+	worker->stats.busy += VM_GetTime() - start;
+	worker->stats.steps += vm->steps - steps;
+	worker->stats.slices += 1;
+	task->slices += 1;
+
+	if (vm->suspend == VM_SUSPEND_NONE) {
+		VM_FinishTask(pool, task);
+		return;
+	}
+
+	// VM_WakeTask queues it once the call completes, unless that already happened
+	if (vm->suspend == VM_SUSPEND_HOST_CALL) {
+		worker->stats.suspends += 1;
+		if (!VM_ParkHostCall(vm)) {
+			return;
+		}
+	}
+
+	// Back of the line, behind everything queued while it ran
+	if (!VM_PushTask(&worker->queue, task)) {
+		VM_PushShared(pool, task);
+		return;
+	}
+
+	if (VM_AtomicLoad(&pool->sleeping) > 0 && VM_GetQueueLength(&worker->queue) > 1) {
+		VM_SignalCond(&pool->work);
+	}
+}
+
+// Called by the host completing a call, on any thread
+static void VM_WakeTask(struct IL_VirtualMachine* vm, void* user) {
+	struct VM_Task* task = (struct VM_Task*)((uint8_t*)vm - offsetof(struct VM_Task, vm));
+	VM_PushShared(user, task);
+}
+
+static void VM_RunWorker(void* context) {
+	struct VM_Worker* worker = context;
+	struct VM_Pool* pool = worker->pool;
+
+	for (;;) {
+		if (VM_AtomicLoad(&pool->shared_count) > 0) {
+			VM_RefillQueue(worker);
+		}
+
+		struct VM_Task* task = VM_TakeTask(&worker->queue);
+		if (task == NULL) {
+			task = VM_StealTask(worker);
+		}
+
+		if (task != NULL) {
+			VM_RunSlice(worker, task);
+			continue;
+		}
+
+		VM_LockMutex(&pool->mutex);
+		if (pool->stop) {
+			VM_UnlockMutex(&pool->mutex);
+			break;
+		}
+
+		if (pool->shared_first == NULL) {
+			VM_AtomicAdd(&pool->sleeping, 1);
+			VM_WaitCond(&pool->work, &pool->mutex, VM_POOL_IDLE_WAIT_MS);
+			VM_AtomicAdd(&pool->sleeping, -1);
+		}
+
+		VM_UnlockMutex(&pool->mutex);
+	}
+}
+
+bool VM_InitTask(struct VM_Task* task, const struct VM_Program* program, size_t memory_size, size_t stack_size) {
+	memset(task, 0, sizeof(*task));
+	if (!VM_CreateMemory(&task->memory, memory_size, stack_size)) {
+		return false;
+	}
+
+	VM_ResetTask(task, program);
+	return true;
+}
+
+void VM_ResetTask(struct VM_Task* task, const struct VM_Program* program) {
+	VM_Init(&task->vm);
+	VM_SetFuel(&task->vm, 0);
+	task->vm.memory = &task->memory;
+	task->vm.ip = (uint64_t)program->base;
+	task->vm.sp = task->memory.stack_top;
+	task->slices = 0;
+}
+
+void VM_FreeTask(struct VM_Task* task) {
+	VM_FreeMemory(&task->memory);
+}
+
+struct VM_Pool* VM_CreatePool(const struct VM_Program* program, const struct VM_PoolConfig* config) {
+	struct VM_Pool* pool = calloc(1, sizeof(struct VM_Pool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->program = program;
+	pool->config = *config;
+	pool->worker_count = config->workers != 0 ? config->workers : VM_GetCoreCount();
+
+	if (pool->config.budget == 0) {
+		pool->config.budget = VM_POOL_DEFAULT_BUDGET;
+	}
+
+	// The JIT state, compiling included, isn't shared safely between threads
+	if (pool->config.engine == VM_ENGINE_JIT) {
+		pool->config.engine = VM_ENGINE_THREADED;
+	}
+
+	VM_InitMutex(&pool->mutex);
+	VM_InitCond(&pool->work);
+	VM_InitCond(&pool->done);
+
+	// Aligned for the run queue counters, each on its own cache line
+#ifdef _MSC_VER
+	pool->workers = _aligned_malloc(pool->worker_count * sizeof(struct VM_Worker), 64);
+#else
+	pool->workers = aligned_alloc(64, pool->worker_count * sizeof(struct VM_Worker));
+#endif
+	if (pool->workers == NULL) {
+		VM_FreePool(pool);
+		return NULL;
+	}
+
+	memset(pool->workers, 0, pool->worker_count * sizeof(struct VM_Worker));
+
+	for (uint32_t i = 0; i < pool->worker_count; ++i) {
+		struct VM_Worker* worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->index = i;
+		worker->seed = 2463534242u + i * 7919u;
+	}
+
+	// Started once every queue is initialized, they steal from each other
+	for (uint32_t i = 0; i < pool->worker_count; ++i) {
+		if (!VM_StartThread(&pool->workers[i].thread, VM_RunWorker, &pool->workers[i])) {
+			pool->worker_count = i;
+			VM_FreePool(pool);
+			return NULL;
+		}
+	}
+
+	return pool;
+}
+
+void VM_FreePool(struct VM_Pool* pool) {
+	VM_LockMutex(&pool->mutex);
+	pool->stop = true;
+	VM_BroadcastCond(&pool->work);
+	VM_UnlockMutex(&pool->mutex);
+
+	for (uint32_t i = 0; pool->workers != NULL && i < pool->worker_count; ++i) {
+		VM_JoinThread(&pool->workers[i].thread);
+	}
+
+#ifdef _MSC_VER
+	_aligned_free(pool->workers);
+#else
+	free(pool->workers);
+#endif
+
+	VM_FreeCond(&pool->done);
+	VM_FreeCond(&pool->work);
+	VM_FreeMutex(&pool->mutex);
+	free(pool);
+}
+
+void VM_SubmitTask(struct VM_Pool* pool, struct VM_Task* task) {
+	task->vm.wake = VM_WakeTask;
+	task->vm.wake_user = pool;
+
+	VM_AtomicAdd(&pool->active, 1);
+	VM_PushShared(pool, task);
+}
+
+void VM_WaitPool(struct VM_Pool* pool) {
+	VM_LockMutex(&pool->mutex);
+	while (VM_AtomicLoad(&pool->active) > 0) {
+		VM_WaitCond(&pool->done, &pool->mutex, 100);
+	}
+
+	VM_UnlockMutex(&pool->mutex);
+}
+
+uint32_t VM_GetPoolWorkerCount(const struct VM_Pool* pool) {
+	return pool->worker_count;
+}
+
+void VM_GetWorkerStats(const struct VM_Pool* pool, uint32_t worker, struct VM_WorkerStats* stats) {
+	*stats = pool->workers[worker].stats;
+}
+
+void VM_PrintPoolStats(const struct VM_Pool* pool, double seconds) {
+	uint64_t steps = 0;
+	uint64_t suspends = 0;
+	for (uint32_t i = 0; i < pool->worker_count; ++i) {
+		steps += pool->workers[i].stats.steps;
+		suspends += pool->workers[i].stats.suspends;
+	}
+
+	printf("============== POOL STATS ==============\n");
+	printf("Workers: %u, %llu insns per slice\n", pool->worker_count, (unsigned long long)pool->config.budget);
+	printf("Total: %llu insns in %.3f ms, %.0f insns/s\n", (unsigned long long)steps, seconds * 1e3, seconds > 0 ? (double)steps / seconds : 0);
+	if (suspends > 0) {
+		printf("Host calls: %llu pending\n", (unsigned long long)suspends);
+	}
+
+	for (uint32_t i = 0; i < pool->worker_count; ++i) {
+		const struct VM_WorkerStats* stats = &pool->workers[i].stats;
+		printf("Worker %u: %llu insns, %llu slices, %llu steals, %5.1f%% busy\n", i,
+			(unsigned long long)stats->steps, (unsigned long long)stats->slices, (unsigned long long)stats->steals,
+			seconds > 0 ? stats->busy * 100.0 / seconds : 0);
+	}
+
+	printf("=======================================\n");
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "vm.h"
+#include "decoder.h"
+#include "memory.h"
+
+// Runs many VMs of one program on a fixed set of worker threads. Each worker owns a run queue,
+// runs a task for one slice of budget instructions and puts it back at the end of its queue
+// unless it halted. Idle workers steal from the front of the other queues. A task whose host
+// call is pending is left out of the queues until the call completes, see host.h.
+
+// Slots per worker queue, tasks past it go through the shared queue
+#define VM_POOL_QUEUE_SIZE 1024
+
+#define VM_POOL_DEFAULT_BUDGET 100000
+
+struct VM_Pool;
+struct VM_Task;
+
+typedef void (*VM_TaskDoneFn_t)(struct VM_Task* task, void* user);
+
+// Owned by the caller until the done callback, submitted once
+struct VM_Task {
+	struct IL_VirtualMachine vm;
+	struct VM_Memory memory;
+	uint64_t slices; // Times it was scheduled
+	void* user;
+
+	struct VM_Task* next; // Link in the shared queue
+};
+
+struct VM_PoolConfig {
+	uint32_t workers; // 0 for one per core
+	uint64_t budget; // Fuel added per slice
+	enum VM_Engine engine; // Table or threaded, the JIT state isn't shared between workers
+
+	// Called on the worker that ran the last slice
+	VM_TaskDoneFn_t done;
+	void* user;
+};
+
+struct VM_WorkerStats {
+	uint64_t steps;
+	uint64_t slices;
+	uint64_t steals;
+	uint64_t suspends; // Slices that ended on a pending host call
+	double busy; // Seconds spent in VM_Execute
+};
+
+// Sets up the VM at the start of program with its own guest memory, without fuel
+bool VM_InitTask(struct VM_Task* task, const struct VM_Program* program, size_t memory_size, size_t stack_size);
+
+// Puts a task that's done back at the start of program to be submitted again, its guest memory is kept as is
+void VM_ResetTask(struct VM_Task* task, const struct VM_Program* program);
+void VM_FreeTask(struct VM_Task* task);
+
+struct VM_Pool* VM_CreatePool(const struct VM_Program* program, const struct VM_PoolConfig* config);
+void VM_FreePool(struct VM_Pool* pool);
+
+// Thread safe, can be called from done callbacks
+void VM_SubmitTask(struct VM_Pool* pool, struct VM_Task* task);
+
+// Waits until every submitted task is done
+void VM_WaitPool(struct VM_Pool* pool);
+
+uint32_t VM_GetPoolWorkerCount(const struct VM_Pool* pool);
+void VM_GetWorkerStats(const struct VM_Pool* pool, uint32_t worker, struct VM_WorkerStats* stats);
+void VM_PrintPoolStats(const struct VM_Pool* pool, double seconds);
@@ -0,0 +1,376 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "il.h"
+#include "vm.h"
+#include "decoder.h"
+#include "memory.h"
+#include "host.h"
+#include "debuginfo.h"
+#include "profiler.h"
+
+// Functions listed by VM_PrintProfile
+#define VM_PROFILE_TOP 16
+
+#define VM_PROFILE_INITIAL_STACKS 256
+#define VM_PROFILE_INITIAL_FRAMES 4096
+
+bool VM_InitProfiler(struct VM_Profiler* profiler, const struct VM_Program* program, uint64_t period) {
+	memset(profiler, 0, sizeof(*profiler));
+	profiler->program = program;
+	profiler->period = period > 0 ? period : VM_PROFILE_DEFAULT_PERIOD;
+
+	profiler->stack_capacity = VM_PROFILE_INITIAL_STACKS;
+	profiler->stacks = calloc(profiler->stack_capacity, sizeof(struct VM_ProfileStack));
+	profiler->frame_capacity = VM_PROFILE_INITIAL_FRAMES;
+	profiler->frames = malloc(profiler->frame_capacity * sizeof(uint32_t));
+	return profiler->stacks != NULL && profiler->frames != NULL;
+}
+
+void VM_FreeProfiler(struct VM_Profiler* profiler) {
+	free(profiler->stacks);
+	free(profiler->frames);
+	memset(profiler, 0, sizeof(*profiler));
+}
+
+static const struct VM_DebugSymbol* VM_FindProfileSymbol(const struct VM_Profiler* profiler, uint64_t offset) {
+	return profiler->program->debug != NULL ? VM_FindDebugSymbol(profiler->program->debug, offset) : NULL;
+}
+
+static void VM_FormatProfileFrame(const struct VM_Profiler* profiler, uint32_t frame, char* buffer, size_t size) {
+	if (frame == VM_PROFILE_FRAME_INDIRECT) {
+		snprintf(buffer, size, "[indirect]");
+		return;
+	}
+
+	if (frame == VM_PROFILE_FRAME_TRUNCATED) {
+		snprintf(buffer, size, "[truncated]");
+		return;
+	}
+
+	uint32_t offset = frame & ~VM_PROFILE_FRAME_LABEL;
+	const struct VM_DebugSymbol* symbol = VM_FindProfileSymbol(profiler, offset);
+
+	// Leaf frames are the sampled instruction when there are lines, named after its label and line
+	if (frame & VM_PROFILE_FRAME_LABEL) {
+		uint32_t line = VM_FindDebugLine(profiler->program->debug, offset);
+		if (line != 0 && symbol != NULL) {
+			snprintf(buffer, size, "@%s:%u", symbol->name, line);
+		}
+		else if (line != 0) {
+			snprintf(buffer, size, "line %u", line);
+		}
+		else {
+			snprintf(buffer, size, "@%s", symbol != NULL ? symbol->name : "?");
+		}
+	}
+	else if (symbol != NULL && symbol->offset == offset) {
+		snprintf(buffer, size, "%s", symbol->name);
+	}
+	else if (offset == 0) {
+		snprintf(buffer, size, "[entry]");
+	}
+	else {
+		snprintf(buffer, size, "sub_%x", offset);
+	}
+}
+
+// Offset of the function a return address goes back from, a CALL has to be right before it
+static bool VM_GetReturnTarget(const struct VM_Program* program, uint64_t address, uint32_t* target) {
+	uint64_t offset = address - (uint64_t)program->base;
+	if (offset == 0 || offset >= program->size || program->map[offset] == VM_CODE_INVALID || program->map[offset] == 0) {
+		return false;
+	}
+
+	// Codes follow the raw image, the one before is the previous instruction
+	const struct VM_DecodedCode* call = &program->codes[program->map[offset] - 1];
+	if (call->mnemonic != IL_MNEMONIC_CALL || call->size > offset) {
+		return false;
+	}
+
+	const struct VM_DecodedOperand* op = &call->ops[0];
+	if (op->type != IL_OPERAND_TYPE_IMMEDIATE) {
+		*target = VM_PROFILE_FRAME_INDIRECT;
+		return true;
+	}
+
+	*target = (uint32_t)(offset - call->size + op->value);
+	return true;
+}
+
+static uint64_t VM_HashFrames(const uint32_t* frames, uint32_t depth) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (uint32_t i = 0; i < depth; ++i) {
+		hash = (hash ^ frames[i]) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+static bool VM_GrowProfileStacks(struct VM_Profiler* profiler) {
+	size_t capacity = profiler->stack_capacity * 2;
+	struct VM_ProfileStack* stacks = calloc(capacity, sizeof(struct VM_ProfileStack));
+	if (stacks == NULL) {
+		return false;
+	}
+
+	for (size_t i = 0; i < profiler->stack_capacity; ++i) {
+		const struct VM_ProfileStack* stack = &profiler->stacks[i];
+		if (stack->samples == 0) {
+			continue;
+		}
+
+		size_t slot = stack->hash & (capacity - 1);
+		while (stacks[slot].samples != 0) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+
+		stacks[slot] = *stack;
+	}
+
+	free(profiler->stacks);
+	profiler->stacks = stacks;
+	profiler->stack_capacity = capacity;
+	return true;
+}
+
+static void VM_AddProfileStack(struct VM_Profiler* profiler, const uint32_t* frames, uint32_t depth) {
+	uint64_t hash = VM_HashFrames(frames, depth);
+	size_t mask = profiler->stack_capacity - 1;
+
+	size_t slot = hash & mask;
+	for (; profiler->stacks[slot].samples != 0; slot = (slot + 1) & mask) {
+		struct VM_ProfileStack* stack = &profiler->stacks[slot];
+		if (stack->hash == hash && stack->depth == depth && memcmp(&profiler->frames[stack->frames], frames, depth * sizeof(uint32_t)) == 0) {
+			stack->samples += 1;
+			return;
+		}
+	}
+
+	if (profiler->frame_count + depth > profiler->frame_capacity) {
+		size_t capacity = profiler->frame_capacity * 2 + depth;
+		uint32_t* grown = realloc(profiler->frames, capacity * sizeof(uint32_t));
+		if (grown == NULL) {
+			return;
+		}
+
+		profiler->frames = grown;
+		profiler->frame_capacity = capacity;
+	}
+
+	struct VM_ProfileStack* stack = &profiler->stacks[slot];
+	stack->hash = hash;
+	stack->frames = profiler->frame_count;
+	stack->depth = depth;
+	stack->samples = 1;
+
+	memcpy(&profiler->frames[profiler->frame_count], frames, depth * sizeof(uint32_t));
+	profiler->frame_count += depth;
+
+	// Kept at most half full
+	profiler->stack_count += 1;
+	if (profiler->stack_count * 2 > profiler->stack_capacity) {
+		VM_GrowProfileStacks(profiler);
+	}
+}
+
+void VM_SampleProfile(struct VM_Profiler* profiler, const struct IL_VirtualMachine* vm) {
+	const struct VM_Program* program = profiler->program;
+	const struct VM_Memory* memory = vm->memory;
+
+	// Innermost first, pushes can be narrower than 8 bytes so every byte is a candidate
+	uint32_t targets[VM_PROFILE_MAX_DEPTH];
+	uint32_t count = 0;
+	bool truncated = false;
+
+	// Nothing to scan when less than a return address is left below the top, the guard lies past it
+	uint64_t address = vm->sp;
+	if (memory != NULL && address >= memory->stack_committed && address < memory->stack_top && memory->stack_top - address >= sizeof(uint64_t)) {
+		uint64_t end = memory->stack_top - sizeof(uint64_t);
+		if (end - address > VM_PROFILE_MAX_SCAN) {
+			end = address + VM_PROFILE_MAX_SCAN;
+			truncated = true;
+		}
+
+		while (address <= end) {
+			uint64_t value = 0;
+			memcpy(&value, VM_TranslateAddress(memory->base, address), sizeof(value));
+
+			if (!VM_GetReturnTarget(program, value, &targets[count])) {
+				address += 1;
+				continue;
+			}
+
+			count += 1;
+			address += sizeof(value);
+			if (count == VM_PROFILE_MAX_DEPTH) {
+				truncated = address <= end;
+				break;
+			}
+		}
+	}
+
+	// Root first, the entry then the called functions from the outermost call in
+	uint32_t frames[VM_PROFILE_MAX_DEPTH + 2];
+	uint32_t depth = 0;
+
+	frames[depth++] = truncated ? VM_PROFILE_FRAME_TRUNCATED : 0;
+	for (uint32_t i = count; i > 0; --i) {
+		frames[depth++] = targets[i - 1];
+	}
+
+	uint32_t function = frames[depth - 1];
+	uint64_t offset = vm->ip - (uint64_t)program->base;
+	const struct VM_DebugInfo* debug = program->debug;
+
+	if (offset < program->size && debug != NULL && debug->line_count > 0) {
+		frames[depth++] = (uint32_t)offset | VM_PROFILE_FRAME_LABEL;
+	}
+	else {
+		const struct VM_DebugSymbol* label = offset < program->size ? VM_FindProfileSymbol(profiler, offset) : NULL;
+		if (label != NULL && (function >= VM_PROFILE_FRAME_TRUNCATED || label->offset > function)) {
+			frames[depth++] = (uint32_t)label->offset | VM_PROFILE_FRAME_LABEL;
+		}
+	}
+
+	VM_AddProfileStack(profiler, frames, depth);
+	profiler->samples += 1;
+	profiler->truncated += truncated;
+}
+
+uint64_t VM_ExecuteProfiled(struct VM_Profiler* profiler, struct IL_VirtualMachine* vm, enum VM_Engine engine) {
+	const struct VM_Program* program = profiler->program;
+	uint64_t fuel = VM_GetFuel(vm);
+	uint64_t pending = 0;
+
+	for (;;) {
+		// A block is paid for whole when it's entered, the slice always covers the first one
+		uint64_t slice = profiler->period + VM_LookupCode(program, vm->ip)->cost;
+		bool last = fuel != VM_FUEL_UNLIMITED && slice >= fuel;
+		if (last) {
+			slice = fuel;
+		}
+
+		VM_SetFuel(vm, slice);
+		uint64_t steps = vm->steps;
+		pending += VM_ExecuteWaiting(vm, program, engine);
+
+		// Every engine stops within the slice, steps has what it ran
+		if (fuel != VM_FUEL_UNLIMITED) {
+			fuel -= vm->steps - steps;
+		}
+
+		if (vm->suspend != VM_SUSPEND_FUEL || last) {
+			break;
+		}
+
+		VM_SampleProfile(profiler, vm);
+		VM_Resume(vm);
+	}
+
+	VM_SetFuel(vm, fuel);
+	return pending;
+}
+
+struct VM_ProfileFunction {
+	uint32_t frame;
+	uint64_t self;
+	uint64_t total;
+};
+
+static struct VM_ProfileFunction* VM_FindProfileFunction(struct VM_ProfileFunction* functions, size_t* count, uint32_t frame) {
+	for (size_t i = 0; i < *count; ++i) {
+		if (functions[i].frame == frame) {
+			return &functions[i];
+		}
+	}
+
+	struct VM_ProfileFunction* function = &functions[(*count)++];
+	function->frame = frame;
+	function->self = 0;
+	function->total = 0;
+	return function;
+}
+
+static int VM_CompareProfileFunctions(const void* a, const void* b) {
+	const struct VM_ProfileFunction* left = a;
+	const struct VM_ProfileFunction* right = b;
+	return left->total > right->total ? -1 : left->total < right->total;
+}
+
+void VM_PrintProfile(const struct VM_Profiler* profiler) {
+	printf("================ PROFILE ===============\n");
+	printf("Samples: %llu, one every %llu instructions, %llu truncated\n", (unsigned long long)profiler->samples,
+		(unsigned long long)profiler->period, (unsigned long long)profiler->truncated);
+
+	if (profiler->samples == 0) {
+		printf("=======================================\n");
+		return;
+	}
+
+	// Every frame is at most a function of its own
+	struct VM_ProfileFunction* functions = malloc(profiler->frame_count * sizeof(struct VM_ProfileFunction));
+	if (functions == NULL) {
+		return;
+	}
+
+	size_t count = 0;
+	for (size_t i = 0; i < profiler->stack_capacity; ++i) {
+		const struct VM_ProfileStack* stack = &profiler->stacks[i];
+		if (stack->samples == 0) {
+			continue;
+		}
+
+		const uint32_t* frames = &profiler->frames[stack->frames];
+		uint32_t depth = stack->depth;
+		if (frames[depth - 1] & VM_PROFILE_FRAME_LABEL && frames[depth - 1] < VM_PROFILE_FRAME_TRUNCATED) {
+			depth -= 1;
+		}
+
+		VM_FindProfileFunction(functions, &count, frames[depth - 1])->self += stack->samples;
+
+		// Recursive functions count once per sample
+		for (uint32_t j = 0; j < depth; ++j) {
+			bool seen = false;
+			for (uint32_t k = 0; k < j && !seen; ++k) {
+				seen = frames[k] == frames[j];
+			}
+
+			if (!seen) {
+				VM_FindProfileFunction(functions, &count, frames[j])->total += stack->samples;
+			}
+		}
+	}
+
+	qsort(functions, count, sizeof(struct VM_ProfileFunction), VM_CompareProfileFunctions);
+
+	printf("%8s %8s  %s\n", "Total", "Self", "Function");
+	for (size_t i = 0; i < count && i < VM_PROFILE_TOP; ++i) {
+		char name[128];
+		VM_FormatProfileFrame(profiler, functions[i].frame, name, sizeof(name));
+		printf("%7.1f%% %7.1f%%  %s\n", 100.0 * (double)functions[i].total / (double)profiler->samples,
+			100.0 * (double)functions[i].self / (double)profiler->samples, name);
+	}
+
+	printf("=======================================\n");
+	free(functions);
+}
+
+void VM_WriteFoldedStacks(const struct VM_Profiler* profiler, FILE* out) {
+	for (size_t i = 0; i < profiler->stack_capacity; ++i) {
+		const struct VM_ProfileStack* stack = &profiler->stacks[i];
+		if (stack->samples == 0) {
+			continue;
+		}
+
+		for (uint32_t j = 0; j < stack->depth; ++j) {
+			char name[128];
+			VM_FormatProfileFrame(profiler, profiler->frames[stack->frames + j], name, sizeof(name));
+			fprintf(out, j == 0 ? "%s" : ";%s", name);
+		}
+
+		fprintf(out, " %llu\n", (unsigned long long)stack->samples);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "vm.h"
+#include "decoder.h"
+
+// Instructions between samples, prime so loops don't line up with it
+#define VM_PROFILE_DEFAULT_PERIOD 10007
+
+// Innermost frames kept per sample, deeper stacks are cut and rooted at [truncated]
+#define VM_PROFILE_MAX_DEPTH 128
+
+// Stack bytes searched for return addresses per sample
+#define VM_PROFILE_MAX_SCAN (1 << 20)
+
+// Frames are code offsets of function entries, the targets of the CALLs the stack goes through, named
+// after the program's debug info. The leaf also gets a frame for the sampled instruction when there
+// are source lines, for the label it's under when there aren't and that's not its function's entry.
+#define VM_PROFILE_FRAME_LABEL (1u << 31)
+#define VM_PROFILE_FRAME_INDIRECT UINT32_MAX // Called through a register
+#define VM_PROFILE_FRAME_TRUNCATED (UINT32_MAX - 1)
+
+// Distinct stack and how many samples hit it
+struct VM_ProfileStack {
+	uint64_t hash;
+	size_t frames; // Index in VM_Profiler::frames, root first
+	uint32_t depth;
+	uint64_t samples;
+};
+
+struct VM_Profiler {
+	const struct VM_Program* program;
+	uint64_t period;
+
+	// Open addressed, capacity is a power of two
+	struct VM_ProfileStack* stacks;
+	size_t stack_count;
+	size_t stack_capacity;
+
+	uint32_t* frames;
+	size_t frame_count;
+	size_t frame_capacity;
+
+	uint64_t samples;
+	uint64_t truncated;
+};
+
+// Samples vm->ip and the guest call stack every period instructions, on any engine. The VM is run
+// on fuel slices, the samples are taken between them so the engines don't change.
+bool VM_InitProfiler(struct VM_Profiler* profiler, const struct VM_Program* program, uint64_t period);
+void VM_FreeProfiler(struct VM_Profiler* profiler);
+
+// Records the stack vm is stopped in. Return addresses are found by scanning the guest stack for values
+// that point right after a CALL, a pushed value that happens to look like one adds a frame.
+void VM_SampleProfile(struct VM_Profiler* profiler, const struct IL_VirtualMachine* vm);
+
+// VM_ExecuteWaiting with a sample every period instructions, the fuel the VM had is kept
+uint64_t VM_ExecuteProfiled(struct VM_Profiler* profiler, struct IL_VirtualMachine* vm, enum VM_Engine engine);
+
+// Functions with the most samples, inclusive and in the function itself
+void VM_PrintProfile(const struct VM_Profiler* profiler);
+
+// One "root;...;leaf count" line per stack, what flamegraph.pl and speedscope read
+void VM_WriteFoldedStacks(const struct VM_Profiler* profiler, FILE* out);
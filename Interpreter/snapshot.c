@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "vm.h"
+#include "memory.h"
+#include "snapshot.h"
+
+bool VM_CaptureSnapshot(struct VM_Snapshot* snapshot, struct IL_VirtualMachine* vm) {
+	if (!VM_CaptureMemory(vm->memory, &snapshot->memory)) {
+		return false;
+	}
+
+	snapshot->vm = *vm;
+	snapshot->vm.memory = NULL;
+	return true;
+}
+
+bool VM_RestoreSnapshot(const struct VM_Snapshot* snapshot, struct IL_VirtualMachine* vm) {
+	struct VM_Memory* memory = vm->memory;
+	if (!VM_RestoreMemory(memory, &snapshot->memory)) {
+		return false;
+	}
+
+	*vm = snapshot->vm;
+	vm->memory = memory;
+	return true;
+}
+
+bool VM_ForkSnapshot(const struct VM_Snapshot* snapshot, struct IL_VirtualMachine* vm, struct VM_Memory* memory) {
+	if (!VM_CloneMemory(memory, &snapshot->memory)) {
+		return false;
+	}
+
+	*vm = snapshot->vm;
+	vm->memory = memory;
+	return true;
+}
+
+void VM_FreeSnapshot(struct VM_Snapshot* snapshot) {
+	VM_FreeMemorySnapshot(&snapshot->memory);
+}
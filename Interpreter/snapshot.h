@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "vm.h"
+#include "memory.h"
+
+// Full VM state at one point, guest memory included. Restoring or forking maps the snapshot
+// pages copy-on-write, the cost doesn't depend on how much memory the guest uses.
+struct VM_Snapshot {
+	struct IL_VirtualMachine vm; // memory is NULL
+	struct VM_MemorySnapshot memory;
+};
+
+// vm->memory keeps working and shares its pages with every fork
+bool VM_CaptureSnapshot(struct VM_Snapshot* snapshot, struct IL_VirtualMachine* vm);
+
+// Brings vm and its memory back to the snapshot
+bool VM_RestoreSnapshot(const struct VM_Snapshot* snapshot, struct IL_VirtualMachine* vm);
+
+// Sets up vm as a copy of the snapshot running in memory, a new guest space freed with VM_FreeMemory
+bool VM_ForkSnapshot(const struct VM_Snapshot* snapshot, struct IL_VirtualMachine* vm, struct VM_Memory* memory);
+
+void VM_FreeSnapshot(struct VM_Snapshot* snapshot);
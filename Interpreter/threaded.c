@@ -0,0 +1,170 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "il.h"
+#include "vm.h"
+#include "decoder.h"
+#include "handlers.h"
+#include "dispatch.h"
+#include "variants.h"
+
+// Labels as values are a GCC/Clang extension, everything else uses the switch fallback.
+// Define VM_THREADED_SWITCH to force the fallback.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_THREADED_SWITCH)
+#define VM_THREADED_COMPUTED_GOTO
+#endif
+
+// Slot taken when the predicate of a code doesn't hold
+#define VM_SLOT_SKIP VM_HANDLER_COUNT
+
+#define VM_THREADED_HANDLERS(X) \
+	X(SET) \
+	X(ADD) \
+	X(SUB) \
+	X(CMP) \
+	X(LOAD) \
+	X(STORE) \
+	X(BRANCH) \
+	X(MUL) \
+	X(AND) \
+	X(OR) \
+	X(XOR) \
+	X(NOT) \
+	X(SHIFTR) \
+	X(SHIFTL) \
+	X(PUSH) \
+	X(POP) \
+	X(CALL) \
+	X(RETURN) \
+	X(HALT) \
+	X(HOSTCALL) \
+	X(MEMCPY) \
+	X(MEMSET) \
+	X(MEMCMP) \
+	X(VLOAD) \
+	X(VSTORE) \
+	X(VSPLAT) \
+	X(VMASK) \
+	X(VADD) \
+	X(VSUB) \
+	X(VMUL) \
+	X(VAND) \
+	X(VOR) \
+	X(VXOR) \
+	X(VCMPEQ) \
+	X(VCMPGT) \
+	X(VSHUF)
+
+static inline uint16_t VM_SelectSlot(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	return VM_ShouldSkipCode(vm, code) ? VM_SLOT_SKIP : code->handler;
+}
+
+#ifdef VM_THREADED_COMPUTED_GOTO
+
+// Every handler ends with its own copy of the dispatch, giving the host one indirect jump per opcode
+#define VM_DISPATCH() \
+	do { \
+		if (vm->conditions & IL_CONDITIONS_HLT) { \
+			goto exit; \
+		} \
+		goto *labels[VM_SelectSlot(vm, code)]; \
+	} while (0)
+
+#define VM_LABEL(index, name) label_##name:
+#define VM_NEXT() \
+	do { \
+		code = VM_GetNextCode(vm, program, code); \
+		vm->steps += 1; \
+		VM_DISPATCH(); \
+	} while (0)
+
+#else
+
+#define VM_LABEL(index, name) case index:
+#define VM_NEXT() break
+
+#endif
+
+#define VM_HANDLER_BODY(name) \
+	VM_LABEL(IL_MNEMONIC_##name, name) \
+	VM_Handler_##name(vm, code); \
+	VM_NEXT();
+
+// Variants are inline, each label gets the specialized body itself
+#define VM_VARIANT_BODY(name, dst, dst_bits, src, src_bits, src_imm) \
+	VM_LABEL(VM_HANDLER_##name##_##dst##_##src, name##_##dst##_##src) \
+	VM_Handler_##name##_##dst##_##src(vm, code); \
+	VM_NEXT();
+
+#define VM_SIZED_BODY(name, bits) \
+	VM_LABEL(VM_HANDLER_##name##_##bits, name##_##bits) \
+	VM_Handler_##name##_##bits(vm, code); \
+	VM_NEXT();
+
+#define VM_FUSED_BODY(first, second) \
+	VM_LABEL(VM_HANDLER_##first##_##second, first##_##second) \
+	VM_Handler_##first##_##second(vm, code); \
+	VM_NEXT();
+
+static void VM_ThreadedLoop(struct IL_VirtualMachine* vm, const struct VM_Program* program) {
+	const struct VM_DecodedCode* code = VM_LookupCode(program, vm->ip);
+
+#ifdef VM_THREADED_COMPUTED_GOTO
+#define VM_LABEL_ADDRESS(name) [IL_MNEMONIC_##name] = &&label_##name,
+#define VM_VARIANT_ADDRESS(name, dst, dst_bits, src, src_bits, src_imm) [VM_HANDLER_##name##_##dst##_##src] = &&label_##name##_##dst##_##src,
+#define VM_SIZED_ADDRESS(name, bits) [VM_HANDLER_##name##_##bits] = &&label_##name##_##bits,
+#define VM_FUSED_ADDRESS(first, second) [VM_HANDLER_##first##_##second] = &&label_##first##_##second,
+	static const void* labels[VM_SLOT_SKIP + 1] = {
+		VM_THREADED_HANDLERS(VM_LABEL_ADDRESS)
+		VM_SPECIALIZED_HANDLERS(VM_VARIANT_ADDRESS)
+		VM_SIZED_HANDLERS(VM_SIZED_ADDRESS)
+		VM_FUSED_HANDLERS(VM_FUSED_ADDRESS)
+		[VM_HANDLER_BAD] = &&label_BAD,
+		[VM_SLOT_SKIP] = &&label_SKIP,
+	};
+#undef VM_LABEL_ADDRESS
+#undef VM_VARIANT_ADDRESS
+#undef VM_SIZED_ADDRESS
+#undef VM_FUSED_ADDRESS
+
+	VM_DISPATCH();
+
+	VM_THREADED_HANDLERS(VM_HANDLER_BODY)
+	VM_SPECIALIZED_HANDLERS(VM_VARIANT_BODY)
+	VM_SIZED_HANDLERS(VM_SIZED_BODY)
+	VM_FUSED_HANDLERS(VM_FUSED_BODY)
+
+label_SKIP:
+	VM_NEXT();
+
+label_BAD:
+	VM_Handler_BAD(vm, code);
+	VM_NEXT();
+
+exit:
+	return;
+#else
+	while (!VM_HasConditions(vm, IL_CONDITIONS_HLT)) {
+		switch (VM_SelectSlot(vm, code)) {
+		VM_THREADED_HANDLERS(VM_HANDLER_BODY)
+		VM_SPECIALIZED_HANDLERS(VM_VARIANT_BODY)
+		VM_SIZED_HANDLERS(VM_SIZED_BODY)
+		VM_FUSED_HANDLERS(VM_FUSED_BODY)
+		case VM_SLOT_SKIP:
+			break;
+		case VM_HANDLER_BAD:
+		default:
+			VM_Handler_BAD(vm, code);
+			break;
+		}
+
+		code = VM_GetNextCode(vm, program, code);
+		vm->steps += 1;
+	}
+#endif
+}
+
+void VM_RunThreaded(struct IL_VirtualMachine* vm, const struct VM_Program* program) {
+	VM_ThreadedLoop(vm, program);
+	VM_MaterializeConditions(vm);
+}
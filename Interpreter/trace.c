@@ -0,0 +1,58 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "il.h"
+#include "trace.h"
+#include "decoder.h"
+#include "debuginfo.h"
+
+bool VM_InitTrace(struct VM_Trace* trace, FILE* out, size_t size) {
+	assert(size > VM_TRACE_LINE_MAX);
+
+	trace->out = out;
+	trace->size = size;
+	trace->used = 0;
+	trace->buffer = malloc(size);
+	return trace->buffer != NULL;
+}
+
+void VM_FreeTrace(struct VM_Trace* trace) {
+	VM_FlushTrace(trace);
+
+	free(trace->buffer);
+	trace->buffer = NULL;
+}
+
+void VM_FlushTrace(struct VM_Trace* trace) {
+	if (trace->used > 0) {
+		fwrite(trace->buffer, 1, trace->used, trace->out);
+		fflush(trace->out);
+		trace->used = 0;
+	}
+}
+
+void VM_TraceCode(struct VM_Trace* trace, const struct VM_Program* program, uint64_t ip, bool skipped) {
+	if (trace->size - trace->used < VM_TRACE_LINE_MAX) {
+		VM_FlushTrace(trace);
+	}
+
+	char* line = trace->buffer + trace->used;
+	size_t size = VM_TRACE_LINE_MAX;
+
+	int used = 0;
+	if (program->debug != NULL) {
+		used = (int)VM_FormatLocation(program->debug, ip - (uint64_t)program->base, line, size / 2);
+		used += snprintf(line + used, size - used, ": ");
+	}
+	else {
+		used = snprintf(line, size, "%p: ", (void*)ip);
+	}
+
+	used += (int)IL_PrintCode((struct IL_Code*)ip, line + used, size - used);
+	used += snprintf(line + used, size - used, skipped ? ":(Skipped)\n" : ":\n");
+
+	trace->used += (size_t)used < size ? (size_t)used : size - 1;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+struct VM_Program;
+
+#define VM_TRACE_BUFFER_SIZE (1 << 16)
+
+// Worst case of a single formatted line, the buffer is flushed before it gets this close to full
+#define VM_TRACE_LINE_MAX 256
+
+struct VM_Trace {
+	FILE* out;
+	char* buffer;
+	size_t size;
+	size_t used;
+};
+
+bool VM_InitTrace(struct VM_Trace* trace, FILE* out, size_t size);
+void VM_FreeTrace(struct VM_Trace* trace);
+
+// Lines start with the code location when the program has debug info, the host address otherwise
+void VM_TraceCode(struct VM_Trace* trace, const struct VM_Program* program, uint64_t ip, bool skipped);
+void VM_FlushTrace(struct VM_Trace* trace);
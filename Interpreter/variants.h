@@ -0,0 +1,167 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "il.h"
+#include "vm.h"
+#include "decoder.h"
+
+// Specialized handlers are generated for every destination register width and source form,
+// the source being an immediate or a register of a given width. Handlers index VM_HANDLERS,
+// the generic ones use their mnemonic as index and the variants follow the bad code sentinel.
+
+#define VM_WIDTH_MASK(bits) (UINT64_MAX >> (64 - (bits)))
+#define VM_MIN_BITS(a, b) ((a) < (b) ? (a) : (b))
+
+// X(name, dst, dst_bits, src, src_bits, src_imm)
+#define VM_VARIANT_FORMS(X, name, dst, dst_bits) \
+	X(name, dst, dst_bits, IMM, 64, 1) \
+	X(name, dst, dst_bits, R8, 8, 0) \
+	X(name, dst, dst_bits, R16, 16, 0) \
+	X(name, dst, dst_bits, R32, 32, 0) \
+	X(name, dst, dst_bits, R64, 64, 0)
+
+#define VM_VARIANT_FORM_COUNT 5
+
+#define VM_VARIANTS(X, name) \
+	VM_VARIANT_FORMS(X, name, R8, 8) \
+	VM_VARIANT_FORMS(X, name, R16, 16) \
+	VM_VARIANT_FORMS(X, name, R32, 32) \
+	VM_VARIANT_FORMS(X, name, R64, 64)
+
+// `dst = dst op src` operations, the only place an operation has to be added to get its variants.
+// X(Y, name, expr), Y is passed through so the list can be expanded into other lists.
+#define VM_ALU_OPERATIONS(X, Y) \
+	X(Y, SET, b) \
+	X(Y, ADD, a + b) \
+	X(Y, SUB, a - b) \
+	X(Y, MUL, a * b) \
+	X(Y, AND, a & b) \
+	X(Y, OR, a | b) \
+	X(Y, XOR, a ^ b) \
+	X(Y, SHIFTR, a >> b) \
+	X(Y, SHIFTL, a << b)
+
+#define VM_ALU_VARIANTS(Y, name, expr) VM_VARIANTS(Y, name)
+
+// Every specialized handler, X(name, dst, dst_bits, src, src_bits, src_imm)
+#define VM_SPECIALIZED_HANDLERS(X) \
+	VM_ALU_OPERATIONS(VM_ALU_VARIANTS, X) \
+	VM_VARIANTS(X, CMP)
+
+// Handlers specialized on a single width, X(name, bits). LOAD and STORE on the width they move,
+// their address is read at its own width. BRANCH on the width of an immediate offset.
+#define VM_WIDTH_VARIANTS(X, name) \
+	X(name, 8) \
+	X(name, 16) \
+	X(name, 32) \
+	X(name, 64)
+
+#define VM_SIZED_HANDLERS(X) \
+	VM_WIDTH_VARIANTS(X, LOAD) \
+	VM_WIDTH_VARIANTS(X, STORE) \
+	VM_WIDTH_VARIANTS(X, BRANCH)
+
+// Superinstructions built by the fusion pass, X(first, second), see fusion.c
+#define VM_FUSED_HANDLERS(X) \
+	X(CMP, BRANCH) \
+	X(CMP, RETURN) \
+	X(SUB, CMP) \
+	X(SET, SET)
+
+#define VM_VARIANT_INDEX(name, dst, dst_bits, src, src_bits, src_imm) VM_HANDLER_##name##_##dst##_##src,
+#define VM_SIZED_INDEX(name, bits) VM_HANDLER_##name##_##bits,
+#define VM_FUSED_INDEX(first, second) VM_HANDLER_##first##_##second,
+
+enum VM_HandlerIndex {
+	VM_HANDLER_BAD = VM_MNEMONIC_BAD,
+	VM_SPECIALIZED_HANDLERS(VM_VARIANT_INDEX)
+	VM_SIZED_HANDLERS(VM_SIZED_INDEX)
+	VM_FUSED_HANDLERS(VM_FUSED_INDEX)
+	VM_HANDLER_COUNT,
+};
+
+#undef VM_VARIANT_INDEX
+#undef VM_SIZED_INDEX
+#undef VM_FUSED_INDEX
+
+// Width checked accessors for codes that got a specialized handler, used where the width is only known at runtime
+static inline uint64_t VM_LoadDestination(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op) {
+	return vm->regs[op->reg] & VM_WIDTH_MASK(op->size * 8);
+}
+
+static inline uint64_t VM_LoadSource(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op, uint8_t size) {
+	return op->type == IL_OPERAND_TYPE_IMMEDIATE ? op->value : vm->regs[op->reg] & VM_WIDTH_MASK(size * 8);
+}
+
+static inline void VM_StoreDestination(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op, uint64_t value) {
+	uint64_t mask = VM_WIDTH_MASK(op->size * 8);
+	vm->regs[op->reg] = (vm->regs[op->reg] & ~mask) | (value & mask);
+}
+
+// Immediate sources are truncated to the destination width by the decoder
+#define VM_DEFINE_ALU_VARIANT(name, dst, dst_bits, src, src_bits, src_imm) \
+	static inline void VM_Handler_##name##_##dst##_##src(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) { \
+		uint64_t* reg0 = &vm->regs[code->ops[0].reg]; \
+		uint64_t a = *reg0 & VM_WIDTH_MASK(dst_bits); \
+		uint64_t b = (src_imm) ? code->ops[1].value : vm->regs[code->ops[1].reg] & VM_WIDTH_MASK(VM_MIN_BITS(dst_bits, src_bits)); \
+		uint64_t value = VM_Operation_##name(a, b); \
+		*reg0 = (*reg0 & ~VM_WIDTH_MASK(dst_bits)) | (value & VM_WIDTH_MASK(dst_bits)); \
+	}
+
+// SET only reads b
+#define VM_DEFINE_ALU(Y, name, expr) \
+	static inline uint64_t VM_Operation_##name(uint64_t a, uint64_t b) { \
+		(void)a; \
+		return expr; \
+	} \
+	VM_VARIANTS(VM_DEFINE_ALU_VARIANT, name)
+
+#define VM_DEFINE_CMP_VARIANT(name, dst, dst_bits, src, src_bits, src_imm) \
+	static inline void VM_Handler_##name##_##dst##_##src(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) { \
+		uint64_t a = vm->regs[code->ops[0].reg] & VM_WIDTH_MASK(dst_bits); \
+		uint64_t b = (src_imm) ? code->ops[1].value : vm->regs[code->ops[1].reg] & VM_WIDTH_MASK(src_bits); \
+		VM_SetCompare(vm, a, b); \
+	}
+
+// Operands of any of the widths the decoder picks a variant for, immediates included
+static inline uint64_t VM_LoadOperand(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op) {
+	uint64_t value = op->type == IL_OPERAND_TYPE_IMMEDIATE ? op->value : vm->regs[op->reg];
+	return value & VM_WIDTH_MASK(op->size * 8);
+}
+
+// Unchecked like VM_ReadMemoryValue, the guard regions catch what's out of range
+#define VM_DEFINE_LOAD_VARIANT(name, bits) \
+	static inline void VM_Handler_LOAD_##bits(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) { \
+		uint64_t* reg0 = &vm->regs[code->ops[0].reg]; \
+		uint64_t value = 0; \
+		memcpy(&value, VM_TranslateAddress(vm->memory->base, VM_LoadOperand(vm, &code->ops[1])), (bits) / 8); \
+		*reg0 = (*reg0 & ~VM_WIDTH_MASK(bits)) | value; \
+	}
+
+#define VM_DEFINE_STORE_VARIANT(name, bits) \
+	static inline void VM_Handler_STORE_##bits(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) { \
+		uint64_t value = VM_LoadOperand(vm, &code->ops[1]); \
+		memcpy(VM_TranslateAddress(vm->memory->base, VM_LoadOperand(vm, &code->ops[0])), &value, (bits) / 8); \
+	}
+
+// Offsets are relative to the branch, IP isn't incremented after it
+#define VM_DEFINE_BRANCH_VARIANT(name, bits) \
+	static inline void VM_Handler_BRANCH_##bits(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) { \
+		vm->ip += code->ops[0].value & VM_WIDTH_MASK(bits); \
+		vm->conditions &= ~IL_CONDITIONS_NI; \
+	}
+
+VM_ALU_OPERATIONS(VM_DEFINE_ALU, _)
+VM_VARIANTS(VM_DEFINE_CMP_VARIANT, CMP)
+VM_WIDTH_VARIANTS(VM_DEFINE_LOAD_VARIANT, LOAD)
+VM_WIDTH_VARIANTS(VM_DEFINE_STORE_VARIANT, STORE)
+VM_WIDTH_VARIANTS(VM_DEFINE_BRANCH_VARIANT, BRANCH)
+
+#undef VM_DEFINE_ALU
+#undef VM_DEFINE_ALU_VARIANT
+#undef VM_DEFINE_CMP_VARIANT
+#undef VM_DEFINE_LOAD_VARIANT
+#undef VM_DEFINE_STORE_VARIANT
+#undef VM_DEFINE_BRANCH_VARIANT
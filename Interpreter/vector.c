@@ -0,0 +1,350 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "vector.h"
+
+#if defined(VM_VECTOR_AVX2)
+#include <immintrin.h>
+#elif defined(VM_VECTOR_SSE2)
+#include <emmintrin.h>
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#endif
+#if defined(__SSE4_2__) || defined(__AVX__)
+#include <nmmintrin.h>
+#endif
+#endif
+
+// pshufb and the 64 bit compares came after SSE2, they're emulated or left to lane loops without them
+#if defined(__SSSE3__) || defined(__AVX__)
+#define VM_VECTOR_SSSE3
+#endif
+
+#if defined(__SSE4_2__) || defined(__AVX__)
+#define VM_VECTOR_SSE42
+#endif
+
+// Lanes are little endian like the registers
+static inline uint64_t VM_ReadLane(const uint8_t* data, uint8_t lane) {
+	uint64_t value = 0;
+	memcpy(&value, data, lane);
+	return value;
+}
+
+static inline void VM_WriteLane(uint8_t* data, uint64_t value, uint8_t lane) {
+	memcpy(data, &value, lane);
+}
+
+#define VM_LANE_LOOP(dst, src, size, lane, expr) \
+	for (size_t i = 0; i < (size); i += (lane)) { \
+		uint64_t a = VM_ReadLane((dst) + i, (lane)); \
+		uint64_t b = VM_ReadLane((src) + i, (lane)); \
+		VM_WriteLane((dst) + i, (expr), (lane)); \
+	}
+
+#if defined(VM_VECTOR_SSE2)
+
+static inline __m128i VM_Load128(const uint8_t* data) { return _mm_loadu_si128((const __m128i*)data); }
+static inline void VM_Store128(uint8_t* data, __m128i value) { _mm_storeu_si128((__m128i*)data, value); }
+
+static inline __m128i VM_Add128(__m128i a, __m128i b, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm_add_epi8(a, b);
+	case 2: return _mm_add_epi16(a, b);
+	case 4: return _mm_add_epi32(a, b);
+	default: return _mm_add_epi64(a, b);
+	}
+}
+
+static inline __m128i VM_Sub128(__m128i a, __m128i b, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm_sub_epi8(a, b);
+	case 2: return _mm_sub_epi16(a, b);
+	case 4: return _mm_sub_epi32(a, b);
+	default: return _mm_sub_epi64(a, b);
+	}
+}
+
+// There's only a 16 bit multiply and a 32 to 64 bit one, the other widths are built from them
+static inline __m128i VM_Mul128(__m128i a, __m128i b, uint8_t lane) {
+	switch (lane) {
+	case 1: {
+		__m128i even = _mm_mullo_epi16(a, b);
+		__m128i odd = _mm_mullo_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		return _mm_or_si128(_mm_and_si128(even, _mm_set1_epi16(0xFF)), _mm_slli_epi16(odd, 8));
+	}
+	case 2:
+		return _mm_mullo_epi16(a, b);
+	case 4: {
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+	default: {
+		__m128i low = _mm_mul_epu32(a, b);
+		__m128i cross = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), b), _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+		return _mm_add_epi64(low, _mm_slli_epi64(cross, 32));
+	}
+	}
+}
+
+static inline __m128i VM_CompareEqual128(__m128i a, __m128i b, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm_cmpeq_epi8(a, b);
+	case 2: return _mm_cmpeq_epi16(a, b);
+	case 4: return _mm_cmpeq_epi32(a, b);
+	default: {
+		// Both halves have to match
+		__m128i equal = _mm_cmpeq_epi32(a, b);
+		return _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+	}
+	}
+}
+
+// The compares are signed, flipping the top bit of both sides makes them unsigned
+static inline __m128i VM_CompareGreater128(__m128i a, __m128i b, uint8_t lane) {
+	switch (lane) {
+	case 1: {
+		__m128i bias = _mm_set1_epi8((char)0x80);
+		return _mm_cmpgt_epi8(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+	}
+	case 2: {
+		__m128i bias = _mm_set1_epi16((short)0x8000);
+		return _mm_cmpgt_epi16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+	}
+	case 4: {
+		__m128i bias = _mm_set1_epi32((int)0x80000000);
+		return _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+	}
+	default: {
+#if defined(VM_VECTOR_SSE42)
+		__m128i bias = _mm_set1_epi64x(INT64_MIN);
+		return _mm_cmpgt_epi64(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+#else
+		// Greater high halves, or equal ones and greater low halves
+		__m128i bias = _mm_set1_epi32((int)0x80000000);
+		__m128i greater = _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+		__m128i equal = _mm_cmpeq_epi32(a, b);
+		__m128i high_greater = _mm_shuffle_epi32(greater, _MM_SHUFFLE(3, 3, 1, 1));
+		__m128i low_greater = _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0));
+		__m128i high_equal = _mm_shuffle_epi32(equal, _MM_SHUFFLE(3, 3, 1, 1));
+		return _mm_or_si128(high_greater, _mm_and_si128(high_equal, low_greater));
+#endif
+	}
+	}
+}
+
+static inline __m128i VM_Splat128(uint64_t value, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm_set1_epi8((char)value);
+	case 2: return _mm_set1_epi16((short)value);
+	case 4: return _mm_set1_epi32((int)value);
+	default: return _mm_set1_epi64x((long long)value);
+	}
+}
+
+#endif
+
+#if defined(VM_VECTOR_AVX2)
+
+static inline __m256i VM_Load256(const uint8_t* data) { return _mm256_loadu_si256((const __m256i*)data); }
+static inline void VM_Store256(uint8_t* data, __m256i value) { _mm256_storeu_si256((__m256i*)data, value); }
+
+static inline __m256i VM_Add256(__m256i a, __m256i b, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm256_add_epi8(a, b);
+	case 2: return _mm256_add_epi16(a, b);
+	case 4: return _mm256_add_epi32(a, b);
+	default: return _mm256_add_epi64(a, b);
+	}
+}
+
+static inline __m256i VM_Sub256(__m256i a, __m256i b, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm256_sub_epi8(a, b);
+	case 2: return _mm256_sub_epi16(a, b);
+	case 4: return _mm256_sub_epi32(a, b);
+	default: return _mm256_sub_epi64(a, b);
+	}
+}
+
+static inline __m256i VM_Mul256(__m256i a, __m256i b, uint8_t lane) {
+	switch (lane) {
+	case 1: {
+		__m256i even = _mm256_mullo_epi16(a, b);
+		__m256i odd = _mm256_mullo_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+		return _mm256_or_si256(_mm256_and_si256(even, _mm256_set1_epi16(0xFF)), _mm256_slli_epi16(odd, 8));
+	}
+	case 2:
+		return _mm256_mullo_epi16(a, b);
+	case 4:
+		return _mm256_mullo_epi32(a, b);
+	default: {
+		__m256i low = _mm256_mul_epu32(a, b);
+		__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+		return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+	}
+	}
+}
+
+static inline __m256i VM_CompareEqual256(__m256i a, __m256i b, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm256_cmpeq_epi8(a, b);
+	case 2: return _mm256_cmpeq_epi16(a, b);
+	case 4: return _mm256_cmpeq_epi32(a, b);
+	default: return _mm256_cmpeq_epi64(a, b);
+	}
+}
+
+static inline __m256i VM_CompareGreater256(__m256i a, __m256i b, uint8_t lane) {
+	switch (lane) {
+	case 1: {
+		__m256i bias = _mm256_set1_epi8((char)0x80);
+		return _mm256_cmpgt_epi8(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+	}
+	case 2: {
+		__m256i bias = _mm256_set1_epi16((short)0x8000);
+		return _mm256_cmpgt_epi16(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+	}
+	case 4: {
+		__m256i bias = _mm256_set1_epi32((int)0x80000000);
+		return _mm256_cmpgt_epi32(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+	}
+	default: {
+		__m256i bias = _mm256_set1_epi64x(INT64_MIN);
+		return _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+	}
+	}
+}
+
+static inline __m256i VM_Splat256(uint64_t value, uint8_t lane) {
+	switch (lane) {
+	case 1: return _mm256_set1_epi8((char)value);
+	case 2: return _mm256_set1_epi16((short)value);
+	case 4: return _mm256_set1_epi32((int)value);
+	default: return _mm256_set1_epi64x((long long)value);
+	}
+}
+
+#endif
+
+// A whole view per instruction with AVX2, 16 bytes at a time with SSE2, lane by lane otherwise
+#if defined(VM_VECTOR_AVX2)
+#define VM_VECTOR_BINARY(name, simd, scalar) \
+	void VM_Vector##name(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane) { \
+		if (size == 32) { \
+			VM_Store256(dst, simd##256(VM_Load256(dst), VM_Load256(src), lane)); \
+			return; \
+		} \
+		VM_Store128(dst, simd##128(VM_Load128(dst), VM_Load128(src), lane)); \
+	}
+#elif defined(VM_VECTOR_SSE2)
+#define VM_VECTOR_BINARY(name, simd, scalar) \
+	void VM_Vector##name(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane) { \
+		for (size_t i = 0; i < size; i += 16) { \
+			VM_Store128(dst + i, simd##128(VM_Load128(dst + i), VM_Load128(src + i), lane)); \
+		} \
+	}
+#else
+#define VM_VECTOR_BINARY(name, simd, scalar) \
+	void VM_Vector##name(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane) { \
+		VM_LANE_LOOP(dst, src, size, lane, scalar) \
+	}
+#endif
+
+#if defined(VM_VECTOR_SSE2)
+// Lanes don't matter to the bitwise operations
+static inline __m128i VM_And128(__m128i a, __m128i b, uint8_t lane) { (void)lane; return _mm_and_si128(a, b); }
+static inline __m128i VM_Or128(__m128i a, __m128i b, uint8_t lane) { (void)lane; return _mm_or_si128(a, b); }
+static inline __m128i VM_Xor128(__m128i a, __m128i b, uint8_t lane) { (void)lane; return _mm_xor_si128(a, b); }
+#endif
+
+#if defined(VM_VECTOR_AVX2)
+static inline __m256i VM_And256(__m256i a, __m256i b, uint8_t lane) { (void)lane; return _mm256_and_si256(a, b); }
+static inline __m256i VM_Or256(__m256i a, __m256i b, uint8_t lane) { (void)lane; return _mm256_or_si256(a, b); }
+static inline __m256i VM_Xor256(__m256i a, __m256i b, uint8_t lane) { (void)lane; return _mm256_xor_si256(a, b); }
+#endif
+
+VM_VECTOR_BINARY(Add, VM_Add, a + b)
+VM_VECTOR_BINARY(Sub, VM_Sub, a - b)
+VM_VECTOR_BINARY(Mul, VM_Mul, a * b)
+VM_VECTOR_BINARY(And, VM_And, a & b)
+VM_VECTOR_BINARY(Or, VM_Or, a | b)
+VM_VECTOR_BINARY(Xor, VM_Xor, a ^ b)
+VM_VECTOR_BINARY(CompareEqual, VM_CompareEqual, a == b ? UINT64_MAX : 0)
+VM_VECTOR_BINARY(CompareGreater, VM_CompareGreater, a > b ? UINT64_MAX : 0)
+
+#undef VM_VECTOR_BINARY
+
+void VM_VectorShuffle(uint8_t* dst, const uint8_t* indices, size_t size) {
+#if defined(VM_VECTOR_AVX2)
+	if (size == 32) {
+		VM_Store256(dst, _mm256_shuffle_epi8(VM_Load256(dst), VM_Load256(indices)));
+		return;
+	}
+
+	VM_Store128(dst, _mm_shuffle_epi8(VM_Load128(dst), VM_Load128(indices)));
+#elif defined(VM_VECTOR_SSSE3)
+	for (size_t i = 0; i < size; i += 16) {
+		VM_Store128(dst + i, _mm_shuffle_epi8(VM_Load128(dst + i), VM_Load128(indices + i)));
+	}
+#else
+	uint8_t table[32];
+	memcpy(table, dst, size);
+	for (size_t i = 0; i < size; ++i) {
+		dst[i] = (indices[i] & 0x80) ? 0 : table[(i & ~(size_t)15) + (indices[i] & 15)];
+	}
+#endif
+}
+
+void VM_VectorSplat(uint8_t* dst, uint64_t value, size_t size, uint8_t lane) {
+#if defined(VM_VECTOR_AVX2)
+	if (size == 32) {
+		VM_Store256(dst, VM_Splat256(value, lane));
+		return;
+	}
+#endif
+
+#if defined(VM_VECTOR_SSE2)
+	__m128i splat = VM_Splat128(value, lane);
+	for (size_t i = 0; i < size; i += 16) {
+		VM_Store128(dst + i, splat);
+	}
+#else
+	for (size_t i = 0; i < size; i += lane) {
+		VM_WriteLane(dst + i, value, lane);
+	}
+#endif
+}
+
+uint32_t VM_VectorMask(const uint8_t* src, size_t size, uint8_t lane) {
+	// Top bit of every byte first, then the last byte of each lane is kept
+	uint32_t bytes = 0;
+#if defined(VM_VECTOR_AVX2)
+	if (size == 32) {
+		bytes = (uint32_t)_mm256_movemask_epi8(VM_Load256(src));
+	}
+	else {
+		bytes = (uint32_t)_mm_movemask_epi8(VM_Load128(src));
+	}
+#elif defined(VM_VECTOR_SSE2)
+	for (size_t i = 0; i < size; i += 16) {
+		bytes |= (uint32_t)_mm_movemask_epi8(VM_Load128(src + i)) << i;
+	}
+#else
+	for (size_t i = 0; i < size; ++i) {
+		bytes |= (uint32_t)(src[i] >> 7) << i;
+	}
+#endif
+
+	if (lane == 1) {
+		return bytes;
+	}
+
+	uint32_t mask = 0;
+	for (size_t i = 0; i < size / lane; ++i) {
+		mask |= ((bytes >> (i * lane + lane - 1)) & 1) << i;
+	}
+
+	return mask;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Packed kernels behind the vector codes, on the 16 or 32 bytes of a register view with lanes of 1, 2, 4
+// or 8 bytes. A 32 byte view is one AVX2 instruction, or two SSE2 ones without AVX2, and lane loops are
+// left for what neither has. Like the lockstep kernels AVX2 is picked at compile time.
+#if defined(__AVX2__)
+#define VM_VECTOR_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define VM_VECTOR_SSE2
+#endif
+
+// dst = dst op src, lane by lane
+void VM_VectorAdd(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorSub(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorMul(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorAnd(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorOr(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorXor(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorCompareEqual(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+void VM_VectorCompareGreater(uint8_t* dst, const uint8_t* src, size_t size, uint8_t lane);
+
+// Each byte of dst is replaced by the byte of its 16 byte half that indices selects, or zero if the index has its top bit set
+void VM_VectorShuffle(uint8_t* dst, const uint8_t* indices, size_t size);
+
+void VM_VectorSplat(uint8_t* dst, uint64_t value, size_t size, uint8_t lane);
+
+// Top bit of each lane, first lane in bit 0
+uint32_t VM_VectorMask(const uint8_t* src, size_t size, uint8_t lane);
@@ -0,0 +1,214 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "il.h"
+#include "verifier.h"
+
+enum VM_OperandKinds {
+	VM_OPERAND_IMMEDIATE = 1 << IL_OPERAND_TYPE_IMMEDIATE,
+	VM_OPERAND_REGISTER = 1 << IL_OPERAND_TYPE_REGISTER,
+	VM_OPERAND_ANY = VM_OPERAND_IMMEDIATE | VM_OPERAND_REGISTER,
+	VM_OPERAND_VECTOR = 1 << IL_OPERAND_TYPE_VECTOR, // Never part of ANY, scalar codes don't take vectors
+};
+
+struct VM_CodeRule {
+	uint8_t operand_count;
+	uint8_t kinds[3]; // enum VM_OperandKinds per operand
+};
+
+// What the handlers expect of each mnemonic
+static const struct VM_CodeRule VM_CODE_RULES[IL_MNEMONIC_COUNT] = {
+	[IL_MNEMONIC_SET] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_ADD] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_SUB] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_CMP] = { 2, { VM_OPERAND_ANY, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_LOAD] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_STORE] = { 2, { VM_OPERAND_ANY, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_BRANCH] = { 1, { VM_OPERAND_ANY } },
+	[IL_MNEMONIC_MUL] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_AND] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_OR] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_XOR] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_NOT] = { 1, { VM_OPERAND_REGISTER } },
+	[IL_MNEMONIC_SHIFTR] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_SHIFTL] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_PUSH] = { 1, { VM_OPERAND_ANY } },
+	[IL_MNEMONIC_POP] = { 1, { VM_OPERAND_REGISTER } },
+	[IL_MNEMONIC_CALL] = { 1, { VM_OPERAND_ANY } },
+	[IL_MNEMONIC_RETURN] = { 0 },
+	[IL_MNEMONIC_HALT] = { 0 },
+	[IL_MNEMONIC_HOSTCALL] = { 1, { VM_OPERAND_ANY } },
+	[IL_MNEMONIC_MEMCPY] = { 3, { VM_OPERAND_ANY, VM_OPERAND_ANY, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_MEMSET] = { 3, { VM_OPERAND_ANY, VM_OPERAND_ANY, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_MEMCMP] = { 3, { VM_OPERAND_ANY, VM_OPERAND_ANY, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_VLOAD] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_VSTORE] = { 2, { VM_OPERAND_ANY, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VSPLAT] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_ANY } },
+	[IL_MNEMONIC_VMASK] = { 2, { VM_OPERAND_REGISTER, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VADD] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VSUB] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VMUL] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VAND] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VOR] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VXOR] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VCMPEQ] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VCMPGT] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+	[IL_MNEMONIC_VSHUF] = { 2, { VM_OPERAND_VECTOR, VM_OPERAND_VECTOR } },
+};
+
+static bool VM_Reject(struct VM_VerifyError* error, size_t offset, const char* reason) {
+	error->offset = offset;
+	error->reason = reason;
+	return false;
+}
+
+static bool VM_IsRegisterSize(uint8_t size) {
+	return size == 1 || size == 2 || size == 4 || size == 8;
+}
+
+// Checks the operand at data + offset, sets its size
+static bool VM_VerifyOperand(const uint8_t* data, size_t size, size_t offset, size_t code_offset, uint8_t kinds, size_t* operand_size, struct VM_VerifyError* error) {
+	if (size - offset < sizeof(struct IL_Operand)) {
+		return VM_Reject(error, code_offset, "image ends inside an operand");
+	}
+
+	struct IL_Operand* op = (struct IL_Operand*)(data + offset);
+	enum IL_OperandType type = IL_GetOperandType(op);
+	uint8_t data_size = IL_GetOperandDataSize(op);
+
+	*operand_size = IL_GetOperandSize(op);
+	if (size - offset < *operand_size) {
+		return VM_Reject(error, code_offset, "image ends inside an operand");
+	}
+
+	if (type != IL_OPERAND_TYPE_IMMEDIATE && type != IL_OPERAND_TYPE_REGISTER && type != IL_OPERAND_TYPE_VECTOR) {
+		return VM_Reject(error, code_offset, "unknown operand type");
+	}
+
+	if (!(kinds & (1 << type))) {
+		switch (type) {
+		case IL_OPERAND_TYPE_REGISTER: return VM_Reject(error, code_offset, "operand can't be a register");
+		case IL_OPERAND_TYPE_VECTOR: return VM_Reject(error, code_offset, "operand can't be a vector register");
+		default: return VM_Reject(error, code_offset, "operand can't be an immediate");
+		}
+	}
+
+	if (type == IL_OPERAND_TYPE_IMMEDIATE) {
+		if (data_size == 0 || data_size > sizeof(uint64_t)) {
+			return VM_Reject(error, code_offset, "immediate must be 1 to 8 bytes");
+		}
+
+		return true;
+	}
+
+	if (type == IL_OPERAND_TYPE_VECTOR) {
+		if (data_size != sizeof(struct IL_OperandVector)) {
+			return VM_Reject(error, code_offset, "malformed vector operand");
+		}
+
+		if (IL_GetOperandVector(op)->lane > 3) {
+			return VM_Reject(error, code_offset, "vector lane size must be 1, 2, 4 or 8");
+		}
+
+		return true;
+	}
+
+	if (data_size != sizeof(struct IL_OperandRegister)) {
+		return VM_Reject(error, code_offset, "malformed register operand");
+	}
+
+	if (!VM_IsRegisterSize(IL_GetOperandRegister(op)->size)) {
+		return VM_Reject(error, code_offset, "register size must be 1, 2, 4 or 8");
+	}
+
+	return true;
+}
+
+// Checks the code at offset against its rule, sets its size
+static bool VM_VerifyCode(const uint8_t* data, size_t size, size_t offset, size_t* code_size, struct VM_VerifyError* error) {
+	if (size - offset < sizeof(struct IL_Code)) {
+		return VM_Reject(error, offset, "image ends inside a code");
+	}
+
+	struct IL_Code* code = (struct IL_Code*)(data + offset);
+	if (IL_IsBadCode(code)) {
+		return VM_Reject(error, offset, "unknown mnemonic");
+	}
+
+	const struct VM_CodeRule* rule = &VM_CODE_RULES[IL_GetCodeMnemonic(code)];
+	if (IL_GetCodeOperandCount(code) != rule->operand_count) {
+		return VM_Reject(error, offset, "wrong operand count");
+	}
+
+	*code_size = sizeof(struct IL_Code);
+	for (uint8_t i = 0; i < rule->operand_count; ++i) {
+		size_t operand_size = 0;
+		if (!VM_VerifyOperand(data, size, offset + *code_size, offset, rule->kinds[i], &operand_size, error)) {
+			return false;
+		}
+
+		*code_size += operand_size;
+	}
+
+	return true;
+}
+
+// Immediate BRANCH and CALL offsets are relative to the code
+static bool VM_VerifyTarget(const uint8_t* data, size_t size, size_t offset, const bool* boundaries, struct VM_VerifyError* error) {
+	struct IL_Code* code = (struct IL_Code*)(data + offset);
+	enum IL_Mnemonic mnemonic = IL_GetCodeMnemonic(code);
+	if (mnemonic != IL_MNEMONIC_BRANCH && mnemonic != IL_MNEMONIC_CALL) {
+		return true;
+	}
+
+	struct IL_Operand* op = IL_GetCodeOperand(code, 0);
+	if (IL_GetOperandType(op) != IL_OPERAND_TYPE_IMMEDIATE) {
+		return true;
+	}
+
+	uint64_t value = 0;
+	IL_ReadOperandData(op, &value, IL_GetOperandDataSize(op));
+
+	uint64_t target = offset + value;
+	if (target >= size || !boundaries[target]) {
+		return VM_Reject(error, offset, mnemonic == IL_MNEMONIC_BRANCH ? "branch target is not an instruction" : "call target is not an instruction");
+	}
+
+	return true;
+}
+
+bool VM_VerifyImage(const uint8_t* data, size_t size, struct VM_VerifyError* error) {
+	struct VM_VerifyError ignored;
+	if (error == NULL) {
+		error = &ignored;
+	}
+
+	if (size == 0) {
+		return VM_Reject(error, 0, "empty image");
+	}
+
+	bool* boundaries = calloc(size, sizeof(bool));
+	if (boundaries == NULL) {
+		return VM_Reject(error, 0, "out of memory");
+	}
+
+	bool verified = true;
+	for (size_t offset = 0; offset < size && verified;) {
+		size_t code_size = 0;
+		verified = VM_VerifyCode(data, size, offset, &code_size, error);
+
+		boundaries[offset] = true;
+		offset += code_size;
+	}
+
+	// Targets can point forward, they're checked once every boundary is known
+	for (size_t offset = 0; offset < size && verified; ++offset) {
+		if (boundaries[offset]) {
+			verified = VM_VerifyTarget(data, size, offset, boundaries, error);
+		}
+	}
+
+	free(boundaries);
+	return verified;
+}
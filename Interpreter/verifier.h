@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct VM_VerifyError {
+	size_t offset; // Offset of the rejected code in the image
+	const char* reason;
+};
+
+// Checks every code of an image once, handlers of a verified program don't validate anything
+bool VM_VerifyImage(const uint8_t* data, size_t size, struct VM_VerifyError* error);
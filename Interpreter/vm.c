@@ -5,25 +5,23 @@
 #include <assert.h>
 
 #include "il.h"
+#include "decoder.h"
 #include "handlers.h"
+#include "dispatch.h"
+#include "trace.h"
+#include "counters.h"
+#include "heap.h"
+#include "debuginfo.h"
 
-bool VM_HasCodeConditions(struct IL_VirtualMachine* vm, struct IL_Code* code) {
-	if (!IL_HasCodeConditions(code)) {
-		return true;
-	}
-
-	for (int condition = 0; condition < IL_CONDITIONS_COUNT; ++condition) {
-		enum IL_Conditions cond = 1 << condition;
-		if (IL_HasConditions(code->conditions, cond) && !VM_HasConditions(vm, cond)) {
-			return false;
-		}
-	}
-
-	return true;
+bool VM_HasCodeConditions(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code) {
+	return !VM_ShouldSkipCode(vm, code);
 }
 
-
 bool VM_HasConditions(struct IL_VirtualMachine* vm, enum IL_Conditions conditions) {
+	if (conditions & VM_COMPARE_CONDITIONS) {
+		VM_MaterializeConditions(vm);
+	}
+
 	return IL_HasConditions(vm->conditions, conditions);
 }
 
@@ -31,39 +29,158 @@ void VM_ToggleCondition(struct IL_VirtualMachine* vm, enum IL_Conditions conditi
 	IL_ToggleCondition(&vm->conditions, condition, value);
 }
 
-void VM_Run(struct IL_VirtualMachine* vm) {
+// Shared by the traced, counting and production loops, trace and counters are constant NULLs in the production one
+static VM_FORCEINLINE void VM_Dispatch(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Trace* trace, struct VM_Counters* counters) {
+	const struct VM_DecodedCode* code = VM_LookupCode(program, vm->ip);
+
 	while (!VM_HasConditions(vm, IL_CONDITIONS_HLT)) {
-		struct IL_Code* code = (struct IL_Code*)vm->ip;
-		if (IL_IsBadCode(code)) {
-			printf("Bad code at %llx\n", vm->ip);
-			break;
+		bool skipped = VM_ShouldSkipCode(vm, code);
+
+		// Verified programs only reach the sentinel through a bad jump, its handler halts
+		if (trace != NULL) {
+			if (code->mnemonic == VM_MNEMONIC_BAD) {
+				VM_FlushTrace(trace);
+			}
+			else {
+				VM_TraceCode(trace, program, vm->ip, skipped);
+			}
 		}
 
-		const char* formated = IL_FormatCode(code);
-		printf("%p: %s:", code, formated);
-		free((void*)formated);
+		if (counters != NULL) {
+			uint64_t start = VM_ReadCycles();
+			if (!skipped) {
+				VM_HANDLERS[code->handler](vm, code);
+			}
 
-		if (VM_HasCodeConditions(vm, code)) {
-			VM_HANDLERS[code->mnemonic](vm, code);
-			// VM_PrintContext(vm);
-			printf("\n");
+			VM_CountCode(counters, code, skipped, VM_ReadCycles() - start);
 		}
-		else {
-			printf("(Skipped)\n");
+		else if (!skipped) {
+			VM_HANDLERS[code->handler](vm, code);
 		}
 
-		if (VM_HasConditions(vm, IL_CONDITIONS_NI)) {
-			vm->ip += IL_GetCodeSize(code);
-		}
-		else {
-			// Don't increment and enable the flag for the next instruction
-			VM_ToggleCondition(vm, IL_CONDITIONS_NI, true);
-		}
+		code = VM_GetNextCode(vm, program, code);
+		vm->steps += 1;
+	}
+
+	if (trace != NULL) {
+		VM_FlushTrace(trace);
+	}
+
+	VM_MaterializeConditions(vm);
+}
+
+void VM_Run(struct IL_VirtualMachine* vm, const struct VM_Program* program) {
+	VM_Dispatch(vm, program, NULL, NULL);
+}
+
+void VM_RunTraced(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Trace* trace) {
+	VM_Dispatch(vm, program, trace, vm->counters);
+}
+
+void VM_RunCounted(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Counters* counters) {
+	VM_Dispatch(vm, program, NULL, counters);
+}
+
+struct VM_ExecuteContext {
+	struct IL_VirtualMachine* vm;
+	const struct VM_Program* program;
+	enum VM_Engine engine;
+	struct VM_Trace* trace;
+};
+
+static void VM_ExecuteEngine(void* context) {
+	struct VM_ExecuteContext* execute = context;
+	if (execute->trace != NULL) {
+		VM_RunTraced(execute->vm, execute->program, execute->trace);
+		return;
+	}
+
+	if (execute->vm->counters != NULL) {
+		VM_RunCounted(execute->vm, execute->program, execute->vm->counters);
+		return;
+	}
+
+	switch (execute->engine) {
+	case VM_ENGINE_TABLE:
+		VM_Run(execute->vm, execute->program);
+		break;
+	case VM_ENGINE_THREADED:
+		VM_RunThreaded(execute->vm, execute->program);
+		break;
+	case VM_ENGINE_JIT:
+		VM_RunJit(execute->vm, execute->program);
+		break;
+	}
+}
+
+// Guest accesses aren't bounds checked, a fault in the guest space lands here instead of crashing
+static void VM_ExecuteGuarded(struct VM_ExecuteContext* context) {
+	struct IL_VirtualMachine* vm = context->vm;
+	const struct VM_Program* program = context->program;
+
+	// Jumps pay for the block they land in, the one execution starts in is paid here
+	if ((vm->conditions & IL_CONDITIONS_HLT) || !VM_ChargeFuel(vm, VM_LookupCode(program, vm->ip))) {
+		return;
 	}
+
+	uint64_t address = 0;
+	struct VM_Memory* memory = vm->memory;
+	if (!VM_RunGuarded(memory, VM_ExecuteEngine, context, &address)) {
+		VM_RaiseFault(vm, VM_IsStackGuard(memory, address) ? VM_FAULT_STACK_OVERFLOW : VM_FAULT_MEMORY, address);
+	}
+
+	// A halt, a fault or a pending host call leaves the rest of its block unrun
+	if (vm->suspend != VM_SUSPEND_FUEL) {
+		vm->fuel += VM_LookupCode(program, vm->ip)->cost;
+	}
+}
+
+void VM_Execute(struct IL_VirtualMachine* vm, const struct VM_Program* program, enum VM_Engine engine) {
+	// Once a program is loaded nothing on the execute path may touch the heap
+#ifdef VM_HEAP_COUNTING
+	VM_BeginHeapCount();
+#endif
+
+	struct VM_ExecuteContext context = { vm, program, engine, NULL };
+	VM_ExecuteGuarded(&context);
+
+#ifdef VM_HEAP_COUNTING
+	// Release builds counting for the tests read the total instead
+	uint64_t allocations = VM_EndHeapCount();
+	assert(allocations == 0 && "Heap allocation during VM_Execute");
+	(void)allocations;
+#endif
+}
+
+void VM_ExecuteTraced(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Trace* trace) {
+	struct VM_ExecuteContext context = { vm, program, VM_ENGINE_TABLE, trace };
+	VM_ExecuteGuarded(&context);
+
+	// Lines buffered before a fault
+	VM_FlushTrace(trace);
 }
 
 void VM_Init(struct IL_VirtualMachine* vm) {
 	memset(vm->regs, 0, sizeof(vm->regs));
+	memset(vm->vregs, 0, sizeof(vm->vregs));
+	vm->steps = 0;
+	vm->compare_a = 0;
+	vm->compare_b = 0;
+	vm->lazy_conditions = false;
+
+	vm->memory = NULL;
+	vm->fault = VM_FAULT_NONE;
+	vm->fault_address = 0;
+
+	vm->fuel = VM_FUEL_UNLIMITED;
+	vm->fuel_added = VM_FUEL_UNLIMITED;
+	vm->fuel_limit = 0;
+	vm->suspend = VM_SUSPEND_NONE;
+	vm->host = NULL;
+	vm->wake = NULL;
+	vm->wake_user = NULL;
+	vm->wake_arrivals = 0;
+	vm->counters = NULL;
 
 	vm->ip = 0;
 	vm->conditions = IL_CONDITIONS_NI;
@@ -71,17 +188,38 @@ void VM_Init(struct IL_VirtualMachine* vm) {
 
 void VM_PrintContext(struct IL_VirtualMachine* vm) {
 	printf("============== VM CONTEXT ==============\n");
+	VM_MaterializeConditions(vm);
 
 	for (uint8_t i = 0; i < 16; ++i) {
 		struct IL_OperandRegister reg;
 		reg.id = i;
 		reg.size = 8;
 
-		printf("%s: %llx (%ju)", IL_FormatRegister(reg), vm->regs[i], vm->regs[i]);
+		char name[16];
+		IL_PrintRegister(reg, name, sizeof(name));
+
+		printf("%s: %llx (%ju)", name, (unsigned long long)vm->regs[i], (uintmax_t)vm->regs[i]);
 		if (i == IL_CD_REG) {
-			const char* conditions = IL_FormatConditions(vm->conditions);
+			char conditions[64];
+			IL_PrintConditions(vm->conditions, conditions, sizeof(conditions));
 			printf(" (%s)", conditions);
-			free((void*)conditions);
+		}
+
+		printf("\n");
+	}
+
+	// Only the vector registers that were written, most programs don't use them
+	for (uint8_t i = 0; i < IL_VECTOR_REGISTERS_COUNT; ++i) {
+		static const uint8_t zero[IL_VECTOR_SIZE] = { 0 };
+		if (memcmp(vm->vregs[i], zero, IL_VECTOR_SIZE) == 0) {
+			continue;
+		}
+
+		printf("V%u:", i);
+		for (int lane = IL_VECTOR_SIZE / 8 - 1; lane >= 0; --lane) {
+			uint64_t value = 0;
+			memcpy(&value, vm->vregs[i] + lane * 8, sizeof(value));
+			printf(" %016llx", (unsigned long long)value);
 		}
 
 		printf("\n");
@@ -90,64 +228,111 @@ void VM_PrintContext(struct IL_VirtualMachine* vm) {
 	printf("=======================================\n");
 }
 
+void VM_RaiseFault(struct IL_VirtualMachine* vm, enum VM_Fault fault, uint64_t address) {
+	// Handlers can be left halfway, the compare bits may still be pending
+	VM_MaterializeConditions(vm);
+
+	vm->fault = fault;
+	vm->fault_address = address;
+	VM_ToggleCondition(vm, IL_CONDITIONS_HLT, true);
+}
+
+void VM_PrintFault(const struct IL_VirtualMachine* vm, const struct VM_Program* program) {
+	uint64_t offset = vm->ip - (uint64_t)program->base;
+
+	char location[128];
+	if (program->debug != NULL) {
+		VM_FormatLocation(program->debug, offset, location, sizeof(location));
+	}
+	else {
+		snprintf(location, sizeof(location), "code offset 0x%llx", (unsigned long long)offset);
+	}
+
+	switch (vm->fault) {
+	case VM_FAULT_NONE:
+		break;
+	case VM_FAULT_BAD_CODE:
+		printf("Fault: bad code at %s\n", location);
+		break;
+	case VM_FAULT_MEMORY:
+		printf("Fault: memory access to 0x%llx at %s\n", (unsigned long long)vm->fault_address, location);
+		break;
+	case VM_FAULT_STACK_OVERFLOW:
+		printf("Fault: stack overflow at %s, SP 0x%llx\n", location, (unsigned long long)vm->sp);
+		break;
+	case VM_FAULT_HOST_CALL:
+		printf("Fault: unknown host function %llu at %s\n", (unsigned long long)vm->fault_address, location);
+		break;
+	}
+}
+
 void VM_WriteRegisterValue(struct IL_VirtualMachine* vm, uint8_t reg_id, void* data, size_t size) {
 	assert(size <= sizeof(uint64_t));
+
+	// Partial writes keep the other bits of CD
+	if (reg_id == IL_CD_REG) {
+		VM_MaterializeConditions(vm);
+	}
+
 	memcpy(&vm->regs[reg_id], data, size);
 }
 
 void VM_ReadRegisterValue(struct IL_VirtualMachine* vm, uint8_t reg_id, void* data, size_t size) {
 	assert(size <= sizeof(uint64_t));
+
+	if (reg_id == IL_CD_REG) {
+		VM_MaterializeConditions(vm);
+	}
+
 	memcpy(data, &vm->regs[reg_id], size);
 }
 
-void VM_ReadOperandValue(struct IL_VirtualMachine* vm, struct IL_Operand* op, void* data, size_t size) {
+void VM_ReadOperandValue(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op, void* data, size_t size) {
 	assert(data != NULL);
+	assert(size <= sizeof(uint64_t));
 
-	void* value = NULL;
-	size_t value_size = 0;
 	switch (op->type) {
 	case IL_OPERAND_TYPE_IMMEDIATE: {
-		value_size = IL_GetOperandDataSize(op);
-		assert(value_size == 1 || value_size == 2 || value_size == 4 || value_size == 8);
-
-		value = malloc(value_size);
-		assert(value != NULL);
-
-		IL_ReadOperandData(op, value, (uint8_t)value_size);
+		memcpy(data, &op->value, size);
 		break;
 	}
 	case IL_OPERAND_TYPE_REGISTER: {
-		struct IL_OperandRegister* reg = IL_GetOperandRegister(op);
-		value_size = reg->size;
-		value = malloc(value_size);
-		assert(value != NULL);
-
-		VM_ReadRegisterValue(vm, reg->id, value, value_size);
+		VM_ReadRegisterValue(vm, op->reg, data, size);
 		break;
 	}
 	}
-
-	memcpy(data, value, value_size);
-	free((void*)value);
 }
 
-void VM_WriteOperandValue(struct IL_VirtualMachine* vm, struct IL_Operand* op, void* data, size_t size) {
+void VM_WriteOperandValue(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op, void* data, size_t size) {
+	// Registers are written at the width of the operand
+	(void)size;
+
 	switch (op->type) {
 	case IL_OPERAND_TYPE_IMMEDIATE: {
 		assert(false);
 	}
 	case IL_OPERAND_TYPE_REGISTER: {
-		struct IL_OperandRegister* reg = IL_GetOperandRegister(op);
-		VM_WriteRegisterValue(vm, reg->id, data, reg->size);
+		VM_WriteRegisterValue(vm, op->reg, data, op->size);
 		break;
 	}
 	}
 }
 
 void VM_WriteMemoryValue(struct IL_VirtualMachine* vm, uint64_t address, void* data, size_t size) {
-	memcpy((void*)address, data, size);
+	memcpy(VM_TranslateAddress(vm->memory->base, address), data, size);
 }
 
 void VM_ReadMemoryValue(struct IL_VirtualMachine* vm, uint64_t address, void* data, size_t size) {
-	memcpy(data, (void*)address, size);
+	memcpy(data, VM_TranslateAddress(vm->memory->base, address), size);
+}
+
+uint8_t* VM_GetMemoryRange(struct IL_VirtualMachine* vm, uint64_t address, uint64_t size) {
+	// Single accesses are caught by the guard regions, a block could reach past them.
+	// The stack below stack_committed is grown by the fault the access takes.
+	uint8_t* range = VM_GetGuestRange(vm->memory, address, size, false);
+	if (range == NULL) {
+		VM_RaiseFault(vm, VM_IsStackGuard(vm->memory, (uint32_t)address) ? VM_FAULT_STACK_OVERFLOW : VM_FAULT_MEMORY, address);
+	}
+
+	return range;
 }
\ No newline at end of file
@@ -1,8 +1,41 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "il.h"
+#include "decoder.h"
+#include "trace.h"
+#include "memory.h"
+
+#define VM_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define VM_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// Why a VM halted without a HALT
+enum VM_Fault {
+	VM_FAULT_NONE,
+	VM_FAULT_BAD_CODE, // IP left the decoded code
+	VM_FAULT_MEMORY, // Access to an uncommitted guest address, see fault_address
+	VM_FAULT_STACK_OVERFLOW, // Access to the guard under the stack
+	VM_FAULT_HOST_CALL, // HOSTCALL index outside the host table, see fault_address
+};
+
+// Why a VM stopped before halting, VM_Resume lets it continue
+enum VM_Suspend {
+	VM_SUSPEND_NONE,
+	VM_SUSPEND_FUEL, // Not enough fuel for the next block
+	VM_SUSPEND_HOST_CALL, // A host call is pending, see VM_ParkHostCall
+};
+
+// Fuel of a VM that was never given any, it never runs out
+#define VM_FUEL_UNLIMITED (UINT64_MAX >> 1)
+
+struct VM_HostTable;
+struct VM_Counters;
+struct IL_VirtualMachine;
+
+// Called from the thread completing a pending host call, makes the VM runnable again
+typedef void (*VM_WakeFn_t)(struct IL_VirtualMachine* vm, void* user);
 
 struct IL_VirtualMachine {
 	union {
@@ -26,22 +59,139 @@ struct IL_VirtualMachine {
 			enum IL_Conditions conditions;
 		};
 	};
+
+	// Executed and skipped instructions since VM_Init
+	uint64_t steps;
+
+	// Operands of the last CMP, the compare bits of conditions are stale while lazy_conditions is set
+	uint64_t compare_a;
+	uint64_t compare_b;
+	bool lazy_conditions;
+
+	// Guest address space, see memory.h
+	struct VM_Memory* memory;
+
+	// Set along with HLT, IP is left on the faulting code
+	enum VM_Fault fault;
+	uint64_t fault_address;
+
+	// Instructions left to run, a whole block is charged when it's jumped to and what the jump skips is given back
+	uint64_t fuel;
+	uint64_t fuel_added; // Consumed is fuel_added - fuel
+	uint64_t fuel_limit; // Steps at which the fuel runs out, checked by native blocks at their inner jumps
+
+	// Set along with HLT, IP is left on the next code to run
+	enum VM_Suspend suspend;
+
+	// Functions HOSTCALL can reach, see host.h
+	const struct VM_HostTable* host;
+
+	// Set by whoever runs the VM before a host call can be pending
+	VM_WakeFn_t wake;
+	void* wake_user;
+	int64_t wake_arrivals; // Atomic, parking and completion of a pending call, the second one wakes
+
+	// Per-opcode counters, every engine runs the counting table loop while it's set, see counters.h
+	struct VM_Counters* counters;
+
+	// Vector registers, writes to an X view clear the upper half like VEX encoded SSE does
+	uint8_t vregs[IL_VECTOR_REGISTERS_COUNT][IL_VECTOR_SIZE];
+};
+
+#define VM_COMPARE_CONDITIONS (IL_CONDITIONS_EQ | IL_CONDITIONS_NEQ | IL_CONDITIONS_LT | IL_CONDITIONS_GT)
+
+// CMP only records its operands, most results are read by a single predicate if at all
+static inline void VM_SetCompare(struct IL_VirtualMachine* vm, uint64_t a, uint64_t b) {
+	vm->compare_a = a;
+	vm->compare_b = b;
+	vm->lazy_conditions = true;
+}
+
+// Compare bits of CMP a, b, unsigned
+static inline enum IL_Conditions VM_CompareConditions(uint64_t a, uint64_t b) {
+	enum IL_Conditions conditions = a == b ? IL_CONDITIONS_EQ : IL_CONDITIONS_NEQ;
+	conditions |= a < b ? IL_CONDITIONS_LT : 0;
+	conditions |= a > b ? IL_CONDITIONS_GT : 0;
+	return conditions;
+}
+
+// Computes the compare bits of the last CMP, needed before anything reads or writes the conditions
+static inline void VM_MaterializeConditions(struct IL_VirtualMachine* vm) {
+	if (!vm->lazy_conditions) {
+		return;
+	}
+
+	vm->conditions = (vm->conditions & ~VM_COMPARE_CONDITIONS) | VM_CompareConditions(vm->compare_a, vm->compare_b);
+	vm->lazy_conditions = false;
+}
+
+static inline void VM_SuspendExecution(struct IL_VirtualMachine* vm, enum VM_Suspend suspend) {
+	vm->suspend = suspend;
+	vm->conditions |= IL_CONDITIONS_HLT;
+}
+
+static inline void VM_Resume(struct IL_VirtualMachine* vm) {
+	if (vm->suspend != VM_SUSPEND_NONE) {
+		vm->suspend = VM_SUSPEND_NONE;
+		vm->conditions &= ~IL_CONDITIONS_HLT;
+	}
+}
+
+static inline uint64_t VM_GetFuel(const struct IL_VirtualMachine* vm) {
+	return vm->fuel;
+}
+
+static inline uint64_t VM_GetFuelConsumed(const struct IL_VirtualMachine* vm) {
+	return vm->fuel_added - vm->fuel;
+}
+
+static inline void VM_AddFuel(struct IL_VirtualMachine* vm, uint64_t fuel) {
+	vm->fuel += fuel;
+	vm->fuel_added += fuel;
+}
+
+// Keeps the consumed count
+static inline void VM_SetFuel(struct IL_VirtualMachine* vm, uint64_t fuel) {
+	vm->fuel_added += fuel - vm->fuel;
+	vm->fuel = fuel;
+}
+
+enum VM_Engine {
+	VM_ENGINE_TABLE, // Indirect call through VM_HANDLERS
+	VM_ENGINE_THREADED, // Threaded dispatch, see threaded.c
+	VM_ENGINE_JIT, // Native blocks with the table engine as fallback, see jit.c
 };
 
-bool VM_HasCodeConditions(struct IL_VirtualMachine* vm, struct IL_Code* code);
+#ifndef VM_DEFAULT_ENGINE
+#define VM_DEFAULT_ENGINE VM_ENGINE_TABLE
+#endif
+
+bool VM_HasCodeConditions(struct IL_VirtualMachine* vm, const struct VM_DecodedCode* code);
 bool VM_HasConditions(struct IL_VirtualMachine* vm, enum IL_Conditions conditions);
-bool VM_ToggleCondition(struct IL_VirtualMachine* vm, enum IL_Conditions condition, bool value);
+void VM_ToggleCondition(struct IL_VirtualMachine* vm, enum IL_Conditions condition, bool value);
 
-void VM_Run(struct IL_VirtualMachine* vm);
+void VM_Run(struct IL_VirtualMachine* vm, const struct VM_Program* program);
+void VM_RunThreaded(struct IL_VirtualMachine* vm, const struct VM_Program* program);
+void VM_RunJit(struct IL_VirtualMachine* vm, const struct VM_Program* program);
+void VM_RunTraced(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Trace* trace);
+void VM_RunCounted(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Counters* counters);
+void VM_Execute(struct IL_VirtualMachine* vm, const struct VM_Program* program, enum VM_Engine engine);
+void VM_ExecuteTraced(struct IL_VirtualMachine* vm, const struct VM_Program* program, struct VM_Trace* trace);
 void VM_Init(struct IL_VirtualMachine* vm);
 void VM_PrintContext(struct IL_VirtualMachine* vm);
+void VM_PrintFault(const struct IL_VirtualMachine* vm, const struct VM_Program* program);
+void VM_RaiseFault(struct IL_VirtualMachine* vm, enum VM_Fault fault, uint64_t address);
 
 void VM_WriteRegisterValue(struct IL_VirtualMachine* vm, uint8_t reg_id, void* data, size_t size);
 void VM_ReadRegisterValue(struct IL_VirtualMachine* vm, uint8_t reg_id, void* data, size_t size);
 
-void VM_WriteOperandValue(struct IL_VirtualMachine* vm, struct IL_Operand* op, void* data, size_t size);
-void VM_ReadOperandValue(struct IL_VirtualMachine* vm, struct IL_Operand* op, void* data, size_t size);
+void VM_WriteOperandValue(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op, void* data, size_t size);
+void VM_ReadOperandValue(struct IL_VirtualMachine* vm, const struct VM_DecodedOperand* op, void* data, size_t size);
 
 void VM_WriteMemoryValue(struct IL_VirtualMachine* vm, uint64_t address, void* data, size_t size);
 void VM_ReadMemoryValue(struct IL_VirtualMachine* vm, uint64_t address, void* data, size_t size);
 
+// Host pointer to size guest bytes for the block handlers, raises a fault and returns NULL if they leave
+// the committed memory or the stack. Stack pages that aren't committed yet are grown into when touched.
+uint8_t* VM_GetMemoryRange(struct IL_VirtualMachine* vm, uint64_t address, uint64_t size);
+
@@ -3,9 +3,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdarg.h>
 
 #include "il.h"
 
+// Portable stand-ins for _strdup and strcat_s, the formatters size their buffers first
+static char* IL_DuplicateString(const char* str) {
+	size_t size = strlen(str) + 1;
+	char* copy = malloc(size);
+	if (copy != NULL) {
+		memcpy(copy, str, size);
+	}
+
+	return copy;
+}
+
+static void IL_AppendString(char* buffer, size_t size, const char* str) {
+	size_t used = strlen(buffer);
+	snprintf(buffer + used, size - used, "%s", str);
+}
+
 bool IL_HasConditions(enum IL_Conditions conditions, enum IL_Conditions other) {
 	return conditions & other;
 }
@@ -47,17 +64,24 @@ const char* IL_FormatRegister(struct IL_OperandRegister reg) {
 	if (reg.size != 8) {
 		// 2 for "." and number, last for null terminator
 		size_t len = strlen(reg_str) + 3;
-		const char* buffer = calloc(len, 1);
+		char* buffer = calloc(len, 1);
 		assert(buffer != NULL);
 
-		sprintf_s(buffer, len, "%s.%d", reg_str, reg.size);
+		snprintf(buffer, len, "%s.%d", reg_str, reg.size);
 		return buffer;
 	}
 	else {
-		return _strdup(reg_str);
+		return IL_DuplicateString(reg_str);
 	}
 }
 
+const char* IL_FormatVector(struct IL_OperandVector vec) {
+	// Up to "Y15.8" and the null terminator
+	char buffer[8];
+	IL_PrintVector(vec, buffer, sizeof(buffer));
+	return IL_DuplicateString(buffer);
+}
+
 const char* IL_FormatConditions(enum IL_Conditions conditions) {
 	size_t len = 0;
 
@@ -92,11 +116,11 @@ const char* IL_FormatConditions(enum IL_Conditions conditions) {
 		enum IL_Conditions condition = 1 << i;
 		if (IL_HasConditions(conditions, condition)) {
 			const char* condition_str = IL_FormatCondition(condition);
-			strcat_s(buffer, buf_size, condition_str);
+			IL_AppendString(buffer, buf_size, condition_str);
 			buf_used += strlen(condition_str);
 
 			if (used_conditions != condition_count - 1) {
-				strcat_s(buffer, buf_size, ".");
+				IL_AppendString(buffer, buf_size, ".");
 				buf_used += 1;
 			}
 
@@ -117,39 +141,45 @@ const char* IL_FormatOperand(struct IL_Operand* operand) {
 			IL_ReadOperandData(operand, &value, sizeof(value));
 
 			char buffer[3];
-			sprintf_s(buffer, sizeof(buffer), "%02x", value);
-			return _strdup(buffer);
+			snprintf(buffer, sizeof(buffer), "%02x", value);
+			return IL_DuplicateString(buffer);
 		}
 		case 2: {
 			uint16_t value = 0;
 			IL_ReadOperandData(operand, &value, sizeof(value));
 
 			char buffer[5];
-			sprintf_s(buffer, sizeof(buffer), "%04x", value);
-			return _strdup(buffer);
+			snprintf(buffer, sizeof(buffer), "%04x", value);
+			return IL_DuplicateString(buffer);
 		}
 		case 4: {
 			uint32_t value = 0;
 			IL_ReadOperandData(operand, &value, sizeof(value));
 
 			char buffer[9];
-			sprintf_s(buffer, sizeof(buffer), "%08x", value);
-			return _strdup(buffer);
+			snprintf(buffer, sizeof(buffer), "%08x", value);
+			return IL_DuplicateString(buffer);
 		}
 		case 8: {
 			uint64_t value = 0;
 			IL_ReadOperandData(operand, &value, sizeof(value));
 
 			char buffer[17];
-			sprintf_s(buffer, sizeof(buffer), "%016llx", value);
-			return _strdup(buffer);
+			snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+			return IL_DuplicateString(buffer);
 		}
 		}
+
+		break;
 	}
 	case IL_OPERAND_TYPE_REGISTER: {
 		struct IL_OperandRegister* reg = IL_GetOperandRegister(operand);
 		return IL_FormatRegister(*reg);
 	}
+	case IL_OPERAND_TYPE_VECTOR: {
+		struct IL_OperandVector* vec = IL_GetOperandVector(operand);
+		return IL_FormatVector(*vec);
+	}
 	}
 
 	assert(false);
@@ -181,11 +211,11 @@ const char* IL_FormatOperands(struct IL_Code* code) {
 	for (uint8_t i = 0; i < op_count; ++i) {
 		struct IL_Operand* op = IL_GetCodeOperand(code, i);
 		const char* op_str = IL_FormatOperand(op);
-		strcat_s(buffer, buf_size, op_str);
+		IL_AppendString(buffer, buf_size, op_str);
 		buf_used += strlen(op_str);
 
 		if (i != op_count - 1) {
-			strcat_s(buffer, buf_size, ", ");
+			IL_AppendString(buffer, buf_size, ", ");
 			buf_used += 2;
 		}
 
@@ -245,27 +275,27 @@ const char* IL_FormatCode(struct IL_Code* code) {
 	char* buffer = calloc(buf_size, 1);
 	assert(buffer != NULL);
 
-	strcat_s(buffer, buf_size, mnemonic_str);
+	IL_AppendString(buffer, buf_size, mnemonic_str);
 	buf_used += strlen(mnemonic_str);
 
 	if (conditions_str) {
-		strcat_s(buffer, buf_size, "(");
+		IL_AppendString(buffer, buf_size, "(");
 		buf_used += 1;
 
-		strcat_s(buffer, buf_size, conditions_str);
+		IL_AppendString(buffer, buf_size, conditions_str);
 		buf_used += strlen(conditions_str);
 
-		strcat_s(buffer, buf_size, ")");
+		IL_AppendString(buffer, buf_size, ")");
 		buf_used += 1;
 
 		free((void*)conditions_str);
 	}
 
 	if (operands_str) {
-		strcat_s(buffer, buf_size, " ");
+		IL_AppendString(buffer, buf_size, " ");
 		buf_used += 1;
 
-		strcat_s(buffer, buf_size, operands_str);
+		IL_AppendString(buffer, buf_size, operands_str);
 		buf_used += strlen(operands_str);
 		free((void*)operands_str);
 	}
@@ -274,6 +304,105 @@ const char* IL_FormatCode(struct IL_Code* code) {
 	return buffer;
 }
 
+static size_t IL_Print(char* buffer, size_t size, size_t used, const char* format, ...) {
+	if (size == 0) {
+		return 0;
+	}
+
+	if (used + 1 >= size) {
+		buffer[size - 1] = '\0';
+		return size - 1;
+	}
+
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(buffer + used, size - used, format, args);
+	va_end(args);
+
+	if (written < 0) {
+		return used;
+	}
+
+	used += (size_t)written;
+	return used < size ? used : size - 1;
+}
+
+size_t IL_PrintRegister(struct IL_OperandRegister reg, char* buffer, size_t size) {
+	const char* reg_str = IL_REGISTERS_STR[reg.id];
+
+	if (reg.size != 8) {
+		return IL_Print(buffer, size, 0, "%s.%d", reg_str, reg.size);
+	}
+
+	return IL_Print(buffer, size, 0, "%s", reg_str);
+}
+
+size_t IL_PrintVector(struct IL_OperandVector vec, char* buffer, size_t size) {
+	char prefix = vec.wide ? 'Y' : 'X';
+	if (vec.lane != 3) {
+		return IL_Print(buffer, size, 0, "%c%d.%d", prefix, vec.id, 1 << vec.lane);
+	}
+
+	return IL_Print(buffer, size, 0, "%c%d", prefix, vec.id);
+}
+
+size_t IL_PrintConditions(enum IL_Conditions conditions, char* buffer, size_t size) {
+	size_t used = IL_Print(buffer, size, 0, "");
+
+	bool first = true;
+	for (int i = 0; i < IL_CONDITIONS_COUNT; ++i) {
+		enum IL_Conditions condition = 1 << i;
+		if (IL_HasConditions(conditions, condition)) {
+			used = IL_Print(buffer, size, used, first ? "%s" : ".%s", IL_FormatCondition(condition));
+			first = false;
+		}
+	}
+
+	return used;
+}
+
+size_t IL_PrintOperand(struct IL_Operand* operand, char* buffer, size_t size) {
+	switch (IL_GetOperandType(operand)) {
+	case IL_OPERAND_TYPE_IMMEDIATE: {
+		uint8_t data_size = IL_GetOperandDataSize(operand);
+		assert(data_size <= sizeof(uint64_t));
+
+		uint64_t value = 0;
+		IL_ReadOperandData(operand, &value, data_size);
+		return IL_Print(buffer, size, 0, "%0*llx", data_size * 2, (unsigned long long)value);
+	}
+	case IL_OPERAND_TYPE_REGISTER: {
+		struct IL_OperandRegister* reg = IL_GetOperandRegister(operand);
+		return IL_PrintRegister(*reg, buffer, size);
+	}
+	case IL_OPERAND_TYPE_VECTOR: {
+		struct IL_OperandVector* vec = IL_GetOperandVector(operand);
+		return IL_PrintVector(*vec, buffer, size);
+	}
+	}
+
+	assert(false);
+	return 0;
+}
+
+size_t IL_PrintCode(struct IL_Code* code, char* buffer, size_t size) {
+	size_t used = IL_Print(buffer, size, 0, "%s", IL_FormatMnemonic(IL_GetCodeMnemonic(code)));
+
+	if (IL_HasCodeConditions(code)) {
+		used = IL_Print(buffer, size, used, "(");
+		used += IL_PrintConditions(IL_GetCodeConditions(code), buffer + used, size - used);
+		used = IL_Print(buffer, size, used, ")");
+	}
+
+	uint8_t op_count = IL_GetCodeOperandCount(code);
+	for (uint8_t i = 0; i < op_count; ++i) {
+		used = IL_Print(buffer, size, used, i == 0 ? " " : ", ");
+		used += IL_PrintOperand(IL_GetCodeOperand(code, i), buffer + used, size - used);
+	}
+
+	return used;
+}
+
 enum IL_OperandType IL_GetOperandType(struct IL_Operand* operand) {
 	return operand->type;
 }
@@ -286,7 +415,7 @@ void IL_SetOperandDataSize(struct IL_Operand* operand, uint8_t size) {
 	operand->size = size;
 }
 
-uint8_t IL_GetOperandDataSize(struct IL_Operand* operand) {
+uint8_t IL_GetOperandDataSize(const struct IL_Operand* operand) {
 	return operand->size;
 }
 
@@ -321,6 +450,26 @@ struct IL_Operand* IL_CreateOperandRegister(uint8_t reg_id, uint8_t reg_size) {
 	return operand;
 }
 
+struct IL_OperandVector* IL_GetOperandVector(struct IL_Operand* operand) {
+	assert(IL_GetOperandType(operand) == IL_OPERAND_TYPE_VECTOR);
+	return (struct IL_OperandVector*)((uint64_t)operand + sizeof(struct IL_Operand));
+}
+
+struct IL_Operand* IL_CreateOperandVector(uint8_t vec_id, bool wide, uint8_t lane_size) {
+	struct IL_OperandVector vec = { vec_id, wide, 0 };
+	while ((1 << vec.lane) < lane_size) {
+		vec.lane += 1;
+	}
+
+	struct IL_Operand* operand = malloc(sizeof(struct IL_Operand) + sizeof(vec));
+	assert(operand != NULL);
+
+	IL_SetOperandType(operand, IL_OPERAND_TYPE_VECTOR);
+	IL_SetOperandDataSize(operand, sizeof(vec));
+	IL_WriteOperandData(operand, &vec, sizeof(vec));
+	return operand;
+}
+
 struct IL_Operand* IL_CreateOperandImmediate(void* data, uint8_t size) {
 	struct IL_Operand* operand = malloc(sizeof(struct IL_Operand) + size);
 	assert(operand != NULL);
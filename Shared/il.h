@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #define IL_SP_REG	13
 #define IL_IP_REG	14
@@ -27,11 +28,28 @@ enum IL_Mnemonic {
 	IL_MNEMONIC_CALL,
 	IL_MNEMONIC_RETURN,
 	IL_MNEMONIC_HALT,
+	IL_MNEMONIC_HOSTCALL,
+	IL_MNEMONIC_MEMCPY, // dst, src, size
+	IL_MNEMONIC_MEMSET, // dst, byte, size
+	IL_MNEMONIC_MEMCMP, // a, b, size, compares the first bytes that differ like CMP
+	IL_MNEMONIC_VLOAD, // vector, address
+	IL_MNEMONIC_VSTORE, // address, vector
+	IL_MNEMONIC_VSPLAT, // vector, value, copied to every lane
+	IL_MNEMONIC_VMASK, // register, vector, a bit per lane from its top bit
+	IL_MNEMONIC_VADD,
+	IL_MNEMONIC_VSUB,
+	IL_MNEMONIC_VMUL,
+	IL_MNEMONIC_VAND,
+	IL_MNEMONIC_VOR,
+	IL_MNEMONIC_VXOR,
+	IL_MNEMONIC_VCMPEQ, // Lanes that compare become all ones, the others zero
+	IL_MNEMONIC_VCMPGT, // Unsigned like CMP
+	IL_MNEMONIC_VSHUF, // vector, indices, bytes picked within each 16 byte half, top bit set for zero
 };
 
-#define IL_MNEMONIC_COUNT (IL_MNEMONIC_HALT + 1)
+#define IL_MNEMONIC_COUNT (IL_MNEMONIC_VSHUF + 1)
 
-static const char* IL_MNEMONICS_STR[] = {
+static const char* const IL_MNEMONICS_STR[] = {
 	"SET",
 	"ADD",
 	"SUB",
@@ -51,6 +69,23 @@ static const char* IL_MNEMONICS_STR[] = {
 	"CALL",
 	"RETURN",
 	"HALT",
+	"HOSTCALL",
+	"MEMCPY",
+	"MEMSET",
+	"MEMCMP",
+	"VLOAD",
+	"VSTORE",
+	"VSPLAT",
+	"VMASK",
+	"VADD",
+	"VSUB",
+	"VMUL",
+	"VAND",
+	"VOR",
+	"VXOR",
+	"VCMPEQ",
+	"VCMPGT",
+	"VSHUF",
 };
 
 enum IL_Conditions {
@@ -65,7 +100,7 @@ enum IL_Conditions {
 
 #define IL_CONDITIONS_COUNT 5
 
-static const char* IL_CONDITIONS_STR[] = {
+static const char* const IL_CONDITIONS_STR[] = {
 	"HLT",
 	"EQ",
 	"NEQ",
@@ -74,16 +109,21 @@ static const char* IL_CONDITIONS_STR[] = {
 	"NI",
 };
 
-static const char* IL_REGISTERS_STR[] = {
+static const char* const IL_REGISTERS_STR[] = {
 	"R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7",
 	"R8", "R9", "R10", "R11", "R12", "SP", "IP", "CD",
 };
 
 #define IL_REGISTERS_COUNT 16
 
+// Vector registers are 32 bytes, X names their low 16 bytes and Y the whole register
+#define IL_VECTOR_REGISTERS_COUNT 16
+#define IL_VECTOR_SIZE 32
+
 enum IL_OperandType {
 	IL_OPERAND_TYPE_IMMEDIATE,
 	IL_OPERAND_TYPE_REGISTER,
+	IL_OPERAND_TYPE_VECTOR,
 };
 
 struct IL_OperandRegister {
@@ -91,6 +131,12 @@ struct IL_OperandRegister {
 	uint8_t size : 4;
 };
 
+struct IL_OperandVector {
+	uint8_t id : 4;
+	uint8_t wide : 1; // Y rather than X
+	uint8_t lane : 3; // Log2 of the lane size in bytes
+};
+
 struct IL_Operand {
 	uint8_t type : 2;
 	uint8_t size : 6;
@@ -114,12 +160,20 @@ bool IL_IsBadCode(struct IL_Code* code);
 const char* IL_FormatMnemonic(enum IL_Mnemonic mnemonic);
 const char* IL_FormatCondition(enum IL_Conditions condition);
 const char* IL_FormatRegister(struct IL_OperandRegister reg);
+const char* IL_FormatVector(struct IL_OperandVector vec);
 
 const char* IL_FormatConditions(enum IL_Conditions conditions);
 const char* IL_FormatOperand(struct IL_Operand* operand);
 const char* IL_FormatOperands(struct IL_Code* code);
 const char* IL_FormatCode(struct IL_Code* code);
 
+// Allocation free variants, write at most size bytes including the null terminator and return the length written
+size_t IL_PrintRegister(struct IL_OperandRegister reg, char* buffer, size_t size);
+size_t IL_PrintVector(struct IL_OperandVector vec, char* buffer, size_t size);
+size_t IL_PrintConditions(enum IL_Conditions conditions, char* buffer, size_t size);
+size_t IL_PrintOperand(struct IL_Operand* operand, char* buffer, size_t size);
+size_t IL_PrintCode(struct IL_Code* code, char* buffer, size_t size);
+
 size_t IL_GetOperandSize(const struct IL_Operand* operand);
 
 struct IL_Operand* IL_GetNextOperand(struct IL_Operand* operand);
@@ -129,14 +183,16 @@ enum IL_OperandType IL_GetOperandType(struct IL_Operand* operand);
 void IL_SetOperandType(struct IL_Operand* operand, enum IL_OperandType type);
 
 void IL_SetOperandDataSize(struct IL_Operand* operand, uint8_t size);
-uint8_t IL_GetOperandDataSize(struct IL_Operand* operand);
+uint8_t IL_GetOperandDataSize(const struct IL_Operand* operand);
 
 void IL_ReadOperandData(struct IL_Operand* operand, void* data, uint8_t size);
 void IL_WriteOperandData(struct IL_Operand* operand, void* data, uint8_t size);
 
 struct IL_OperandRegister* IL_GetOperandRegister(struct IL_Operand* operand);
+struct IL_OperandVector* IL_GetOperandVector(struct IL_Operand* operand);
 
 struct IL_Operand* IL_CreateOperandRegister(uint8_t reg_id, uint8_t reg_size);
+struct IL_Operand* IL_CreateOperandVector(uint8_t vec_id, bool wide, uint8_t lane_size);
 struct IL_Operand* IL_CreateOperandImmediate(void* data, uint8_t size);
 
 void IL_SetCodeMnemonic(struct IL_Code* code, enum IL_Mnemonic mnemonic);
@@ -0,0 +1,209 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "image.h"
+
+static bool IL_RejectImage(const char** error, const char* reason) {
+	if (error != NULL) {
+		*error = reason;
+	}
+
+	return false;
+}
+
+bool IL_IsImage(const uint8_t* data, size_t size) {
+	uint32_t magic = 0;
+	if (size < sizeof(magic)) {
+		return false;
+	}
+
+	memcpy(&magic, data, sizeof(magic));
+	return magic == IL_IMAGE_MAGIC;
+}
+
+static bool IL_ParseSymbols(const uint8_t* data, size_t size, const char** error) {
+	struct IL_ImageSymbols symbols;
+	if (size < sizeof(symbols)) {
+		return IL_RejectImage(error, "truncated symbol table");
+	}
+
+	memcpy(&symbols, data, sizeof(symbols));
+
+	size_t table_size = sizeof(symbols) + (size_t)symbols.count * sizeof(struct IL_ImageSymbol);
+	if (symbols.count > size / sizeof(struct IL_ImageSymbol) || table_size > size) {
+		return IL_RejectImage(error, "truncated symbol table");
+	}
+
+	// Names are checked once so lookups can hand them out as is
+	const char* names = (const char*)(data + table_size);
+	size_t names_size = size - table_size;
+	for (uint32_t i = 0; i < symbols.count; ++i) {
+		struct IL_ImageSymbol symbol;
+		memcpy(&symbol, data + sizeof(symbols) + i * sizeof(symbol), sizeof(symbol));
+
+		if (symbol.name >= names_size || memchr(names + symbol.name, '\0', names_size - symbol.name) == NULL) {
+			return IL_RejectImage(error, "symbol name out of bounds");
+		}
+	}
+
+	return true;
+}
+
+bool IL_ParseImage(const uint8_t* data, size_t size, struct IL_Image* image, const char** error) {
+	memset(image, 0, sizeof(*image));
+
+	struct IL_ImageHeader header;
+	if (size < sizeof(header)) {
+		return IL_RejectImage(error, "truncated header");
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != IL_IMAGE_MAGIC) {
+		return IL_RejectImage(error, "bad magic");
+	}
+
+	if (header.version != IL_IMAGE_VERSION) {
+		return IL_RejectImage(error, "unsupported version");
+	}
+
+	size_t table_size = sizeof(header) + (size_t)header.section_count * sizeof(struct IL_ImageSection);
+	if (header.header_size < table_size || header.header_size > size) {
+		return IL_RejectImage(error, "truncated section table");
+	}
+
+	image->version = header.version;
+
+	for (uint16_t i = 0; i < header.section_count; ++i) {
+		struct IL_ImageSection section;
+		memcpy(&section, data + sizeof(header) + i * sizeof(section), sizeof(section));
+
+		if (section.offset < header.header_size || section.offset > size || section.size > size - section.offset) {
+			return IL_RejectImage(error, "section out of bounds");
+		}
+
+		const uint8_t** target = NULL;
+		size_t* target_size = NULL;
+		switch (section.type) {
+		case IL_SECTION_CODE:
+			target = &image->code;
+			target_size = &image->code_size;
+			break;
+		case IL_SECTION_RODATA:
+			target = &image->rodata;
+			target_size = &image->rodata_size;
+			break;
+		case IL_SECTION_SYMBOLS:
+			target = &image->symbols;
+			target_size = &image->symbols_size;
+			break;
+		case IL_SECTION_METADATA:
+			target = &image->metadata;
+			target_size = &image->metadata_size;
+			break;
+		case IL_SECTION_LINES:
+			target = &image->lines;
+			target_size = &image->lines_size;
+			break;
+		default:
+			// Unknown sections come from newer assemblers, they're skipped
+			continue;
+		}
+
+		if (*target != NULL) {
+			return IL_RejectImage(error, "duplicate section");
+		}
+
+		*target = data + section.offset;
+		*target_size = (size_t)section.size;
+	}
+
+	if (image->code == NULL) {
+		return IL_RejectImage(error, "missing code section");
+	}
+
+	if (image->symbols != NULL && !IL_ParseSymbols(image->symbols, image->symbols_size, error)) {
+		return false;
+	}
+
+	// Rows are checked as they're read, loading doesn't pay for them
+	if (image->lines != NULL && image->lines_size < sizeof(struct IL_ImageLines)) {
+		return IL_RejectImage(error, "truncated line table");
+	}
+
+	return true;
+}
+
+size_t IL_GetImageSymbolCount(const struct IL_Image* image) {
+	if (image->symbols == NULL) {
+		return 0;
+	}
+
+	struct IL_ImageSymbols symbols;
+	memcpy(&symbols, image->symbols, sizeof(symbols));
+	return symbols.count;
+}
+
+const char* IL_GetImageSymbol(const struct IL_Image* image, size_t index, uint64_t* offset) {
+	size_t count = IL_GetImageSymbolCount(image);
+	if (index >= count) {
+		return NULL;
+	}
+
+	struct IL_ImageSymbol symbol;
+	memcpy(&symbol, image->symbols + sizeof(struct IL_ImageSymbols) + index * sizeof(symbol), sizeof(symbol));
+
+	*offset = symbol.offset;
+	return (const char*)(image->symbols + sizeof(struct IL_ImageSymbols) + count * sizeof(symbol) + symbol.name);
+}
+
+size_t IL_GetImageLineCount(const struct IL_Image* image) {
+	if (image->lines == NULL) {
+		return 0;
+	}
+
+	struct IL_ImageLines lines;
+	memcpy(&lines, image->lines, sizeof(lines));
+	return lines.count;
+}
+
+void IL_InitLineReader(const struct IL_Image* image, struct IL_LineReader* reader) {
+	reader->data = image->lines != NULL ? image->lines + sizeof(struct IL_ImageLines) : NULL;
+	reader->end = image->lines != NULL ? image->lines + image->lines_size : NULL;
+	reader->left = (uint32_t)IL_GetImageLineCount(image);
+	reader->offset = 0;
+	reader->line = 0;
+}
+
+static bool IL_ReadVarint(struct IL_LineReader* reader, uint64_t* value) {
+	*value = 0;
+	for (uint32_t shift = 0; shift < 64; shift += 7) {
+		if (reader->data >= reader->end) {
+			return false;
+		}
+
+		uint8_t byte = *reader->data++;
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool IL_ReadLine(struct IL_LineReader* reader, uint64_t* offset, uint32_t* line) {
+	uint64_t offset_delta = 0;
+	uint64_t line_delta = 0;
+	if (reader->left == 0 || !IL_ReadVarint(reader, &offset_delta) || !IL_ReadVarint(reader, &line_delta)) {
+		return false;
+	}
+
+	reader->left -= 1;
+	reader->offset += offset_delta;
+	reader->line += (int64_t)(line_delta >> 1) ^ -(int64_t)(line_delta & 1);
+
+	*offset = reader->offset;
+	*line = (uint32_t)reader->line;
+	return true;
+}
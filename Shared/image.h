@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Container written by the assembler and mapped by the interpreter:
+// IL_ImageHeader, section_count IL_ImageSection entries, then the section data.
+
+// "RVMI" read as a little endian uint32
+#define IL_IMAGE_MAGIC 0x494D5652
+#define IL_IMAGE_VERSION 1
+
+// Section data starts on this boundary
+#define IL_IMAGE_ALIGNMENT 16
+
+enum IL_SectionType {
+	IL_SECTION_CODE = 1,
+	IL_SECTION_RODATA,
+	IL_SECTION_SYMBOLS,
+	IL_SECTION_METADATA, // Optional "key=value" lines
+	IL_SECTION_LINES, // Optional, written by the assembler with -g
+};
+
+struct IL_ImageHeader {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t section_count;
+	uint32_t header_size; // Header and section table
+	uint32_t reserved;
+};
+
+struct IL_ImageSection {
+	uint32_t type; // enum IL_SectionType
+	uint32_t flags;
+	uint64_t offset; // From the start of the image
+	uint64_t size;
+};
+
+// Symbols section, IL_ImageSymbols then count IL_ImageSymbol entries then their null terminated names
+struct IL_ImageSymbols {
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct IL_ImageSymbol {
+	uint64_t offset; // In the code section
+	uint32_t name; // From the end of the symbol entries
+	uint32_t reserved;
+};
+
+// Lines section, IL_ImageLines then count rows of two LEB128 numbers: the code offset delta unsigned and
+// the source line delta zigzag encoded, both from the previous row which starts at offset 0 line 0.
+// Rows are in code order, one per instruction, lines are 1-based.
+struct IL_ImageLines {
+	uint32_t count;
+	uint32_t reserved;
+};
+
+// Walks the rows of a lines section, nothing is decoded before it's read
+struct IL_LineReader {
+	const uint8_t* data;
+	const uint8_t* end;
+	uint32_t left;
+	uint64_t offset;
+	int64_t line;
+};
+
+// Sections of a parsed image, pointers into it, NULL and 0 when a section is absent
+struct IL_Image {
+	uint16_t version;
+
+	const uint8_t* code;
+	size_t code_size;
+
+	const uint8_t* rodata;
+	size_t rodata_size;
+
+	const uint8_t* symbols;
+	size_t symbols_size;
+
+	const uint8_t* metadata;
+	size_t metadata_size;
+
+	const uint8_t* lines;
+	size_t lines_size;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool IL_IsImage(const uint8_t* data, size_t size);
+
+// Checks the header, the section bounds and the symbol table, error is a static string
+bool IL_ParseImage(const uint8_t* data, size_t size, struct IL_Image* image, const char** error);
+
+size_t IL_GetImageSymbolCount(const struct IL_Image* image);
+const char* IL_GetImageSymbol(const struct IL_Image* image, size_t index, uint64_t* offset);
+
+// Rows of the lines section, IL_ReadLine returns false past the last one or on a truncated row
+size_t IL_GetImageLineCount(const struct IL_Image* image);
+void IL_InitLineReader(const struct IL_Image* image, struct IL_LineReader* reader);
+bool IL_ReadLine(struct IL_LineReader* reader, uint64_t* offset, uint32_t* line);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vm.h"
+#include "decoder.h"
+#include "verifier.h"
+#include "loader.h"
+#include "memory.h"
+#include "bench.h"
+#include "fusion.h"
+#include "jit.h"
+#include "host.h"
+#include "heap.h"
+
+// Runs each image on every engine and on the pool with the allocator counted, and fails if anything
+// VM_Execute ran touched the heap. Built against a core that counts in release builds too.
+
+// Skipped by ctest
+#define HEAPCHECK_SKIP 77
+
+#define HEAPCHECK_ITERATIONS 4
+
+static bool CheckImage(const char* path) {
+	const char* error = NULL;
+	struct VM_MappedImage mapped;
+	if (!VM_MapImage(path, &mapped, &error)) {
+		printf("Failed to load %s: %s\n", path, error);
+		return false;
+	}
+
+	struct VM_Program program;
+	struct VM_VerifyError verify;
+	if (!VM_DecodeProgram(&program, (uint8_t*)mapped.image.code, mapped.image.code_size, &verify)) {
+		printf("Invalid image %s at code offset 0x%zx: %s\n", path, verify.offset, verify.reason);
+		VM_UnmapImage(&mapped);
+		return false;
+	}
+
+	// Everything that's reached is compiled, from inside VM_Execute
+	VM_FuseProgram(&program, NULL);
+	bool jit = VM_CreateJit(&program, 0);
+
+	const struct VM_HostTable* host = &VM_BUILTIN_HOST_TABLE;
+	struct VM_BenchResult result;
+	uint64_t before = VM_GetHeapCountTotal();
+
+	VM_Benchmark(&program, VM_ENGINE_TABLE, host, HEAPCHECK_ITERATIONS, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &result);
+	uint64_t table = VM_GetHeapCountTotal();
+
+	VM_Benchmark(&program, VM_ENGINE_THREADED, host, HEAPCHECK_ITERATIONS, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &result);
+	uint64_t threaded = VM_GetHeapCountTotal();
+
+	if (jit) {
+		VM_Benchmark(&program, VM_ENGINE_JIT, host, HEAPCHECK_ITERATIONS, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &result);
+	}
+
+	uint64_t native = VM_GetHeapCountTotal();
+
+	VM_BenchmarkPool(&program, VM_ENGINE_THREADED, host, HEAPCHECK_ITERATIONS, VM_DEFAULT_MEMORY_SIZE, VM_DEFAULT_STACK_SIZE, &result);
+	uint64_t pool = VM_GetHeapCountTotal();
+
+	printf("%s: table %llu, threaded %llu, jit %llu, pool %llu allocations\n", path,
+		(unsigned long long)(table - before), (unsigned long long)(threaded - table),
+		(unsigned long long)(native - threaded), (unsigned long long)(pool - native));
+
+	VM_FreeJit(&program);
+	VM_FreeProgram(&program);
+	VM_UnmapImage(&mapped);
+	return pool == before;
+}
+
+int main(int argc, char** argv) {
+#ifndef VM_HEAP_COUNTING
+	(void)argc;
+	(void)argv;
+	printf("Heap counting isn't available in this build\n");
+	return HEAPCHECK_SKIP;
+#else
+	if (argc < 2) {
+		printf("Usage: %s <image>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	bool passed = true;
+	for (int i = 1; i < argc; ++i) {
+		passed = CheckImage(argv[i]) && passed;
+	}
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,132 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image.h"
+
+// Builds a small valid image, breaks one field at a time and checks IL_ParseImage rejects it for the right reason
+
+#define IMAGECHECK_SECTIONS 2
+#define IMAGECHECK_HEADER_SIZE (sizeof(struct IL_ImageHeader) + IMAGECHECK_SECTIONS * sizeof(struct IL_ImageSection))
+#define IMAGECHECK_CODE_OFFSET 64
+#define IMAGECHECK_CODE_SIZE 16
+#define IMAGECHECK_SYMBOLS_OFFSET (IMAGECHECK_CODE_OFFSET + IMAGECHECK_CODE_SIZE)
+#define IMAGECHECK_SYMBOLS_SIZE (sizeof(struct IL_ImageSymbols) + sizeof(struct IL_ImageSymbol) + sizeof("main"))
+#define IMAGECHECK_SIZE (IMAGECHECK_SYMBOLS_OFFSET + IMAGECHECK_SYMBOLS_SIZE)
+
+struct ImageCheck {
+	uint8_t data[IMAGECHECK_SIZE];
+	struct IL_ImageHeader header;
+	struct IL_ImageSection sections[IMAGECHECK_SECTIONS];
+	struct IL_ImageSymbols symbols;
+	struct IL_ImageSymbol symbol;
+};
+
+// A code section and a symbol table naming its start
+static void BuildImage(struct ImageCheck* check) {
+	memset(check, 0, sizeof(*check));
+
+	check->header.magic = IL_IMAGE_MAGIC;
+	check->header.version = IL_IMAGE_VERSION;
+	check->header.section_count = IMAGECHECK_SECTIONS;
+	check->header.header_size = IMAGECHECK_HEADER_SIZE;
+
+	check->sections[0].type = IL_SECTION_CODE;
+	check->sections[0].offset = IMAGECHECK_CODE_OFFSET;
+	check->sections[0].size = IMAGECHECK_CODE_SIZE;
+
+	check->sections[1].type = IL_SECTION_SYMBOLS;
+	check->sections[1].offset = IMAGECHECK_SYMBOLS_OFFSET;
+	check->sections[1].size = IMAGECHECK_SYMBOLS_SIZE;
+
+	check->symbols.count = 1;
+	check->symbol.offset = 0;
+	check->symbol.name = 0;
+}
+
+// Lays the fields out, called after a case changed them
+static void WriteImage(struct ImageCheck* check) {
+	uint8_t* data = check->data;
+	memcpy(data, &check->header, sizeof(check->header));
+	memcpy(data + sizeof(check->header), check->sections, sizeof(check->sections));
+
+	uint8_t* symbols = data + IMAGECHECK_SYMBOLS_OFFSET;
+	memcpy(symbols, &check->symbols, sizeof(check->symbols));
+	memcpy(symbols + sizeof(check->symbols), &check->symbol, sizeof(check->symbol));
+	memcpy(symbols + sizeof(check->symbols) + sizeof(check->symbol), "main", sizeof("main"));
+}
+
+static bool Expect(const char* name, struct ImageCheck* check, size_t size, const char* reason) {
+	WriteImage(check);
+
+	struct IL_Image image;
+	const char* error = NULL;
+	bool parsed = IL_ParseImage(check->data, size, &image, &error);
+
+	bool passed = reason == NULL ? parsed : !parsed && strcmp(error, reason) == 0;
+	printf("%s: %s, %s\n", name, parsed ? "accepted" : error, passed ? "ok" : "FAILED");
+	return passed;
+}
+
+int main(void) {
+	struct ImageCheck check;
+	bool passed = true;
+
+	BuildImage(&check);
+	passed = Expect("valid", &check, IMAGECHECK_SIZE, NULL) && passed;
+
+	BuildImage(&check);
+	check.header.magic ^= 1;
+	passed = Expect("magic", &check, IMAGECHECK_SIZE, "bad magic") && passed;
+
+	BuildImage(&check);
+	passed = Expect("header", &check, sizeof(struct IL_ImageHeader) - 1, "truncated header") && passed;
+
+	BuildImage(&check);
+	check.header.version = IL_IMAGE_VERSION + 1;
+	passed = Expect("version", &check, IMAGECHECK_SIZE, "unsupported version") && passed;
+
+	BuildImage(&check);
+	check.header.section_count = 1000;
+	passed = Expect("table", &check, IMAGECHECK_SIZE, "truncated section table") && passed;
+
+	BuildImage(&check);
+	check.sections[0].size = IMAGECHECK_SIZE;
+	passed = Expect("bounds", &check, IMAGECHECK_SIZE, "section out of bounds") && passed;
+
+	BuildImage(&check);
+	check.sections[0].offset = 0;
+	passed = Expect("overlap", &check, IMAGECHECK_SIZE, "section out of bounds") && passed;
+
+	BuildImage(&check);
+	check.sections[0].offset = UINT64_MAX;
+	passed = Expect("offset", &check, IMAGECHECK_SIZE, "section out of bounds") && passed;
+
+	BuildImage(&check);
+	check.sections[1].size = sizeof(struct IL_ImageSymbols) - 1;
+	passed = Expect("symbols", &check, IMAGECHECK_SIZE, "truncated symbol table") && passed;
+
+	BuildImage(&check);
+	check.symbols.count = 2;
+	passed = Expect("entries", &check, IMAGECHECK_SIZE, "truncated symbol table") && passed;
+
+	BuildImage(&check);
+	check.symbols.count = UINT32_MAX;
+	passed = Expect("count", &check, IMAGECHECK_SIZE, "truncated symbol table") && passed;
+
+	BuildImage(&check);
+	check.symbol.name = sizeof("main");
+	passed = Expect("name", &check, IMAGECHECK_SIZE, "symbol name out of bounds") && passed;
+
+	BuildImage(&check);
+	check.sections[1].type = IL_SECTION_CODE;
+	passed = Expect("duplicate", &check, IMAGECHECK_SIZE, "duplicate section") && passed;
+
+	BuildImage(&check);
+	check.sections[0].type = IL_SECTION_RODATA;
+	check.sections[1].type = IL_SECTION_METADATA;
+	passed = Expect("code", &check, IMAGECHECK_SIZE, "missing code section") && passed;
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}